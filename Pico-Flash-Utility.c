@@ -2,9 +2,9 @@
    Pico-Flash-Utility.c
    St-Louys Andre - November 2022
    astlouys@gmail.com
-   Revision 03-JAN-2023
+   Revision 14-OCT-2026
    Compiler: GNU 7.3.1
-   Version 2.00
+   Version 2.10
 
    Raspberry Pi Pico Utility to work with Pico's flash memory.
    An external monitor (or a PC running a terminal emulator program like TeraTerm)
@@ -17,7 +17,8 @@
    - The Firmware will never overwrite the Pico's manufacturing test results saved at 0x1007F000 (length: 107 bytes).
    - If you erase all the flash, the Pico will be seen as a "USB drive" automatically on next power-up.
    - Pico's "Unique number" is taken from the flash memory IC (and is never erased).
-   - Flash memory space goes from 0x10000000 to 0x101FFFFF (2MBytes).
+   - Flash memory space goes from 0x10000000 to 0x101FFFFF (2MBytes) on a
+     Pico, the actual flash size is detected at startup (see flash_probe()).
    - RAM   memory space goes from 0x20000000 to 0x20041FFF (264KBytes)
   
     - When including required system libraries to support the Pico W, firmware becomes far too big to be run from RAM (around 575 kBypes),
@@ -32,6 +33,36 @@
    26-NOV-2022 1.00 - Initial release.
    01-JAN_2023 2.00 - Add flash memory test function.
                     - Some code restructuring and cleanup.
+   14-OCT-2026 2.10 - Erase flash with 64 KB block erase commands whenever possible.
+                    - Program test patterns directly to erased flash (no read-modify-write).
+                    - Blank check compares flash content 32 bits at a time.
+                    - Optional pattern verification through the DMA sniffer (CRC32).
+                    - Optional dual-core pipeline for flash test (core 1 checks flash while core 0 erases and writes).
+                    - Bulk flash scans bypass the XIP cache.
+                    - Binary dump mode (CRC32 framed) for complete flash and RAM displays.
+                    - Memory dump lines built with a lookup table instead of sprintf().
+                    - Compact memory dump format summarizing repeated lines.
+                    - Terminal output buffered and sent in background by core 1.
+                    - Per-phase timing profile and throughput summary for flash test.
+                    - Optional per-sector erase / program latency capture, with histogram and outliers.
+                    - Flash test driven by a test plan (range, patterns, cycles) chosen from predefined profiles or entered by user.
+                    - Flash test snapshot verbosity: none, mismatching rows only (default) or full dump.
+                    - Pattern generator (offset, inverted offset, xorshift) regenerated on-the-fly for verification.
+                    - Flash test checkpoints saved to a reserved flash sector, interrupted test may be resumed.
+                    - Command mode with machine-parseable replies, for host scripts driving the utility unattended.
+                    - Long operations poll the console between sectors for <abort>, <pause> / <resume> and <status?>.
+                    - Per-sector CRC32 of flash memory, compared against a host-supplied list of expected hashes.
+                    - Differential flash_write(): unchanged sectors are skipped and 1 to 0 changes are programmed without erase.
+                    - Flash IC detection (JEDEC ID / SFDP) at startup, whole-flash operations scale to the real flash size.
+                    - flash_program(): page-granular programming of any length into erased flash, in one critical section.
+                    - Wear-levelled, log-structured record store (kv_xxx()) kept in flash, used to keep flash test results between runs.
+                    - Metadata region (erase counts, record store, checkpoints) and a central table of protected flash regions.
+                    - Blank check and verification split flash into unprotected spans, protected bytes are never compared.
+                    - RAM memory map from linker symbols, dump of meaningful RAM regions only and stack high-water marks.
+                    - Optional USB vendor bulk endpoint for binary transfers, text console remains on CDC (USB_VENDOR_BULK).
+                    - Image upload from the host (command mode UPLOAD): CRC-acknowledged frames, each sector programmed by core 1 while the next one is received, CRC32 verification.
+                    - Benchmark of flash and memory primitives (erase, program, XIP reads, memcpy, dump formatter, terminal output).
+                    - Job status (phase, percent, errors) updated by the engines, LED timer only armed while a job is running.
 \* ================================================================== */
 
 
@@ -41,17 +72,30 @@
 \* ------------------------------------------------------------------------------------------------------------------------------------------------------------------- */
 #include "hardware/adc.h"
 #include "hardware/clocks.h"
+#include "hardware/dma.h"
 #include "hardware/flash.h"
 #include "hardware/gpio.h"
+#include "hardware/structs/xip_ctrl.h"
 #include "hardware/uart.h"
 /// #include "pico/cyw43_arch.h"
+#include "pico/multicore.h"
+#include "pico/stdio/driver.h"
+#include "pico/stdio_uart.h"
+#include "pico/stdio_usb.h"
 #include "pico/stdlib.h"
 #include "pico/sync.h"
 #include "pico/unique_id.h"
 /// #include "pico_w.h"
+#include "malloc.h"
+#include "stddef.h"
 #include "stdio.h"
 #include "stdlib.h"
 #include "string.h"
+#include "version.h"
+
+#ifdef USB_VENDOR_BULK
+#include "tusb.h"
+#endif
 
 
 
@@ -67,9 +111,116 @@ typedef unsigned char UCHAR;
 
 
 /// #define RESTORE
+#define DMA_VERIFY  // verify flash test patterns with the DMA sniffer (comment out to verify with the CPU only).
+#define SECTOR_LATENCY  // capture erase and program latency of each flash sector (comment out to remove from flash test).
+#define DIFFERENTIAL_WRITE  // flash_write() skips unchanged sectors and avoids erase when possible (comment out to always erase and reprogram).
+/// #define PROGRAM_MAX_PAGES 16  // flash_program() leaves its critical section after this many pages (comment out to program each run in one critical section).
+/// #define USB_VENDOR_BULK  // binary transfers through a USB vendor bulk endpoint (set by the CMake option of the same name, see CMakeLists.txt).
 
 #define ADC_VCC  29
 
+/* DMA verification (see flash_verify_bisect()). */
+#define VERIFY_BISECT_SIZE  256  // a flash range found in error is split in halves down to this size before the CPU looks at its bytes.
+
+/* Memory dump formats. */
+#define DUMP_TEXT            1  // hex and ASCII text lines.
+#define DUMP_BINARY          2  // binary frames with CRC32 (see display_memory_binary()).
+#define DUMP_COMPACT         3  // hex and ASCII text lines, identical consecutive lines are summarized on a single line.
+#define DUMP_FRAME_SIZE   1024  // maximum number of data bytes in a binary frame.
+
+/* Per-sector latency definitions. */
+#define LATENCY_ERASE        0  // 4 KB sector erase.
+#define LATENCY_PROGRAM      1  // 4 KB sector program (programs of a few pages only are not recorded).
+#define LATENCY_BLOCK_ERASE  2  // 64 KB block erase, kept per block so that it is never compared with sector erases.
+#define LATENCY_OPERATIONS   3
+#define LATENCY_SECTORS     (PICO_FLASH_SIZE_BYTES / FLASH_SECTOR_SIZE)  // sectors with latency statistics.
+#define LATENCY_BLOCKS      (PICO_FLASH_SIZE_BYTES / FLASH_BLOCK_SIZE)   // blocks with latency statistics.
+#define LATENCY_BUCKETS     21  // histogram bucket n counts durations from 2^(n-1) to (2^n - 1) usec.
+#define LATENCY_OUTLIER    150  // a sector is reported when its average latency is above this percentage of the overall average.
+#define LATENCY_MAX_REPORT  16  // maximum number of outliers reported for each operation.
+
+/* Flash test phases timed by the profiler. */
+#define PHASE_ERASE          0  // erase_all_flash()
+#define PHASE_BLANK_CHECK    1  // flash_blank_check()
+#define PHASE_WRITE          2  // flash_write_pattern()
+#define PHASE_DISPLAY        3  // display_all_flash()
+#define PHASE_VERIFY         4  // flash_verify_pattern()
+#define PHASE_COUNT          5
+
+/* Flash test patterns (see pattern_next()). */
+#define PATTERN_00           0  // all bytes 0x00.
+#define PATTERN_55           1  // all bytes 0x55.
+#define PATTERN_AA           2  // all bytes 0xAA.
+#define PATTERN_55AA         3  // consecutive bytes 0x55 and 0xAA.
+#define PATTERN_AA55         4  // consecutive bytes 0xAA and 0x55.
+#define PATTERN_WALKING_ONES 5  // consecutive bytes 0x01, 0x02, 0x04, ... 0x80.
+#define PATTERN_ADDRESS      6  // each 32-bit word contains its own flash offset.
+#define PATTERN_PRNG         7  // pseudo-random words (xorshift32), seeded for every sector and write cycle.
+#define PATTERN_ADDRESS_INV  8  // each 32-bit word contains its own flash offset, inverted.
+#define PATTERN_COUNT        9
+#define PLAN_MAX_PATTERNS   16  // maximum number of patterns in a test plan.
+
+/* Command mode status codes (see command_mode()). */
+#define STATUS_OK            0  // command executed successfully.
+#define STATUS_ERRORS        1  // command executed, errors were found in flash memory.
+#define STATUS_UNKNOWN       2  // unknown command.
+#define STATUS_ARGUMENT      3  // missing or invalid argument.
+#define STATUS_ALIGNMENT     4  // offset or length not aligned on a sector boundary.
+#define STATUS_NOT_FOUND     5  // nothing to act upon (for example no checkpoint to resume).
+#define STATUS_TIMEOUT       6  // host stopped sending data.
+#define STATUS_FLASH_RUN     7  // firmware is run from flash, so flash memory can't be modified.
+
+#define UPLOAD_TIMEOUT    5000  // msec without data from the host before an image upload is abandoned.
+#define UPLOAD_RESYNC_IDLE  50  // msec without data from the host before a NAK is sent (see image_upload()).
+#define SEND_TIMEOUT      5000  // msec without room in the vendor TX FIFO before a binary transfer is abandoned (see binary_send()).
+#define HASH_CHUNK_SECTORS 256  // sectors hashed in one pass (1 MB), which is the size of SectorHash[] (see flash_hash_range()).
+
+/* Benchmark definitions (see benchmark()). */
+#define BENCH_RUNS           8                                                              // number of runs of each benchmark.
+#define BENCH_OFFSET        ((METADATA_OFFSET & ~(FLASH_BLOCK_SIZE - 1)) - FLASH_BLOCK_SIZE)  // 64 KB flash block erased and programmed by the benchmark.
+#define BENCH_READ_SIZE     (256 * 1024)                                                   // bytes read by each XIP read run (larger than the 16 KB XIP cache).
+#define BENCH_UART_LINES    32                                                             // lines sent by each terminal output run.
+
+/* Metadata region: last sectors of flash memory, skipped by every bulk engine (see FlashExclusion[]). From its beginning:
+     ERASE_COUNT_SECTORS   cumulative erase count of each flash sector (see erase_count_save()).
+     KV_SECTORS            record store: copy of Pico's manufacturing test results and flash test history (see kv_write()).
+     1 sector              flash test checkpoints (see checkpoint_save()). */
+#define METADATA_SECTORS    (ERASE_COUNT_SECTORS + KV_SECTORS + 1)
+#define METADATA_OFFSET     (FlashChip.Size - (METADATA_SECTORS * FLASH_SECTOR_SIZE))
+#define ERASE_COUNT_OFFSET  METADATA_OFFSET
+#define ERASE_COUNT_SECTORS ((FLASH_SIZE_SECTORS * sizeof(UINT16)) / FLASH_SECTOR_SIZE)  // room for the largest flash IC, so that layout doesn't depend on the IC.
+#define ERASE_COUNT_SIZE    ((FlashChip.Size / FLASH_SECTOR_SIZE) * sizeof(UINT16))      // bytes actually used for the flash IC found (see erase_count_load()).
+#define ERASE_COUNT_SAVE_MIN 256                                                          // sector erases counted before erase counts are saved again (see erase_count_save()).
+
+/* Flash exclusion policies (see flash_excluded()). */
+#define EXCLUDE_SKIP         1  // never erased, written nor checked by bulk engines (erase range, write pattern, blank check, verify).
+#define EXCLUDE_PRESERVE     2  // kept unchanged when its sector is erased or written, and never reported as an error.
+#define EXCLUSION_MANUFACTURING 0
+#define EXCLUSION_METADATA      1
+#define EXCLUSION_COUNT         2
+
+/* Flash test checkpoint definitions (see checkpoint_save()). */
+#define CHECKPOINT_OFFSET  (FlashChip.Size - FLASH_SECTOR_SIZE)  // last sector of the metadata region.
+#define CHECKPOINT_MAGIC   0x43484B50                                   // "PKHC" (a checkpoint record is written at this slot).
+#define CHECKPOINT_SLOTS   (FLASH_SECTOR_SIZE / FLASH_PAGE_SIZE)        // one checkpoint record per flash page.
+
+/* Record store definitions (see kv_write()). */
+#define KV_SECTORS         4                                            // flash sectors used by the record store, one of them is always kept erased.
+#define KV_OFFSET          (CHECKPOINT_OFFSET - (KV_SECTORS * FLASH_SECTOR_SIZE))  // record store sectors are just before the checkpoint sector and never tested.
+#define KV_MAGIC           0x5453564B                                   // "KVST" (sector is part of the record store).
+#define KV_MAX_KEYS        24                                           // keys go from 0 to KV_MAX_KEYS - 1.
+#define KV_MAX_VALUE       112                                          // largest value (bytes). All live records must fit in a sector with room to spare.
+#define KV_RECORD_SIZE(Length) ((sizeof(struct kv_record) + (Length) + 7) & ~7)  // records are aligned on 8 bytes.
+#define KV_KEY_TEST_RESULT 0                                            // struct test_result of the last flash test.
+#define KV_KEY_MANUFACTURING 1                                          // copy of Pico's manufacturing test results.
+#define KV_KEY_HISTORY     8                                            // first of TEST_HISTORY_SIZE keys with the struct test_result of previous flash tests.
+#define TEST_HISTORY_SIZE  8                                            // number of flash tests kept in history.
+
+/* Flash snapshot taken after each pattern has been written during flash test. */
+#define SNAPSHOT_NONE        0  // no snapshot, verification reports the errors.
+#define SNAPSHOT_MISMATCH    1  // only the rows that don't match the pattern written.
+#define SNAPSHOT_FULL        2  // complete range, every line displayed.
+
 #define FLAG_OFF 0x00
 #define FLAG_ON  0xFF
 
@@ -85,12 +236,48 @@ typedef unsigned char UCHAR;
 #define MODE_ERASE_WHOLE_FLASH        8
 #define MODE_BLANK_CHECK              9
 #define MODE_FLASH_TEST              10
+#define MODE_COMMAND                 12
+#define MODE_TEST_HISTORY            13
+#define MODE_BENCHMARK               14
 
 
 #define PICO_LED 25  // for Pico only (Pico W's LED must go through cyw43 library).
 
+/* Log buffer definitions. */
+#define LOG_BUFFER_SIZE   16384                         // size of the log buffer (must be a power of 2).
+#define LOG_HIGH_WATER    (LOG_BUFFER_SIZE - 1024)      // log buffer usage above which the log policy applies.
+#define LOG_CHUNK_SIZE      256                         // maximum number of bytes sent by core 1 at a time.
+#define LOG_POLICY_BLOCK      1                         // when above high water, wait for core 1 to send more data.
+#define LOG_POLICY_DROP       2                         // when above high water, drop new data and count it.
+
+/* Dual-core pipeline definitions. */
+#define JOB_BLANK_CHECK       1  // core 1 must check that a flash region is blank (0xFF).
+#define JOB_VERIFY            2  // core 1 must check that a flash region matches a sector-sized pattern.
+#define JOB_PROGRAM           3  // core 1 must program a flash sector from a RAM buffer (see image_upload()).
+#define JOB_RESULT_SAME       1  // JOB_PROGRAM: sector already held the data, nothing was erased.
+#define JOB_RESULT_OK         2  // JOB_PROGRAM: sector programmed and read back correctly.
+#define JOB_RESULT_FAIL       3  // JOB_PROGRAM: sector programmed, but read back doesn't match.
+#define PIPELINE_QUEUE_SIZE  64  // maximum number of jobs waiting for core 1 (must be a power of 2).
+
 #define RAM_BASE_ADDRESS 0x20000000
 
+/* RAM memory map definitions (see ram_map()). */
+#define RAM_MAP_REGIONS     9           // number of RAM regions in the memory map.
+#define STACK_FILL          0xA5A5A5A5  // stack space not used yet (see stack_paint()).
+#define STACK_PAINT_MARGIN  64          // bytes left untouched below the stack pointer when painting a stack.
+
+/* Flash IC detection (see flash_probe()). */
+#define FLASH_SIZE_MAX     (16 * 1024 * 1024)  // largest flash IC addressable through the XIP window.
+#define FLASH_SIZE_SECTORS (FLASH_SIZE_MAX / FLASH_SECTOR_SIZE)
+#define FLASH_CMD_JEDEC_ID 0x9F
+#define FLASH_CMD_WRITE_EN 0x06
+#define FLASH_CMD_STATUS   0x05                // read status register 1 (bit 0: erase or program in progress).
+#define FLASH_CMD_ERASE_32 0x52                // 32 KB block erase, not used by the SDK (see flash_erase_block32()).
+#define FLASH_CMD_SFDP     0x5A
+#define SFDP_SIGNATURE     0x50444653          // "SFDP" in little endian.
+#define PLAN_END_OF_FLASH  0xFFFFFFFF          // test plan end offset resolved at startup to the last sector before the metadata region.
+
+#define TEST_RESULT_OFFSET 0x7F000  // offset of Pico's manufacturing test result in flash memory.
 #define TEST_RESULT_SIZE  107  // size of Pico's manufacturing test result in flash memory.
 #define TOTAL_CYCLES      5    // total number of write cycles to do for the complete flash test.
 #define TYPE_PICO    1
@@ -107,30 +294,318 @@ typedef unsigned char UCHAR;
 \* ------------------------------------------------------------------------------------------------------------------------------------------------------------------- */
 /* NOTE: XIP_BASE ("eXecute-In-Place") is the base address of the flash memory in Pico's address space (memory map). */
 UINT8 *FlashBaseAddress = (UINT8 *)XIP_BASE;  // base address of flash memory.
+
+/* Flash IC characteristics, SDK defaults until flash_probe() reads them from the IC. */
+struct flash_chip
+{
+  UINT8  JedecId[3];                    // manufacturer, memory type and capacity code.
+  UINT8  FlagSfdp;                      // FLAG_ON if the IC has a valid SFDP table.
+  UINT8  EraseCommand;                  // opcode of the largest erase supported by both the IC and the SDK.
+  UINT16 PageSize;                      // program page size reported by the IC.
+  UINT32 Size;                          // capacity in bytes.
+  UINT32 EraseSize;                     // size erased by EraseCommand.
+} FlashChip = {{0, 0, 0}, FLAG_OFF, FLASH_BLOCK_ERASE_CMD, FLASH_PAGE_SIZE, PICO_FLASH_SIZE_BYTES, FLASH_BLOCK_SIZE};
+
+/* Flash regions protected from the bulk engines (metadata region is resolved by flash_probe()). */
+struct flash_exclusion
+{
+  UCHAR  Name[32];
+  UINT32 Offset;
+  UINT32 Length;
+  UINT8  Policy;                        // EXCLUDE_SKIP or EXCLUDE_PRESERVE.
+} FlashExclusion[EXCLUSION_COUNT] =
+{
+  {"Manufacturing test results", TEST_RESULT_OFFSET, TEST_RESULT_SIZE, EXCLUDE_PRESERVE},
+  {"Metadata",                   0,                  0,                EXCLUDE_SKIP}
+};
+
+UINT16 *EraseCount;  // cumulative erase count of each flash sector, saved to the metadata region (allocated for the flash IC found).
+UINT32 EraseCountPending = 0;  // sector erases counted in RAM since erase counts have last been saved.
+UINT8 *FlashReadAddress = (UINT8 *)XIP_NOCACHE_NOALLOC_BASE;  // same flash memory, through the XIP alias that bypasses the XIP cache (bulk sequential reads, by 32 bits words only).
 UINT8 *FlashOldData;                          // pointer to an allocated RAM memory space used for flash operations.
 UINT8 *FlashNewData;                          // pointer to an allocated RAM memory space used for flash operations.
 UINT8  SoftwareMode;                          // indicate current software mode.
 UINT8  WriteCycle = 0;                        // keep track of current memory write cycle.
 
-struct repeating_timer TimerMSec;     // time keeping and overall supervision callback
+/* Jobs handed by core 0 to core 1. Core 0 only writes PipelineHead, core 1 only writes PipelineTail. */
+struct pipeline_job
+{
+  UINT8   Type;
+  UINT32  Offset;
+  UINT32  Length;
+  UINT8   Pattern;  // pattern and write cycle to regenerate for JOB_VERIFY.
+  UINT8   Cycle;
+  UINT8  *Data;     // sector to program for JOB_PROGRAM (must stay unchanged until the job is completed).
+  volatile UINT8 Result;  // JOB_RESULT_xxx of JOB_PROGRAM, written by core 1.
+};
+
+struct pipeline_job PipelineJob[PIPELINE_QUEUE_SIZE];
+volatile UINT16 PipelineHead = 0;                                        // number of jobs posted by core 0.
+volatile UINT16 PipelineTail = 0;                                        // number of jobs completed by core 1.
+volatile UINT32 PipelineSectorFlags[FLASH_SIZE_SECTORS / 32];  // one bit for every sector found in error by core 1.
+volatile UINT8  Core1Ready   = FLAG_OFF;                                 // core 1 is running and may be paused during flash operations.
+UINT8           FlagPipeline = FLAG_OFF;                                 // blank checks and verifications are handed to core 1.
+UINT8           FlagSectorFlags = FLAG_OFF;                              // PipelineSectorFlags[] set by display_flash_mismatch() instead of core 1 (see flash_verify_pattern()).
+
+int DmaChannel = -1;  // DMA channel used with the sniffer (reserved on first use).
+
+UINT8 FlagVendorClaimed = FLAG_OFF;  // host has claimed the USB vendor bulk endpoint for binary transfers (see binary_vendor_claimed()).
+
+/* Terminal output is written to the log buffer by core 0 and sent to USB CDC and UART by core 1. */
+UCHAR           LogBuffer[LOG_BUFFER_SIZE];
+volatile UINT32 LogHead = 0;                  // number of bytes written to LogBuffer (core 0 only).
+volatile UINT32 LogTail = 0;                  // number of bytes sent to the terminal (core 1 only).
+UINT32          LogDropped = 0;               // number of bytes dropped with LOG_POLICY_DROP.
+UINT32          LogDroppedReported = 0;       // number of bytes dropped already reported in the log.
+UINT8           LogPolicy = LOG_POLICY_BLOCK; // what to do when the log buffer is above high water (see LOG command).
+UINT8           FlagLogActive = FLAG_OFF;     // terminal output goes through the log buffer.
+
+/* TinyUSB is shared: core 1 sends the log to USB CDC (see log_drain()) while core 0 reads the terminal and runs the
+   binary transfers. Every USB call of the utility is made while holding UsbMutex (the SDK's own stdio_usb mutex only
+   covers USB CDC, not the vendor bulk endpoint). */
+recursive_mutex_t UsbMutex;
+
+UINT8  FlagAbort      = FLAG_OFF;              // user asked to abort the on-going operation (see console_poll()).
+
+/* Progress of the on-going job. Only written by core 0 in thread mode (see status_begin()), read by
+   the LED timer callback, <status?> and profile_report() through status_read(). */
+struct job_status
+{
+  volatile UINT32 Sequence;             // odd while the fields below are being updated.
+  UINT8  FlagActive;                    // a job is running (LED timer is armed).
+  UINT8  Mode;                          // SoftwareMode when job started.
+  UINT8  Phase;                         // flash test phase in progress (PHASE_COUNT when not in a flash test).
+  UINT8  Cycle;                         // write cycle in progress.
+  UINT8  Percent;                       // progress of the whole job.
+  UINT32 StartOffset;                   // flash range of one step of the job.
+  UINT32 Length;
+  UINT32 Offset;                        // last flash offset reached.
+  UINT32 Step;                          // steps of the job completed (one step is one pass over the flash range).
+  UINT32 Steps;                         // total number of steps of the job.
+  UINT64 Errors;                        // errors found so far.
+  UINT64 StartTime;                     // time since power-up when job started (usec).
+} JobStatus;
+
+UINT32 StatusTicks;                     // 100 msec periods elapsed since the job started (LED timer callback only).
+
+/* Flash test plan: flash range to test, patterns to write and number of write cycles. */
+struct test_plan
+{
+  UCHAR  Name[32];
+  UINT32 StartOffset;                   // must be aligned on a sector boundary.
+  UINT32 EndOffset;                     // last byte tested (inclusive).
+  UINT8  Cycles;                        // number of complete write cycles.
+  UINT8  PatternCount;                  // number of patterns written during each cycle.
+  UINT8  Pattern[PLAN_MAX_PATTERNS];    // patterns, in the order they are written.
+  UINT8  Snapshot;                      // SNAPSHOT_NONE, SNAPSHOT_MISMATCH or SNAPSHOT_FULL.
+};
+
+/* Flash test progress, saved after each phase so that an interrupted test may be resumed. */
+struct test_checkpoint
+{
+  UINT32 Magic;                         // CHECKPOINT_MAGIC.
+  struct test_plan Plan;                // test plan being executed.
+  UINT8  FlagPipeline;                  // dual-core pipeline in use.
+  UINT8  Cycle;                         // write cycle in progress.
+  UINT8  PatternIndex;                  // index in Plan.Pattern[] of the pattern in progress.
+  UINT8  Phase;                         // next phase to execute (PHASE_ERASE to PHASE_VERIFY).
+  UINT64 TotalErrors;                   // errors found so far.
+  UINT32 Crc;                           // CRC32 of all previous fields.
+};
+
+/* Header at the beginning of each record store sector. */
+struct kv_sector_header
+{
+  UINT32 Magic;                         // KV_MAGIC.
+  UINT32 Sequence;                      // incremented each time a new sector is started.
+  UINT32 SequenceCheck;                 // ~Sequence, so that a partially programmed header is ignored.
+  UINT32 Reserved;
+};
+
+/* Record appended in the record store. Value follows, a zero length value deletes the key. */
+struct kv_record
+{
+  UINT16 Key;                           // 0xFFFF marks the erased space at the end of a sector.
+  UINT16 Length;                        // length of the value.
+  UINT32 Crc;                           // CRC32 of Key, Length and value.
+};
+
+/* Record store state, rebuilt from flash by kv_init(). */
+UINT8  FlagKvReady = FLAG_OFF;          // record store has been found or created (see kv_create()), nothing is written to it otherwise.
+UINT8  KvActive;                        // sector where records are appended.
+UINT32 KvIndex[KV_MAX_KEYS];            // flash offset of the latest record of each key (0 if key doesn't exist).
+UINT32 KvSequence;                      // sequence number of the active sector.
+UINT32 KvWriteOffset;                   // flash offset where next record will be appended.
+
+/* Summary of a flash test, kept in the record store. */
+struct test_result
+{
+  UCHAR  Name[32];                      // name of the test plan.
+  UINT64 TotalErrors;                   // errors found.
+  UINT64 StartTime;                     // time since power-up when test started (usec, Pico has no real-time clock).
+  UINT32 Runs;                          // number of flash tests run since the record store was created, including this one.
+  UINT32 Duration;                      // test duration (seconds).
+  UINT32 Throughput[PHASE_COUNT];       // throughput of each phase (KB / sec).
+  UINT8  Cycles;                        // write cycles completed.
+  UINT8  FlagAborted;                   // test was aborted by user.
+};
+
+/* Predefined test plans proposed in the flash test menu (PLAN_END_OF_FLASH is resolved by flash_probe()). */
+struct test_plan TestPlanProfile[] =
+{
+  {"Full burn-in",      0x00000000, PLAN_END_OF_FLASH, TOTAL_CYCLES, 5, {PATTERN_00, PATTERN_55, PATTERN_AA, PATTERN_55AA, PATTERN_AA55}, SNAPSHOT_MISMATCH},
+  {"Quick smoke test",  0x00100000, 0x0013FFFF, 1,            5, {PATTERN_55AA, PATTERN_WALKING_ONES, PATTERN_ADDRESS, PATTERN_ADDRESS_INV, PATTERN_PRNG}, SNAPSHOT_MISMATCH},
+  {"Extended burn-in",  0x00000000, PLAN_END_OF_FLASH, 10,           9, {PATTERN_00, PATTERN_55, PATTERN_AA, PATTERN_55AA, PATTERN_AA55, PATTERN_WALKING_ONES, PATTERN_ADDRESS, PATTERN_ADDRESS_INV, PATTERN_PRNG}, SNAPSHOT_MISMATCH}
+};
+#define TEST_PLAN_PROFILES (sizeof(TestPlanProfile) / sizeof(TestPlanProfile[0]))
+
+const UCHAR *PatternName[PATTERN_COUNT] = {"0x00", "0x55", "0xAA", "0x55 / 0xAA", "0xAA / 0x55", "walking ones", "offset in data", "pseudo-random", "inverted offset in data"};
+
+/* State of a pattern generator: produces the expected content of flash memory, one 32-bit word at a time. */
+struct pattern_generator
+{
+  UINT8  Pattern;        // one of the PATTERN_xxx definitions.
+  UINT8  Cycle;          // write cycle (used to seed PATTERN_PRNG).
+  UINT32 Offset;         // flash offset of the next word to generate.
+  UINT32 State;          // xorshift32 state (PATTERN_PRNG only).
+};
+
+/* Timing profile of each flash test phase. */
+struct phase_profile
+{
+  UINT64 StartTime;      // time_us_64() when the current run of this phase started.
+  UINT64 TotalTime;      // cumulative duration of all runs (usec).
+  UINT64 TotalBytes;     // cumulative number of bytes processed by all runs.
+  UINT32 Runs;           // number of runs of this phase.
+  UINT32 MinSectorTime;  // shortest average time per sector for a single run (usec).
+  UINT32 MaxSectorTime;  // longest average time per sector for a single run (usec).
+} PhaseProfile[PHASE_COUNT];
+
+/* Latency of one kind of operation on a flash sector or block. */
+struct latency_stats
+{
+  UINT32 Total;          // cumulative duration of the operations (usec).
+  UINT32 Max;            // longest operation (usec).
+  UINT16 Count;          // number of operations.
+};
+
+struct latency_stats SectorLatency[LATENCY_SECTORS][2];  // LATENCY_ERASE and LATENCY_PROGRAM of each flash sector.
+struct latency_stats BlockLatency[LATENCY_BLOCKS];       // LATENCY_BLOCK_ERASE of each flash block.
+
+UINT32 LatencyHistogram[LATENCY_OPERATIONS][LATENCY_BUCKETS];  // number of operations of each kind in each duration bucket.
+
+UINT32 SectorHash[HASH_CHUNK_SECTORS];  // CRC32 of each flash sector of the chunk being hashed (see flash_hash_range()).
+
+const UCHAR *PhaseName[PHASE_COUNT] = {"Erase", "Blank check", "Write", "Display", "Verify"};
+
+const UCHAR HexDigit[16] = {'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F'};  // nibble to hex character lookup table.
+
+struct repeating_timer TimerMSec;     // LED blinking callback, armed only while a job is running (see status_begin()).
+
+/* RAM region of the memory map (see ram_map()). */
+struct ram_region
+{
+  UCHAR  Name[32];
+  UINT32 Start;                         // absolute address.
+  UINT32 Length;
+  UINT8  FlagDump;                      // FLAG_ON if region content is meaningful and displayed in a RAM dump.
+};
+
+/* Linker script symbols giving Pico's RAM layout. */
+extern char __data_start__[];
+extern char __data_end__[];
+extern char __bss_start__[];
+extern char __bss_end__[];
+extern char __end__[];                  // heap start.
+extern char __HeapLimit[];
+extern char __StackBottom[];            // core 0 stack, in scratch Y.
+extern char __StackTop[];
+extern char __StackOneBottom[];         // core 1 stack, in scratch X.
+extern char __StackOneTop[];
 
 
 
 /* ------------------------------------------------------------------------------------------------------------------------------------------------------------------- *\
                                                                              Function prototypes.
 \* ------------------------------------------------------------------------------------------------------------------------------------------------------------------- */
+/* Time the flash and memory primitives the utility depends on. */
+void benchmark(void);
+
+/* Display the result of one benchmark. */
+void benchmark_report(UCHAR *Name, UINT32 OpBytes, UINT32 Ops, UINT32 *RunTime);
+
+/* Discard binary data received from the host until it stops sending. */
+void binary_discard(UINT32 IdleTime);
+
+/* Receive binary data from the host through USB CDC or the USB vendor bulk endpoint. */
+UINT8 binary_receive(UINT8 *Data, UINT32 Length);
+
+/* Send binary data to the host through USB CDC. */
+UINT8 binary_send(UINT8 *Data, UINT32 Length);
+
+/* Check if the host reads binary transfers from the USB vendor bulk endpoint. */
+UINT8 binary_vendor_claimed(void);
+
 /* Blink Pico's LED the specified number of times. */
 void blink_pico_led(UINT8 NumberOfTimes);
 
+/* Erase all flash test checkpoints. */
+void checkpoint_clear(void);
+
+/* Find the last flash test checkpoint saved. */
+UINT8 checkpoint_find(struct test_checkpoint *Checkpoint);
+
+/* Save flash test progress to the checkpoint sector. */
+void checkpoint_save(struct test_plan *Plan, UINT8 Cycle, UINT8 PatternIndex, UINT8 Phase, UINT64 TotalErrors);
+
+/* Execute a command received by console_poll() during a long operation. */
+void console_command(UCHAR *Line);
+
+/* Check for <abort>, <pause> or <status?> commands between sectors of a long operation. */
+UINT8 console_poll(UINT32 Offset);
+
+/* Core 1 entry point, executing blank check and verification jobs posted by core 0. */
+void core1_main(void);
+
+/* Check if firmware is run from flash, in which case command mode must not modify flash memory. */
+UINT8 command_flash_run(UCHAR *Details);
+
+/* Parse and execute commands received from a host script. */
+void command_mode(void);
+
+/* Parse a flash range given as command arguments. */
+UINT8 command_range(UCHAR *StartString, UCHAR *LengthString, UINT32 *StartOffset, UINT32 *Length);
+
+/* Send a machine-parseable status reply for a command. */
+void command_reply(UINT8 Status, UCHAR *Command, UCHAR *Details);
+
+/* Run a flash test plan from command mode and build the status reply. */
+UINT8 command_test(struct test_plan *Plan, struct test_checkpoint *Resume, UCHAR *Details);
+
+/* Update a standard CRC-32 (same as zlib) with a memory area. */
+UINT32 crc32_update(UINT32 Crc, UINT8 *Data, UINT32 Length);
+
+/* Compute a CRC32 of a memory area with the DMA sniffer hardware. */
+UINT32 dma_crc32(UINT8 *Address, UINT32 Length);
+
+/* Compute a CRC32 of a flash memory area streamed through the XIP streaming FIFO. */
+UINT32 dma_crc32_flash(UINT32 Offset, UINT32 Length);
+
 /* Display Pico's complete flash address space. */
-void display_all_flash(void);
+void display_all_flash(UINT8 DumpFormat);
 
 /* Display Pico's complete RAM address space. */
-void display_all_ram(void);
+void display_all_ram(UINT8 DumpFormat);
 
 /* Erase all flash memory and display complete log for this Raspberry Pi Pico. */
 void display_complete_log(void);
 
+/* Display the rows of a range of flash memory that don't match a test pattern. */
+void display_flash_mismatch(UINT32 StartOffset, UINT32 Length, UINT8 Pattern, UINT8 Cycle);
+
+/* Display a range of Pico's flash address space. */
+void display_flash_range(UINT32 StartOffset, UINT32 Length, UINT8 DumpFormat);
+
 /* Display address of functions. They should be in RAM, somewhere between 0x20000000 and 0x20041FFF. */
 void display_function_addresses(void);
 
@@ -138,36 +613,234 @@ void display_function_addresses(void);
 void display_manufacturing_test(void);
 
 /* Display memory content through external monitor. */
-void display_memory(UINT32 BaseAddress, UINT32 StartOffset, UINT32 Length);
+void display_memory(UINT32 BaseAddress, UINT32 StartOffset, UINT32 Length, UINT8 DumpFormat);
+
+/* Send memory content to the host as binary frames. */
+UINT8 display_memory_binary(UINT32 BaseAddress, UINT32 StartOffset, UINT32 Length);
 
 /* Determine if the microcontroller is a Pico or a Pico W and display Pico's Unique Number. */
 UINT8 display_microcontroller_id(void);
 
+/* Display RAM memory map, stack high-water marks and meaningful RAM regions only. */
+void display_ram_map(void);
+
 /* Display Pico's specific flash memory sector. */
 void display_specific_sector(void);
 
-/* Erase Pico's whole flash address space except Pico's manufacturing test results. */
+/* Display flash test history and flash erase counts kept in the metadata region. */
+void display_test_history(void);
+
+/* Erase Pico's whole flash address space except protected regions. */
 void erase_all_flash(UINT8 FlagUnattended);
 
+/* Add one to the erase count of the sectors of a flash range. */
+void erase_count_add(UINT32 Offset, UINT32 Length);
+
+/* Read the erase count of every sector from the metadata region. */
+void erase_count_load(void);
+
+/* Save the erase count of every sector to the metadata region. */
+void erase_count_save(void);
+
 /* Erase a specific sector of Pico's flash memory. */
 void erase_specific_sector(void);
 
 /* Check if flash area is blank (0xFF). */
 UINT64 flash_blank_check(void);
 
+/* Check if a range of flash memory is blank (0xFF), with header and summary. */
+UINT64 flash_blank_check_range(UINT32 StartOffset, UINT32 Length);
+
+/* Check if a region of flash memory is blank (0xFF) and display the ranges that are not. */
+UINT64 flash_blank_check_region(UINT32 Offset, UINT32 Length);
+
+/* Pause core 1 and disable interrupts before a flash erase or program operation. */
+UINT32 flash_enter_critical(void);
+
 /* Erase data in Pico flash memory. */
 void flash_erase(UINT32 FlashMemoryOffset);
 
+/* Erase a 32 KB flash block with the 32 KB block erase command of the flash IC. */
+void flash_erase_block32(UINT32 Offset);
+
+/* Erase a range of Pico's flash memory using the largest erase commands possible. */
+UINT flash_erase_range(UINT32 StartOffset, UINT32 Length);
+
+/* Find the protected flash region that overlaps a flash range. */
+struct flash_exclusion *flash_excluded(UINT32 Offset, UINT32 Length, UINT8 Policy);
+
+/* Restore interrupts and resume core 1 after a flash erase or program operation. */
+void flash_exit_critical(UINT32 InterruptMask);
+
+/* Compute the CRC32 of each sector of a flash range. */
+UINT32 flash_hash_range(UINT32 StartOffset, UINT32 Length);
+
+/* Copy the content of the protected regions of a flash sector into a sector buffer. */
+void flash_preserve(UINT32 SectorOffset, UINT8 *Buffer);
+
+/* Read flash IC JEDEC ID and SFDP table to find its size, erase and page sizes. */
+void flash_probe(void);
+
+/* Program data of any length into an erased flash area, one 256-byte page at a time. */
+UINT flash_program(UINT32 Offset, UINT8 *Data, UINT32 Length);
+
+/* Read bytes from the flash IC SFDP table. */
+void flash_sfdp_read(UINT32 Address, UINT8 *Buffer, UINT16 Length);
+
+/* Find the next span of a flash range that doesn't overlap any protected region. */
+UINT32 flash_span_next(UINT32 Offset, UINT32 EndOffset, UINT32 *SpanEnd);
+
 /* Flash memory test. */
 void flash_test(void);
 
+/* Display the steps that will be executed for a test plan. */
+void flash_test_describe(struct test_plan *Plan);
+
+/* Run a flash memory test plan (unattended), or resume it from a checkpoint. */
+UINT8 flash_test_run(struct test_plan *Plan, struct test_checkpoint *Resume, UINT64 *Errors);
+
+/* Split a flash range whose CRC32 doesn't match in halves until the bytes in error are found. */
+UINT64 flash_verify_bisect(UINT32 Offset, UINT32 Length, UINT8 Pattern, UINT8 Cycle);
+
+/* Check that a range of flash memory contains a test pattern. */
+UINT64 flash_verify_pattern(UINT32 StartOffset, UINT32 Length, UINT8 Pattern, UINT8 Cycle);
+
+/* Check byte by byte that a region of flash memory contains a test pattern and report errors. */
+UINT64 flash_verify_region(UINT32 Offset, UINT32 Length, UINT8 Pattern, UINT8 Cycle);
+
 /* Write data to Pico's flash memory. */
 UINT flash_write(UINT32 FlashMemoryOffset, UINT8 NewData[], UINT16 NewDataSize);
 
+/* Program a test pattern to a range of flash memory already erased. */
+UINT flash_write_pattern(UINT32 StartOffset, UINT32 Length, UINT8 Pattern, UINT8 Cycle);
+
+/* Format one line of a memory dump (address, hex and ASCII). */
+UINT16 format_memory_row(UCHAR *String, UINT32 Address, UINT8 *Data, UINT8 Count);
+
+/* Receive an image from the host and program it to flash memory. */
+UINT8 image_upload(UINT32 StartOffset, UINT32 Length, UCHAR *Details);
+
+/* Report the result of a sector programmed by core 1 during an image upload. */
+void image_upload_result(struct pipeline_job *Job, UINT32 Crc, UINT32 *Written, UINT32 *Failed);
+
+/* Ask user for the format of a memory dump. */
+UINT8 input_dump_format(void);
+
 /* Read a single character from stdin (external PC running TeraTerm or other terminal software). */
 void input_string(UCHAR *String);
 
-/* One second period callback function. */
+/* Read a string from stdin, with or without echo. */
+void input_string_echo(UCHAR *String, UINT8 FlagEcho);
+
+/* Ask user for the test plan to run. */
+UINT8 input_test_plan(struct test_plan *Plan);
+
+/* Append a record to the record store. */
+UINT kv_append(UINT8 Key, UINT8 *Value, UINT16 Length);
+
+/* Move the live records out of the oldest record store sector and erase it. */
+void kv_collect(void);
+
+/* Create the record store. */
+UINT kv_create(UINT8 FlagErase);
+
+/* Delete a key from the record store. */
+UINT kv_delete(UINT8 Key);
+
+/* Rebuild the record store index from flash. */
+void kv_init(void);
+
+/* Read the value of a key from the record store. */
+UINT kv_read(UINT8 Key, UINT8 *Value, UINT16 *Length);
+
+/* Add the records of a record store sector to the index. */
+UINT32 kv_scan(UINT8 Sector);
+
+/* Write the value of a key to the record store. */
+UINT kv_write(UINT8 Key, UINT8 *Value, UINT16 Length);
+
+/* Record the duration of an erase or program operation for the sector or block it covered. */
+void latency_record(UINT8 Operation, UINT32 Offset, UINT32 Duration);
+
+/* Display latency histogram and outlier sectors for erase and program operations. */
+void latency_report(void);
+
+/* Clear all per-sector latency data. */
+void latency_reset(void);
+
+/* Send a chunk of the log buffer to the terminal (called by core 1). */
+void log_drain(void);
+
+/* Wait until the log buffer has been completely sent to the terminal. */
+void log_flush(void);
+
+/* stdio driver input function: read characters from USB CDC or UART. */
+int log_in_chars(char *Buffer, int Length);
+
+/* stdio driver output function: write characters to the log buffer. */
+void log_out_chars(const char *Buffer, int Length);
+
+/* Write data to the log buffer, according to the log policy. */
+void log_write(const UCHAR *Data, UINT32 Length);
+
+/* Fill a sector-sized buffer with the test pattern of a flash sector. */
+void pattern_fill(UINT8 Pattern, UINT8 Cycle, UINT32 SectorOffset, UINT8 *Buffer);
+
+/* Generate the next 32-bit word of a test pattern. */
+UINT32 pattern_next(struct pattern_generator *Generator);
+
+/* Initialize a pattern generator at a flash offset. */
+void pattern_start(struct pattern_generator *Generator, UINT8 Pattern, UINT8 Cycle, UINT32 Offset);
+
+/* Post a job to core 1. */
+struct pipeline_job *pipeline_post(UINT8 Type, UINT32 Offset, UINT32 Length, UINT8 Pattern, UINT8 Cycle, UINT8 *Data);
+
+/* Check if core 1 found an error in a sector and clear its flag. */
+UINT8 pipeline_sector_failed(UINT32 SectorOffset);
+
+/* Wait until core 1 has completed all jobs posted. */
+void pipeline_wait(void);
+
+/* Mark the end of a flash test phase and cumulate its timing. */
+void profile_end(UINT8 Phase, UINT32 Bytes);
+
+/* Display the timing summary of all flash test phases. */
+void profile_report(void);
+
+/* Clear all flash test phase timings. */
+void profile_reset(void);
+
+/* Mark the beginning of a flash test phase. */
+void profile_start(UINT8 Phase);
+
+/* Build the RAM memory map from the linker script symbols. */
+UINT8 ram_map(struct ram_region *Region);
+
+/* Find the lowest address ever used in a stack painted by stack_paint(). */
+UINT32 stack_high_water(UINT32 Bottom, UINT32 Top);
+
+/* Fill the unused part of the current core's stack with STACK_FILL. */
+void stack_paint(UINT32 Bottom);
+
+/* Start reporting the progress of a job and arm the LED timer. */
+void status_begin(UINT8 Mode, UINT32 StartOffset, UINT32 Length, UINT32 Steps);
+
+/* Stop reporting the progress of a job and disarm the LED timer. */
+void status_end(void);
+
+/* Update the number of errors found by the on-going job. */
+void status_errors(UINT64 Errors);
+
+/* Update the last flash offset reached by the on-going job. */
+void status_offset(UINT32 Offset);
+
+/* Update the phase of the on-going job. */
+void status_phase(UINT8 Phase, UINT8 Cycle, UINT32 Step);
+
+/* Take a consistent copy of the job status. */
+UINT8 status_read(struct job_status *Status);
+
+/* Hundred millisecond period callback function, blinking Pico's LED while a job is running. */
 bool timer_callback_ms(struct repeating_timer *TimerMSec);
 
 /* Send a string to VT101 monitor through Pico UART. */
@@ -175,6 +848,18 @@ void uart_send(UINT16 LineNumber, UCHAR *String);
 
 
 
+/* stdio driver used to send all terminal output through the log buffer (needs the prototypes above). */
+stdio_driver_t StdioLog =
+{
+  .out_chars = log_out_chars,
+  .in_chars  = log_in_chars,
+  #if PICO_STDIO_ENABLE_CRLF_SUPPORT
+  .crlf_enabled = PICO_STDIO_DEFAULT_CRLF
+  #endif
+};
+
+
+
 /* ------------------------------------------------------------------------------------------------------------------------------------------------------------------- *\
                                                                           Main program entry point.
 \* ------------------------------------------------------------------------------------------------------------------------------------------------------------------- */
@@ -193,9 +878,15 @@ int main(void)
   UINT32 SectorAddress;
   UINT32 StartAddress;
 
+  struct test_checkpoint Checkpoint;
+  struct test_result Result;
+
   uart_inst_t *Uart;  // Pico's UART used to serially transfer data to an external monitor or to a PC.
 
 
+  /* Fill unused core 0 stack space, to find its high-water mark later (see display_ram_map()). */
+  stack_paint((UINT32)__StackBottom);
+
   /* Initialize UART0 used for bi-directional communication with a PC running TeraTermn (or other) terminal emulation software. */
   stdio_init_all();
   uart_init(uart0, 921600);
@@ -216,6 +907,9 @@ int main(void)
   gpio_set_dir(PICO_LED, GPIO_OUT);
 
 
+  /* Retrieve flash IC characteristics once, since flash regions and RAM allocations depend on them. */
+  flash_probe();
+
   /* Check if we are running on a Pico or Pico W. */
   PicoType = display_microcontroller_id();
 
@@ -256,11 +950,66 @@ int main(void)
   \* ---------------------------------------------------------------- */
   FlashOldData = (UINT8 *)malloc(FLASH_SECTOR_SIZE);
   FlashNewData = (UINT8 *)malloc(FLASH_SECTOR_SIZE);
+  EraseCount   = (UINT16 *)malloc(ERASE_COUNT_SIZE);  // 1 KB for a 2 MB flash IC.
 
 
 
-  /* Initialize callback function for 100 millisecond timer (to flash current on-going cycle to user during processing). */
-  add_repeating_timer_ms(100, timer_callback_ms, NULL, &TimerMSec);
+  /* ---------------------------------------------------------------- *\
+        Start core 1 to run flash test jobs in parallel with core 0.
+  \* ---------------------------------------------------------------- */
+  recursive_mutex_init(&UsbMutex);
+  multicore_launch_core1(core1_main);
+  while (Core1Ready == FLAG_OFF)
+    tight_loop_contents();
+
+
+
+  /* ---------------------------------------------------------------- *\
+       From now on, terminal output is written to the log buffer and
+             sent to USB CDC and UART by core 1 in background.
+  \* ---------------------------------------------------------------- */
+  stdio_set_driver_enabled(&stdio_usb,  false);
+  stdio_set_driver_enabled(&stdio_uart, false);
+  stdio_set_driver_enabled(&StdioLog,   true);
+  FlagLogActive = FLAG_ON;
+
+
+
+  /* ---------------------------------------------------------------- *\
+           Tell user if a flash test has been interrupted.
+  \* ---------------------------------------------------------------- */
+  if (checkpoint_find(&Checkpoint) == FLAG_ON)
+  {
+    sprintf(String, "Flash test <%s> has been interrupted at cycle %u. Select option 10 to resume it.\r\r", Checkpoint.Plan.Name, Checkpoint.Cycle + 1);
+    uart_send(__LINE__, String);
+  }
+
+
+
+  /* ---------------------------------------------------------------- *\
+       Rebuild record store index and display last flash test result.
+  \* ---------------------------------------------------------------- */
+  kv_init();
+  erase_count_load();
+
+  /* The record store is never created at power-up: its sectors may hold user data (see kv_create()). */
+  if (FlagKvReady == FLAG_OFF)
+    uart_send(__LINE__, "No record store found: flash test results will be kept once it has been created (see option 10).\r\r");
+
+  /* Keep a copy of Pico's manufacturing test results in the metadata region the first time they are found (kv_write() does nothing if there is no record store). */
+  if ((kv_read(KV_KEY_MANUFACTURING, FlashNewData, &DataInput) != 0) && (FlashBaseAddress[TEST_RESULT_OFFSET] != 0xFF))
+    kv_write(KV_KEY_MANUFACTURING, &FlashBaseAddress[TEST_RESULT_OFFSET], TEST_RESULT_SIZE);
+
+  if ((kv_read(KV_KEY_TEST_RESULT, (UINT8 *)&Result, &DataInput) == 0) && (DataInput == sizeof(Result)))
+  {
+    sprintf(String, "Last flash test <%s>: %llu error(s) after %u write cycle(s)%s. %lu flash test(s) run so far.\r\r", Result.Name, Result.TotalErrors, Result.Cycles, (Result.FlagAborted == FLAG_ON) ? " (aborted)" : "", Result.Runs);
+    uart_send(__LINE__, String);
+  }
+
+
+
+  /* Nothing is running yet (100 millisecond LED timer is armed by status_begin() when a job starts). */
+  JobStatus.Phase = PHASE_COUNT;
 
   
   
@@ -293,7 +1042,7 @@ int main(void)
     printf("                    1) Display Pico's manufacturing test results.\r");
     printf("                    2) Display Pico's flash memory specific sector.\r");
     printf("                    3) Display Pico's complete flash address space.\r");
-    printf("                    4) Display Pico's complete RAM address space.\r");
+    printf("                    4) Display Pico's RAM (memory map or complete address space).\r");
     printf("                    5) Display firmware functions address.\r");
     printf("                    6) Erase all flash and generate Pico's complete log.\r");
     printf("                    7) Erase a specific sector of Pico's flash.\r");
@@ -301,6 +1050,9 @@ int main(void)
     printf("                    9) Flash memory blank check.\r");
     printf("                   10) Flash memory test.\r");
     printf("                   11) Clear screen.\r");
+    printf("                   12) Command mode (for host scripts).\r");
+    printf("                   13) Display flash test history and erase counts.\r");
+    printf("                   14) Benchmark flash and memory primitives.\r");
     printf("\r");
 
     
@@ -308,6 +1060,7 @@ int main(void)
     input_string(String);
     if (String[0] == 0x0D) continue;
     Menu = atoi(String);
+    FlagAbort = FLAG_OFF;
     
     
     switch(Menu)
@@ -332,7 +1085,7 @@ int main(void)
         /* Display Pico's complete flash address space. */
         printf("\r\r");
         SoftwareMode = MODE_DISPLAY_COMPLETE_FLASH;
-        display_all_flash();
+        display_all_flash(input_dump_format());
         printf("\r\r");
       break;
       
@@ -340,7 +1093,13 @@ int main(void)
         /* Display Pico's complete RAM address space. */
         printf("\r\r");
         SoftwareMode = MODE_DISPLAY_COMPLETE_RAM;
-        display_all_ram();
+        printf("                    Display <M>emory map (meaningful regions only) or <F>ull RAM address space <M/F>: ");
+        input_string(String);
+        printf("\r\r");
+        if ((strcmp(String, "M") == 0) || (strcmp(String, "m") == 0))
+          display_ram_map();
+        else
+          display_all_ram(input_dump_format());
         printf("\r\r");
       break;
 
@@ -369,7 +1128,7 @@ int main(void)
       break;
 
       case (8):
-        /* Erase Pico's whole flash address space, except manufacturing test results. */
+        /* Erase Pico's whole flash address space, except protected regions. */
         printf("\r\r");
         SoftwareMode = MODE_ERASE_WHOLE_FLASH;
         erase_all_flash(FLAG_OFF);
@@ -398,6 +1157,30 @@ int main(void)
           printf("\r");
       break;
 
+      case (12):
+        /* Command mode, driven by a host script. */
+        printf("\r\r");
+        SoftwareMode = MODE_COMMAND;
+        command_mode();
+        printf("\r\r");
+      break;
+
+      case (13):
+        /* Display flash test history and erase counts kept in the metadata region. */
+        printf("\r\r");
+        SoftwareMode = MODE_TEST_HISTORY;
+        display_test_history();
+        printf("\r\r");
+      break;
+
+      case (14):
+        /* Time flash and memory primitives. */
+        printf("\r\r");
+        SoftwareMode = MODE_BENCHMARK;
+        benchmark();
+        printf("\r\r");
+      break;
+
       default:
         printf("\r\r");
         printf("                    Invalid choice... please re-enter [%s]  [%u]\r\r\r\r\r", String, Menu);
@@ -414,135 +1197,210 @@ int main(void)
 
 
 /* $PAGE */
-/* $TITLE=blink_pico_led() */
+/* $TITLE=benchmark() */
 /* ------------------------------------------------------------------ *\
-            Blink Pico's LED the specified number of times.
+       Time the flash and memory primitives the utility depends on.
+     NOTES:
+     - Each benchmark is run BENCH_RUNS times, see benchmark_report()
+       for the results displayed.
+     - Flash erase and program benchmarks use the 64 KB block at
+       BENCH_OFFSET (just below the metadata region), whose content is
+       lost. Each operation is timed alone, inside its own critical
+       section (see flash_enter_critical()).
+     - The SDK erases 32 KB as eight sector erases (it only knows the
+       4 KB sector and 64 KB block erase commands), so the 32 KB
+       benchmark sends the 32 KB block erase command itself (see
+       flash_erase_block32()).
+     - XIP read benchmarks read BENCH_READ_SIZE bytes from the
+       beginning of flash, through the cached alias (cache flushed
+       before each run) and through the alias that bypasses the cache.
+     - Terminal output benchmark includes the time needed to send the
+       log buffer to the terminal (see log_flush()).
 \* ------------------------------------------------------------------ */
-void blink_pico_led(UINT8 NumberOfTimes)
+void benchmark(void)
 {
-  UINT8 Loop1UInt8;
-
-
-  for (Loop1UInt8 = 0; Loop1UInt8 < NumberOfTimes; ++Loop1UInt8)
-  {
-    gpio_put(PICO_LED, true);
-    sleep_ms(120);
-    gpio_put(PICO_LED, false);
-    sleep_ms(300);
-  }
+  UCHAR String[256];
 
-  return;
-}
+  UINT8 Run;
 
+  UINT32 InterruptMask;
+  UINT32 Loop1UInt32;
+  UINT32 RunTime[BENCH_RUNS];
+  UINT32 StartTime;
 
 
+  printf("                    This will erase Pico's flash from offset 0x%8.8X to offset 0x%8.8X.\r", BENCH_OFFSET, (BENCH_OFFSET + FLASH_BLOCK_SIZE - 1));
+  printf("                    Are you sure you want to proceed <Y/N>: ");
+  input_string(String);
+  if ((strcmp(String, "Y") != 0) && (strcmp(String, "y") != 0))
+    return;
+  printf("\r\r");
 
 
-/* $PAGE */
-/* $TITLE=display_all_flash() */
-/* ------------------------------------------------------------------ *\
-             Display Pico's complete flash address space.
-\* ------------------------------------------------------------------ */
-void display_all_flash(void)
-{
-  UCHAR String[256];
+  if (((void *)main < (void *)0x20000000) || ((void *)main > (void *)0x20041FFF))
+  {
+    sprintf(String, "<<<<< FATAL >>>>> YOU CAN'T BENCHMARK FLASH MEMORY WHILE YOU RUN THE APPLICATION FROM FLASH.\r\r\r");
+    uart_send(__LINE__, String);
 
-  UINT32 StartOffset;
-  UINT32 Length;
+    return;
+  }
 
-  
-  StartOffset = 0x00000000;
-  Length      = 0x00200000;
+  if (flash_excluded(BENCH_OFFSET, FLASH_BLOCK_SIZE, 0) != NULL)
+  {
+    sprintf(String, "Benchmark flash block 0x%8.8X overlaps <%s>, benchmark cancelled.\r\r\r", BENCH_OFFSET, flash_excluded(BENCH_OFFSET, FLASH_BLOCK_SIZE, 0)->Name);
+    uart_send(__LINE__, String);
 
+    return;
+  }
 
 
   printf("=======================================================================================================\r");
-  sprintf(String, "Display Pico's complete flash address space:\r");
+  sprintf(String, "Benchmark of flash and memory primitives (%u runs each).\r\r", BENCH_RUNS);
   uart_send(__LINE__, String);
+  uart_send(__LINE__, "Primitive                       Op size   Ops/run   Op min (usec)   avg (usec)   max (usec)      MB/s\r");
+  uart_send(__LINE__, "-----------------------------   -------   -------   -------------   ----------   ----------   -------\r");
 
-  sprintf(String, "XIP_BASE: 0x%p   StartOffset: 0x%8.8X   Length: 0x%8.8X (%u)\r", XIP_BASE, StartOffset, Length, Length);
-  uart_send(__LINE__, String);
 
-  sprintf(String, "(Note: Pico's flash memory space goes from 0x10000000 to 0x101FFFFF)\r\r");
-  uart_send(__LINE__, String);
 
-  display_memory(XIP_BASE, StartOffset, Length);
+  /* ----------------------------------------------------- *\
+                      Flash erase (4, 32, 64 KB).
+  \* ----------------------------------------------------- */
+  for (Run = 0; Run < BENCH_RUNS; ++Run)
+  {
+    InterruptMask = flash_enter_critical();
+    StartTime     = time_us_32();
+    flash_range_erase(BENCH_OFFSET + ((Run % (FLASH_BLOCK_SIZE / FLASH_SECTOR_SIZE)) * FLASH_SECTOR_SIZE), FLASH_SECTOR_SIZE);
+    RunTime[Run]  = time_us_32() - StartTime;
+    flash_exit_critical(InterruptMask);
+    erase_count_add(BENCH_OFFSET + ((Run % (FLASH_BLOCK_SIZE / FLASH_SECTOR_SIZE)) * FLASH_SECTOR_SIZE), FLASH_SECTOR_SIZE);
+  }
+  benchmark_report("flash_range_erase() 4 KB", FLASH_SECTOR_SIZE, 1, RunTime);
 
-  printf("\r");
-  sprintf(String, "End of display Pico's complete flash address space.\r");
-  uart_send(__LINE__, String);
-  printf("=======================================================================================================\r\r\r");
+  for (Run = 0; Run < BENCH_RUNS; ++Run)
+  {
+    InterruptMask = flash_enter_critical();
+    StartTime     = time_us_32();
+    flash_erase_block32(BENCH_OFFSET + ((Run % 2) * (FLASH_BLOCK_SIZE / 2)));
+    RunTime[Run]  = time_us_32() - StartTime;
+    flash_exit_critical(InterruptMask);
+    erase_count_add(BENCH_OFFSET + ((Run % 2) * (FLASH_BLOCK_SIZE / 2)), (FLASH_BLOCK_SIZE / 2));
+  }
+  benchmark_report("flash_erase_block32() 32 KB", (FLASH_BLOCK_SIZE / 2), 1, RunTime);
 
-  return;
-}
+  for (Run = 0; Run < BENCH_RUNS; ++Run)
+  {
+    InterruptMask = flash_enter_critical();
+    StartTime     = time_us_32();
+    flash_range_erase(BENCH_OFFSET, FLASH_BLOCK_SIZE);
+    RunTime[Run]  = time_us_32() - StartTime;
+    flash_exit_critical(InterruptMask);
+    erase_count_add(BENCH_OFFSET, FLASH_BLOCK_SIZE);
+  }
+  benchmark_report("flash_range_erase() 64 KB", FLASH_BLOCK_SIZE, 1, RunTime);
 
 
 
+  /* ----------------------------------------------------- *\
+       Flash program, one page at a time (block is erased).
+  \* ----------------------------------------------------- */
+  memset(FlashNewData, 0x55, FLASH_SECTOR_SIZE);
+  for (Run = 0; Run < BENCH_RUNS; ++Run)
+  {
+    /* Each run programs every page of its own sector. */
+    RunTime[Run] = 0;
+    for (Loop1UInt32 = 0; Loop1UInt32 < FLASH_SECTOR_SIZE; Loop1UInt32 += FLASH_PAGE_SIZE)
+    {
+      InterruptMask = flash_enter_critical();
+      StartTime     = time_us_32();
+      flash_range_program(BENCH_OFFSET + (Run * FLASH_SECTOR_SIZE) + Loop1UInt32, &FlashNewData[Loop1UInt32], FLASH_PAGE_SIZE);
+      RunTime[Run] += time_us_32() - StartTime;
+      flash_exit_critical(InterruptMask);
+    }
+  }
+  benchmark_report("flash_range_program() page", FLASH_PAGE_SIZE, (FLASH_SECTOR_SIZE / FLASH_PAGE_SIZE), RunTime);
 
 
-/* $PAGE */
-/* $TITLE=display_all_ram() */
-/* ------------------------------------------------------------------ *\
-               Display Pico's complete RAM address space.
-\* ------------------------------------------------------------------ */
-void display_all_ram(void)
-{
-  UCHAR String[256];
 
-  UINT32 StartOffset;
-  UINT32 Length;
+  /* ----------------------------------------------------- *\
+             XIP sequential reads, cached and uncached.
+  \* ----------------------------------------------------- */
+  for (Run = 0; Run < BENCH_RUNS; ++Run)
+  {
+    xip_ctrl_hw->flush = 1;
+    (void)xip_ctrl_hw->flush;  // flush is complete when read returns.
 
-  
-  StartOffset = 0x00000000;
-  Length      = 0x00042000;
-
-
-  printf("=======================================================================================================\r");
-  sprintf(String, "Display Pico's complete RAM address space:\r");
-  uart_send(__LINE__, String);
+    StartTime = time_us_32();
+    for (Loop1UInt32 = 0; Loop1UInt32 < BENCH_READ_SIZE; Loop1UInt32 += 4)
+      (void)*(volatile UINT32 *)&FlashBaseAddress[Loop1UInt32];
+    RunTime[Run] = time_us_32() - StartTime;
+  }
+  benchmark_report("XIP read (cached)", BENCH_READ_SIZE, 1, RunTime);
 
-  sprintf(String, "RAM base address: 0x%p   StartOffset: 0x%6.6X   Length: 0x%X (%u)\r", RAM_BASE_ADDRESS, StartOffset, Length, Length);
-  uart_send(__LINE__, String);
+  for (Run = 0; Run < BENCH_RUNS; ++Run)
+  {
+    StartTime = time_us_32();
+    for (Loop1UInt32 = 0; Loop1UInt32 < BENCH_READ_SIZE; Loop1UInt32 += 4)
+      (void)*(volatile UINT32 *)&FlashReadAddress[Loop1UInt32];
+    RunTime[Run] = time_us_32() - StartTime;
+  }
+  benchmark_report("XIP read (uncached)", BENCH_READ_SIZE, 1, RunTime);
 
-  sprintf(String, "(Note: Pico's RAM memory space goes from 0x20000000 to 0x20041FFF)\r\r");
-  uart_send(__LINE__, String);
 
-  display_memory(RAM_BASE_ADDRESS, StartOffset, Length);
 
-  printf("\r");
-  sprintf(String, "End of Pico's RAM address space.\r");
-  uart_send(__LINE__, String);
-  printf("=======================================================================================================\r\r\r");
+  /* ----------------------------------------------------- *\
+                     RAM to RAM memcpy().
+  \* ----------------------------------------------------- */
+  for (Run = 0; Run < BENCH_RUNS; ++Run)
+  {
+    StartTime = time_us_32();
+    for (Loop1UInt32 = 0; Loop1UInt32 < 64; ++Loop1UInt32)
+      memcpy(FlashOldData, FlashNewData, FLASH_SECTOR_SIZE);
+    RunTime[Run] = time_us_32() - StartTime;
+  }
+  benchmark_report("memcpy() RAM to RAM", FLASH_SECTOR_SIZE, 64, RunTime);
 
-  return;
-}
 
 
+  /* ----------------------------------------------------- *\
+       Memory dump formatter used by display_memory().
+  \* ----------------------------------------------------- */
+  for (Run = 0; Run < BENCH_RUNS; ++Run)
+  {
+    StartTime = time_us_32();
+    for (Loop1UInt32 = 0; Loop1UInt32 < FLASH_SECTOR_SIZE; Loop1UInt32 += 16)
+      format_memory_row(String, (RAM_BASE_ADDRESS + Loop1UInt32), &FlashOldData[Loop1UInt32], 16);
+    RunTime[Run] = time_us_32() - StartTime;
+  }
+  benchmark_report("format_memory_row() 16 bytes", 16, (FLASH_SECTOR_SIZE / 16), RunTime);
 
 
 
-/* $TITLE=display_complete_log() */
-/* ------------------------------------------------------------------- *\
-                  Erase all flash memory and display
-               complete log for this Raspberry Pi Pico.
-\* ------------------------------------------------------------------- */
-void display_complete_log(void)
-{
-  UCHAR String[256];
+  /* ----------------------------------------------------- *\
+               Terminal output through uart_send().
+  \* ----------------------------------------------------- */
+  format_memory_row(String, RAM_BASE_ADDRESS, FlashOldData, 16);
+  for (Run = 0; Run < BENCH_RUNS; ++Run)
+  {
+    log_flush();
+    StartTime = time_us_32();
+    for (Loop1UInt32 = 0; Loop1UInt32 < BENCH_UART_LINES; ++Loop1UInt32)
+      uart_send(__LINE__, String);
+    log_flush();
+    RunTime[Run] = time_us_32() - StartTime;
+  }
+  printf("\r");
+  benchmark_report("uart_send() line", strlen(String), BENCH_UART_LINES, RunTime);
 
 
-  printf("                    This will erase Pico's whole flash address space except Pico's manufacturing test results.\r");
-  printf("                    Are you sure you want to proceed <Y/N>: ");
-  input_string(String);
-  if ((strcmp(String, "Y") != 0) && (strcmp(String, "y") != 0))
-    return;
 
+  /* Leave benchmark block erased. */
+  flash_erase_range(BENCH_OFFSET, FLASH_BLOCK_SIZE);
+  printf("\r");
+  erase_count_save();
 
-  display_manufacturing_test();
-  erase_all_flash(FLAG_ON);
-  flash_blank_check();
-  display_all_flash();
-  display_function_addresses();
+  sprintf(String, "End of benchmark.\r");
+  uart_send(__LINE__, String);
+  printf("=======================================================================================================\r\r\r");
 
   return;
 }
@@ -551,86 +1409,91 @@ void display_complete_log(void)
 
 
 
-/* $TITLE=display_function_addresses() */
-/* ------------------------------------------------------------------- *\
-                      Display addresses of functions.
-   They should be in RAM, somewhere between 0x20000000 and 0x20041FFF.
-\* ------------------------------------------------------------------- */
-void display_function_addresses(void)
+/* $PAGE */
+/* $TITLE=benchmark_report() */
+/* ------------------------------------------------------------------ *\
+                   Display the result of one benchmark.
+     NOTES:
+     - RunTime[] gives the duration of each of the BENCH_RUNS runs,
+       each run being made of Ops operations of OpBytes bytes.
+     - Time per operation is averaged over each run. Min and max are
+       the fastest and slowest runs.
+     - Throughput is given in MB/s (1 MB = 1,000,000 bytes).
+\* ------------------------------------------------------------------ */
+void benchmark_report(UCHAR *Name, UINT32 OpBytes, UINT32 Ops, UINT32 *RunTime)
 {
   UCHAR String[256];
 
+  UINT8 Run;
 
-  printf("=======================================================================================================\r");
-  sprintf(String, "Display functions' address:\r");
-  uart_send(__LINE__, String);
-  
-  sprintf(String, "FLASH_BASE_ADDRESS: 0x%p         RAM_BASE_ADDRESS: 0x%p\r", XIP_BASE, RAM_BASE_ADDRESS);
-  uart_send(__LINE__, String);
-
-  sprintf(String, "(Note: Pico's FLASH memory space goes from 0x10000000 to 0x101FFFFF)\r");
-  uart_send(__LINE__, String);
-
-  sprintf(String, "(Note: Pico's  RAM  memory space goes from 0x20000000 to 0x20041FFF)\r\r");
-  uart_send(__LINE__, String);
+  UINT32 MaxTime;
+  UINT32 MinTime;
 
-  sprintf(String, "main():                             0x%p\r", main);
-  uart_send(__LINE__, String);
+  UINT64 TotalTime;
 
-  sprintf(String, "display_all_flash():                0x%p\r", display_all_flash);
-  uart_send(__LINE__, String);
 
-  sprintf(String, "display_all_ram():                  0x%p\r", display_all_ram);
-  uart_send(__LINE__, String);
+  /* Initializations. */
+  MinTime   = 0xFFFFFFFF;
+  MaxTime   = 0;
+  TotalTime = 0;
 
-  sprintf(String, "display_complete_log():             0x%p\r", display_complete_log);
-  uart_send(__LINE__, String);
 
-  sprintf(String, "display_function_addresses():       0x%p\r", display_function_addresses);
-  uart_send(__LINE__, String);
+  for (Run = 0; Run < BENCH_RUNS; ++Run)
+  {
+    TotalTime += RunTime[Run];
+    if (RunTime[Run] < MinTime) MinTime = RunTime[Run];
+    if (RunTime[Run] > MaxTime) MaxTime = RunTime[Run];
+  }
+  if (TotalTime == 0) TotalTime = 1;
 
-  sprintf(String, "display_manufacturing_test():       0x%p\r", display_manufacturing_test);
+  sprintf(String, "%-29s   %7lu   %7lu   %13.2f   %10.2f   %10.2f   %7.3f\r", Name, OpBytes, Ops, ((float)MinTime / Ops), ((float)TotalTime / (BENCH_RUNS * Ops)),
+          ((float)MaxTime / Ops), ((float)OpBytes * Ops * BENCH_RUNS / (float)TotalTime));
   uart_send(__LINE__, String);
 
-  sprintf(String, "display_memory():                   0x%p\r", display_memory);
-  uart_send(__LINE__, String);
+  return;
+}
 
-  sprintf(String, "display_microcontroller_id():       0x%p\r", display_microcontroller_id);
-  uart_send(__LINE__, String);
 
-  sprintf(String, "display_specific_sector():          0x%p\r", display_specific_sector);
-  uart_send(__LINE__, String);
 
-  sprintf(String, "erase_all_flash()):                 0x%p\r", erase_all_flash);
-  uart_send(__LINE__, String);
 
-  sprintf(String, "erase_specific_sector()):           0x%p\r", erase_specific_sector);
-  uart_send(__LINE__, String);
 
-  sprintf(String, "flash_blank_check():                0x%p\r", flash_blank_check);
-  uart_send(__LINE__, String);
+/* $PAGE */
+/* $TITLE=binary_discard() */
+/* ------------------------------------------------------------------ *\
+     Discard binary data received from the host until it stops
+                             sending.
+     NOTE: Data is dropped until nothing has been received for
+           IdleTime msec, from the same channel as binary_receive().
+\* ------------------------------------------------------------------ */
+void binary_discard(UINT32 IdleTime)
+{
+  UINT8 Buffer[64];
 
-  sprintf(String, "flash_erase():                      0x%p\r", flash_erase);
-  uart_send(__LINE__, String);
+  int Count;
 
-  sprintf(String, "flash_test():                       0x%p\r", flash_test);
-  uart_send(__LINE__, String);
+  UINT32 LastTime;
 
-  sprintf(String, "flash_write():                      0x%p\r", flash_write);
-  uart_send(__LINE__, String);
 
-  sprintf(String, "input_string():                     0x%p\r", input_string);
-  uart_send(__LINE__, String);
+  /* Initializations. */
+  LastTime = time_us_32();
 
-  sprintf(String, "uart_send():                        0x%p\r", uart_send);
-  uart_send(__LINE__, String);
 
+  while ((time_us_32() - LastTime) < (IdleTime * 1000))
+  {
+    recursive_mutex_enter_blocking(&UsbMutex);
+    #ifdef USB_VENDOR_BULK
+    if (binary_vendor_claimed() == FLAG_ON)
+      Count = tud_vendor_read(Buffer, sizeof(Buffer));
+    else
+    #endif
+    Count = stdio_usb.in_chars((char *)Buffer, sizeof(Buffer));
+    recursive_mutex_exit(&UsbMutex);
 
-  printf("\r");
-  sprintf(String, "End of functions' address display.\r");
-  uart_send(__LINE__, String);
-  printf("========================================================================================================\r\r\r");
-  printf("\r\r");
+    if (Count > 0)
+      LastTime = time_us_32();
+    else
+      tight_loop_contents();
+  }
 
   return;
 }
@@ -640,42 +1503,52 @@ void display_function_addresses(void)
 
 
 /* $PAGE */
-/* $TITLE=display_manufacturing_test() */
+/* $TITLE=binary_receive() */
 /* ------------------------------------------------------------------ *\
-               Display Pico's manufacturing test results.
-     This data has been saved in Pico's flash at address 0x1007F000
-                       and it is 107 bytes long.
+      Receive binary data from the host through USB CDC or through
+                 the optional USB vendor bulk endpoint.
+     NOTES:
+     - Data is read from the vendor bulk endpoint when the host has
+       claimed it (see binary_vendor_claimed()), from USB CDC
+       otherwise, with no <line feed> translation.
+     - Returns FLAG_OFF if the host sends nothing for UPLOAD_TIMEOUT
+       msec before Length bytes have been received.
 \* ------------------------------------------------------------------ */
-void display_manufacturing_test(void)
+UINT8 binary_receive(UINT8 *Data, UINT32 Length)
 {
-  UCHAR String[256];
-
-  UINT8 TestResultSize;
+  int Count;
 
-  UINT32 TestResultOffset;
-
-
-  TestResultOffset = 0x7F000;
-  TestResultSize   = TEST_RESULT_SIZE;
+  UINT32 LastTime;
 
 
-  printf("=======================================================================================================\r");
-  uart_send(__LINE__, "Display Pico's manufacturing test results:\r");
+  /* Initializations. */
+  LastTime = time_us_32();
 
-  sprintf(String, "XIP_BASE: 0x%p   Offset: 0x%6.6X   Length: 0x%X (%u)\r", XIP_BASE, TestResultOffset, TestResultSize, TestResultSize);
-  uart_send(__LINE__, String);
 
-  sprintf(String, "(Note: Pico's flash memory space goes from 0x10000000 to 0x101FFFFF)\r\r");
-  uart_send(__LINE__, String);
+  while (Length)
+  {
+    recursive_mutex_enter_blocking(&UsbMutex);
+    #ifdef USB_VENDOR_BULK
+    if (binary_vendor_claimed() == FLAG_ON)
+      Count = tud_vendor_read(Data, Length);
+    else
+    #endif
+    Count = stdio_usb.in_chars((char *)Data, Length);
+    recursive_mutex_exit(&UsbMutex);
 
-  display_memory(XIP_BASE, TestResultOffset, TestResultSize);
+    if (Count > 0)
+    {
+      Data    += Count;
+      Length  -= Count;
+      LastTime = time_us_32();
+      continue;
+    }
 
-  printf("\r");
-  sprintf(String, "End of Pico's manufacturing test results.\r");
-  uart_send(__LINE__, String);
-  printf("=======================================================================================================\r\r\r");
+    if ((time_us_32() - LastTime) > (UPLOAD_TIMEOUT * 1000)) return FLAG_OFF;
+    tight_loop_contents();
+  }
 
-  return;
+  return FLAG_ON;
 }
 
 
@@ -683,63 +1556,84 @@ void display_manufacturing_test(void)
 
 
 /* $PAGE */
-/* $TITLE=display_memory() */
+/* $TITLE=binary_send() */
 /* ------------------------------------------------------------------ *\
-           Display memory content through external monitor.
+       Send binary data to the host through USB CDC or through the
+                   optional USB vendor bulk endpoint.
+     NOTES:
+     - Data is handed to the USB CDC driver as a whole, with no
+       <line feed> translation, so that binary transfers run at CDC
+       line rate.
+     - When USB_VENDOR_BULK is defined and the host has claimed the
+       vendor bulk endpoint (see binary_vendor_claimed()), data goes
+       to the vendor TX FIFO instead. The FIFO holds more than two
+       binary frames (see tusb_config.h), so the USB stack sends one
+       frame while the next one is being built, and the text console
+       is not slowed down.
+     - Binary data is not echoed to the optional UART monitor.
+     - Log buffer is flushed first so that binary data is not mixed
+       with text lines still waiting to be sent.
+     - Returns FLAG_OFF if the transfer has been abandoned: host
+       disconnected, or stopped reading the vendor endpoint for
+       SEND_TIMEOUT msec. Returns FLAG_ON otherwise.
 \* ------------------------------------------------------------------ */
-void display_memory(UINT32 BaseAddress, UINT32 Offset, UINT32 Length)
+UINT8 binary_send(UINT8 *Data, UINT32 Length)
 {
-  UCHAR String[256];
-
-  UINT8 *MemoryBaseAddress;
-
-  UINT32 Loop1UInt32;
-  UINT32 Loop2UInt32;
+  #ifdef USB_VENDOR_BULK
+  UINT32 Chunk;
+  UINT32 LastTime;
+  #endif
 
 
-  /* Point to target memory address (either RAM of flash). */
-  MemoryBaseAddress = (UINT8 *)(BaseAddress);
+  /* Text already in the log buffer must be sent first. Core 1 has nothing more to send afterwards, so holding UsbMutex
+     for the whole transfer doesn't delay anything. */
+  log_flush();
+  recursive_mutex_enter_blocking(&UsbMutex);
 
-  for (Loop1UInt32 = Offset; Loop1UInt32 < (Offset + Length); Loop1UInt32 += 16)
+  #ifdef USB_VENDOR_BULK
+  if (binary_vendor_claimed() == FLAG_ON)
   {
-    /* Display memory address. */
-    sprintf(String, "[%p] ", MemoryBaseAddress + Loop1UInt32);
-
-    /* Display memory content in hex. */
-    for (Loop2UInt32 = 0; Loop2UInt32 < 16; ++Loop2UInt32)
-    {
-      if ((Loop1UInt32 + Loop2UInt32) >= (Offset + Length))
-        sprintf(&String[strlen(String)], "   ");
-      else
-        sprintf(&String[strlen(String)], "%2.2X ", MemoryBaseAddress[Loop1UInt32 + Loop2UInt32]);
-    }
-
-
-    /* Display separator. */
-    sprintf(&String[strlen(String)], "| ");
-
-
-    /* Display memory content in ASCII when displayable characters, or <.> if not displayable. */
-    for (Loop2UInt32 = 0; Loop2UInt32 < 16; ++Loop2UInt32)
+    LastTime = time_us_32();
+    while (Length)
     {
-      if ((Loop1UInt32 + Loop2UInt32) >= (Offset + Length))
+      /* Give up if host disconnects during the transfer. */
+      if (!tud_vendor_mounted())
       {
-        sprintf(&String[strlen(String)], " ");
+        FlagVendorClaimed = FLAG_OFF;
+        recursive_mutex_exit(&UsbMutex);
+        return FLAG_OFF;
       }
-      else
+
+      Chunk = tud_vendor_write_available();
+      if (Chunk == 0)
       {
-        if ((MemoryBaseAddress[Loop1UInt32 + Loop2UInt32] >= 0x20) && (MemoryBaseAddress[Loop1UInt32 + Loop2UInt32] <= 0x7E) && (MemoryBaseAddress[Loop1UInt32 + Loop2UInt32] != 0x25))
-          sprintf(&String[strlen(String)], "%c", MemoryBaseAddress[Loop1UInt32 + Loop2UInt32]);
-        else
-          sprintf(&String[strlen(String)], ".");
+        /* Give up if host is still there but doesn't read anymore. */
+        if ((time_us_32() - LastTime) > (SEND_TIMEOUT * 1000))
+        {
+          recursive_mutex_exit(&UsbMutex);
+          return FLAG_OFF;
+        }
+        tight_loop_contents();
+        continue;
       }
+      if (Chunk > Length) Chunk = Length;
+
+      tud_vendor_write(Data, Chunk);
+      Data    += Chunk;
+      Length  -= Chunk;
+      LastTime = time_us_32();
     }
-    
-    sprintf(&String[strlen(String)], "\r");  // add linefeed.
-    uart_send(__LINE__, String);
+    tud_vendor_write_flush();
+    recursive_mutex_exit(&UsbMutex);
+
+    return FLAG_ON;
   }
+  #endif
 
-  return;
+  stdio_usb.out_chars((const char *)Data, Length);
+  recursive_mutex_exit(&UsbMutex);
+
+  return FLAG_ON;
 }
 
 
@@ -747,87 +1641,4990 @@ void display_memory(UINT32 BaseAddress, UINT32 Offset, UINT32 Length)
 
 
 /* $PAGE */
-/* $TITLE=display_microcontroller_id() */
+/* $TITLE=binary_vendor_claimed() */
 /* ------------------------------------------------------------------ *\
-         Determine if the microcontroller is a Pico or a Pico W
-                     and display its Unique Number.
+      Check if the host reads binary transfers from the USB vendor
+                          bulk endpoint.
+     NOTES:
+     - Host claims the vendor bulk endpoint by sending any data to it
+       (bulk OUT endpoint 0x03), before sending any command. From then
+       on, binary transfers go through the vendor bulk endpoints until
+       the host disconnects, and data received on endpoint 0x03 is
+       left for binary_receive().
+     - Otherwise, binary transfers go through USB CDC, so that host
+       scripts that don't know about the vendor endpoint keep working.
+     - Always FLAG_OFF when USB_VENDOR_BULK is not defined.
 \* ------------------------------------------------------------------ */
-UINT8 display_microcontroller_id(void)
+UINT8 binary_vendor_claimed(void)
 {
-  UCHAR String[256];
-
-  UINT8 Loop1UInt8;
-  UINT8 PicoType;
-  
-  UINT16 AdcValue1;
-  UINT16 AdcValue2;
+  #ifdef USB_VENDOR_BULK
+  UINT8 Buffer[64];
 
-  float Volts1;
-  float Volts2;
 
-  pico_unique_board_id_t board_id;
+  recursive_mutex_enter_blocking(&UsbMutex);
+  if (!tud_vendor_mounted())
+  {
+    FlagVendorClaimed = FLAG_OFF;
+    recursive_mutex_exit(&UsbMutex);
 
+    return FLAG_OFF;
+  }
 
-  printf("=======================================================================================================\r");
-  printf("                                          Pico-Flash-Utility\r");
+  /* Claim data itself is dropped. */
+  while ((FlagVendorClaimed == FLAG_OFF) && tud_vendor_available())
+  {
+    while (tud_vendor_available())
+      tud_vendor_read(Buffer, sizeof(Buffer));
+    FlagVendorClaimed = FLAG_ON;
+  }
+  recursive_mutex_exit(&UsbMutex);
+  #endif
 
+  return FlagVendorClaimed;
+}
 
-  /* Select power supply input. */
-  adc_select_input(3);
-  gpio_put(PICO_LED, true);
 
-  /* Read ADC converter raw value. */
-  AdcValue1 = adc_read();
 
-  /* Convert raw value to voltage value. */
-  Volts1 = (3 * (AdcValue1 * 3.3f / 4096));
 
 
+/* $PAGE */
+/* $TITLE=blink_pico_led() */
+/* ------------------------------------------------------------------ *\
+            Blink Pico's LED the specified number of times.
+\* ------------------------------------------------------------------ */
+void blink_pico_led(UINT8 NumberOfTimes)
+{
+  UINT8 Loop1UInt8;
 
-  /* The important power supply value to consider is when GPIO25 is Low. */
-  gpio_put(PICO_LED, false);
-    
-  /* Read ADC converter raw value. */
-  AdcValue2 = adc_read();
 
-  /* Convert raw value to voltage value. */
-  Volts2 = (3 * (AdcValue2 * 3.3f / 4096));
-  if (Volts2 > 3)
-  {
-    printf("                                Microcontroller is a Raspberry Pi Pico\r");
-    PicoType = TYPE_PICO;
-  }
-  else
+  for (Loop1UInt8 = 0; Loop1UInt8 < NumberOfTimes; ++Loop1UInt8)
   {
-    printf("                               Microcontroller is a Raspberry Pi Pico W\r");
-    PicoType = TYPE_PICO_W;
+    gpio_put(PICO_LED, true);
+    sleep_ms(120);
+    gpio_put(PICO_LED, false);
+    sleep_ms(300);
   }
 
+  return;
+}
 
 
-  /* Retrieve Pico Unique Number from flash memory IC. */
-  pico_get_unique_board_id(&board_id);
-    
-  /* Build-up the Unique ID string in hex. */
-  sprintf(String, "                                     Pico ID: ");
-  for (Loop1UInt8 = 0; Loop1UInt8 < PICO_UNIQUE_BOARD_ID_SIZE_BYTES; ++Loop1UInt8)
-  {
-    sprintf(&String[strlen(String)], "%2.2X", board_id.id[Loop1UInt8]);
+
+
+/* $PAGE */
+/* $TITLE=checkpoint_clear() */
+/* ------------------------------------------------------------------ *\
+                Erase all flash test checkpoints.
+\* ------------------------------------------------------------------ */
+void checkpoint_clear(void)
+{
+  UINT32 InterruptMask;
+
+
+  /* Nothing to do if the checkpoint sector is already blank. */
+  if (*(UINT32 *)&FlashReadAddress[CHECKPOINT_OFFSET] == 0xFFFFFFFF) return;
+
+  InterruptMask = flash_enter_critical();
+  flash_range_erase(CHECKPOINT_OFFSET, FLASH_SECTOR_SIZE);
+  flash_exit_critical(InterruptMask);
+  erase_count_add(CHECKPOINT_OFFSET, FLASH_SECTOR_SIZE);
+
+  return;
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=checkpoint_find() */
+/* ------------------------------------------------------------------ *\
+             Find the last flash test checkpoint saved.
+     Returns FLAG_ON and copies the checkpoint when a valid one has
+     been found.
+\* ------------------------------------------------------------------ */
+UINT8 checkpoint_find(struct test_checkpoint *Checkpoint)
+{
+  UINT8 FlagFound;
+  UINT8 Slot;
+
+  struct test_checkpoint *Record;
+
+
+  /* Initializations. */
+  FlagFound = FLAG_OFF;
+
+
+  /* Records are appended one page at a time, the last valid one is the most recent. */
+  for (Slot = 0; Slot < CHECKPOINT_SLOTS; ++Slot)
+  {
+    Record = (struct test_checkpoint *)&FlashBaseAddress[CHECKPOINT_OFFSET + (Slot * FLASH_PAGE_SIZE)];
+    if (Record->Magic == 0xFFFFFFFF) break;  // first free slot.
+
+    if ((Record->Magic == CHECKPOINT_MAGIC) && (Record->Crc == crc32_update(0, (UINT8 *)Record, offsetof(struct test_checkpoint, Crc))))
+    {
+      memcpy(Checkpoint, Record, sizeof(struct test_checkpoint));
+      FlagFound = FLAG_ON;
+    }
+  }
+
+  /* Ignore a checkpoint that doesn't match a valid test plan. */
+  if ((FlagFound == FLAG_ON) && ((Checkpoint->Plan.PatternCount == 0) || (Checkpoint->Plan.PatternCount > PLAN_MAX_PATTERNS) || (Checkpoint->PatternIndex >= Checkpoint->Plan.PatternCount) || (Checkpoint->Phase >= PHASE_COUNT)))
+    FlagFound = FLAG_OFF;
+
+  return FlagFound;
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=checkpoint_save() */
+/* ------------------------------------------------------------------ *\
+          Save flash test progress to the checkpoint sector.
+     NOTES:
+     - The last flash sector (CHECKPOINT_OFFSET) of the metadata
+       region is reserved for checkpoints and is never tested, so it survives
+       a power failure or a USB disconnect during the test.
+     - Every record is programmed into the next free page of the
+       sector. The sector is erased only once all its pages have been
+       used, so that flash test doesn't wear it out.
+     - A record is valid only if its CRC32 matches, so a record
+       interrupted while being programmed is ignored.
+     - Nothing is saved once user has aborted the test.
+\* ------------------------------------------------------------------ */
+void checkpoint_save(struct test_plan *Plan, UINT8 Cycle, UINT8 PatternIndex, UINT8 Phase, UINT64 TotalErrors)
+{
+  UINT8 Page[FLASH_PAGE_SIZE];
+  UINT8 Slot;
+
+  UINT32 InterruptMask;
+
+  struct test_checkpoint *Record;
+
+
+  /* An aborted phase has not been completed, keep the previous checkpoint so that it is executed again on resume. */
+  if (FlagAbort == FLAG_ON) return;
+
+  /* Build the record in a page-sized buffer (unused bytes are left to 0xFF). */
+  memset(Page, 0xFF, FLASH_PAGE_SIZE);
+  Record = (struct test_checkpoint *)Page;
+  memset(Record, 0x00, sizeof(struct test_checkpoint));
+  Record->Magic          = CHECKPOINT_MAGIC;
+  Record->FlagPipeline   = FlagPipeline;
+  Record->Cycle          = Cycle;
+  Record->PatternIndex   = PatternIndex;
+  Record->Phase          = Phase;
+  Record->TotalErrors    = TotalErrors;
+  memcpy(&Record->Plan, Plan, sizeof(struct test_plan));
+  Record->Crc            = crc32_update(0, (UINT8 *)Record, offsetof(struct test_checkpoint, Crc));
+
+  /* Find the first free page of the checkpoint sector. */
+  for (Slot = 0; Slot < CHECKPOINT_SLOTS; ++Slot)
+    if (*(UINT32 *)&FlashReadAddress[CHECKPOINT_OFFSET + (Slot * FLASH_PAGE_SIZE)] == 0xFFFFFFFF) break;
+
+  InterruptMask = flash_enter_critical();
+
+  /* All pages used, start over from the beginning of the sector. */
+  if (Slot == CHECKPOINT_SLOTS)
+  {
+    flash_range_erase(CHECKPOINT_OFFSET, FLASH_SECTOR_SIZE);
+    erase_count_add(CHECKPOINT_OFFSET, FLASH_SECTOR_SIZE);
+    Slot = 0;
+  }
+
+  flash_range_program(CHECKPOINT_OFFSET + (Slot * FLASH_PAGE_SIZE), Page, FLASH_PAGE_SIZE);
+
+  flash_exit_critical(InterruptMask);
+
+  return;
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=command_flash_run() */
+/* ------------------------------------------------------------------ *\
+      Check if firmware is run from flash, in which case command
+               mode must not modify flash memory.
+     NOTE: Same check as erase_all_flash() and flash_test_run(), the
+           reason is given in Details for the status reply.
+\* ------------------------------------------------------------------ */
+UINT8 command_flash_run(UCHAR *Details)
+{
+  if (((void *)main < (void *)0x20000000) || ((void *)main > (void *)0x20041FFF))
+  {
+    sprintf(Details, "reason=running_from_flash");
+
+    return FLAG_ON;
+  }
+
+  return FLAG_OFF;
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=command_mode() */
+/* ------------------------------------------------------------------ *\
+          Parse and execute commands received from a host script.
+     NOTES:
+     - One command per line, arguments separated by spaces. Offsets
+       and lengths are in hex, other numbers in decimal:
+         BLANK  <start> <length>      blank check a flash range.
+         COMPARE <start> <length>     compare the CRC32 of each sector
+                                      with the list sent by host.
+         DUMP   <start> <length>      send a flash range as binary
+                                      frames (see display_memory_binary()).
+         ERASE  <start> <length>      erase a flash range.
+         HASH   <start> <length>      CRC32 of each sector.
+         HELP                         list the commands.
+         LOG    [BLOCK/DROP]          set the log policy (see
+                                      log_write()), or report it.
+         QUIT                         return to main menu.
+         RESUME                       resume an interrupted flash test.
+         STATS                        timing of the last flash test.
+         STORE  [ERASE]               create the record store (its
+                                      sectors are erased only with
+                                      ERASE if they are not blank).
+         TEST   <profile> [N/M/F] [P] run a predefined test plan
+                                      (1 to n), with optional snapshot
+                                      verbosity and dual-core pipeline.
+     - ERASE, RESUME, STORE, TEST and UPLOAD reply STATUS_FLASH_RUN
+       when firmware is run from flash, so that host never takes a
+       test that was not run for a test without errors.
+     - Lines received are not echoed. No question is ever asked to
+       user in command mode. Every command ends with a single line
+       that doesn't include a time stamp, so it is easy to parse:
+         STATUS <code> <command> [key=value ...]
+       where <code> is one of the STATUS_xxx definitions. Other lines
+       in-between are regular log lines and may be ignored by host.
+     - While a command is running, host may send <abort>, <pause>,
+       <resume> and <status?> (see console_poll()).
+     - Sector hashes are standard CRC-32 (same as zlib / Python
+       binascii.crc32()) of each 4096-byte sector. After COMPARE, the
+       firmware sends "EXPECT <n>" and host sends one hash per line
+       (hex), in sector order. Ranges larger than HASH_CHUNK_SECTORS
+       are compared one chunk at a time: host answers each "EXPECT"
+       with the next <n> hashes. Only sectors that differ are reported.
+\* ------------------------------------------------------------------ */
+void command_mode(void)
+{
+  UCHAR Details[128];
+  UCHAR Line[256];
+  UCHAR *Argument[4];
+  UCHAR *Command;
+
+  UINT8 Loop1UInt8;
+  UINT8 Phase;
+  UINT8 Status;
+
+  UINT32 Chunk;
+  UINT32 ChunkOffset;
+  UINT32 Expected;
+  UINT32 Length;
+  UINT32 Loop1UInt32;
+  UINT32 Sectors;
+  UINT32 StartOffset;
+
+  UINT64 TotalErrors;
+
+  struct ram_region Region[RAM_MAP_REGIONS];
+  struct test_checkpoint Checkpoint;
+  struct test_plan Plan;
+
+
+  sprintf(Details, "version=%X.%2.2X", (FIRMWARE_VERSION >> 8), (FIRMWARE_VERSION & 0xFF));
+  command_reply(STATUS_OK, "READY", Details);
+
+  while (true)
+  {
+    input_string_echo(Line, FLAG_OFF);
+    if (Line[0] == 0x0D) continue;  // empty line.
+
+    /* Split command line into command and arguments. */
+    Command = strtok(Line, " \r");
+    if (Command == NULL) continue;
+    for (Loop1UInt8 = 0; Command[Loop1UInt8]; ++Loop1UInt8)
+      if ((Command[Loop1UInt8] >= 'a') && (Command[Loop1UInt8] <= 'z')) Command[Loop1UInt8] -= ('a' - 'A');
+    for (Loop1UInt8 = 0; Loop1UInt8 < 4; ++Loop1UInt8)
+      Argument[Loop1UInt8] = strtok(NULL, " \r");
+    Details[0] = 0x00;
+    FlagAbort  = FLAG_OFF;
+
+
+    if (strcmp(Command, "BLANK") == 0)
+    {
+      Status = command_range(Argument[0], Argument[1], &StartOffset, &Length);
+      if (Status == STATUS_OK)
+      {
+        status_begin(MODE_COMMAND, StartOffset, Length, 1);
+        TotalErrors = flash_blank_check_range(StartOffset, Length);
+        status_end();
+        sprintf(Details, "errors=%llu", TotalErrors);
+        if (TotalErrors) Status = STATUS_ERRORS;
+      }
+    }
+    else if (strcmp(Command, "COMPARE") == 0)
+    {
+      Status = command_range(Argument[0], Argument[1], &StartOffset, &Length);
+      if (Status == STATUS_OK)
+      {
+        /* Hash a whole chunk first, so that host may send the expected hashes of this chunk at full speed. */
+        status_begin(MODE_COMMAND, StartOffset, Length, 1);
+        Sectors     = 0;
+        TotalErrors = 0;
+        for (ChunkOffset = StartOffset; (ChunkOffset < (StartOffset + Length)) && (FlagAbort == FLAG_OFF); ChunkOffset += (Chunk * FLASH_SECTOR_SIZE))
+        {
+          Chunk = flash_hash_range(ChunkOffset, ((StartOffset + Length) - ChunkOffset));
+          printf("EXPECT %lu\r", Chunk);
+          for (Loop1UInt32 = 0; Loop1UInt32 < Chunk; ++Loop1UInt32)
+          {
+            input_string_echo(Line, FLAG_OFF);
+            Expected = strtoul(Line, NULL, 16);
+            if (Expected != SectorHash[Loop1UInt32])
+            {
+              printf("DIFF 0x%8.8X expected=0x%8.8X actual=0x%8.8X\r", (ChunkOffset + (Loop1UInt32 * FLASH_SECTOR_SIZE)), Expected, SectorHash[Loop1UInt32]);
+              ++TotalErrors;
+            }
+          }
+          Sectors += Chunk;
+        }
+        status_end();
+        sprintf(Details, "sectors=%lu differ=%llu", Sectors, TotalErrors);
+        if ((TotalErrors) || (FlagAbort == FLAG_ON)) Status = STATUS_ERRORS;
+      }
+    }
+    else if (strcmp(Command, "DUMP") == 0)
+    {
+      Status = command_range(Argument[0], Argument[1], &StartOffset, &Length);
+      if (Status == STATUS_OK)
+      {
+        /* Tell host that binary frames follow, and on which channel. */
+        printf("BINARY 0x%8.8X 0x%8.8X %s\r", (XIP_BASE + StartOffset), Length, ((binary_vendor_claimed() == FLAG_ON) ? "VENDOR" : "CDC"));
+        if (display_memory_binary(XIP_BASE, StartOffset, Length) == FLAG_OFF) Status = STATUS_TIMEOUT;
+      }
+    }
+    else if (strcmp(Command, "ERASE") == 0)
+    {
+      Status = command_range(Argument[0], Argument[1], &StartOffset, &Length);
+      if ((Status == STATUS_OK) && (command_flash_run(Details) == FLAG_ON)) Status = STATUS_FLASH_RUN;
+      if (Status == STATUS_OK)
+      {
+        status_begin(MODE_COMMAND, StartOffset, Length, 1);
+        flash_erase_range(StartOffset, Length);
+        status_end();
+        printf("\r");
+        sprintf(Details, "start=0x%8.8X length=0x%8.8X", StartOffset, Length);
+      }
+    }
+    else if (strcmp(Command, "HASH") == 0)
+    {
+      Status = command_range(Argument[0], Argument[1], &StartOffset, &Length);
+      if (Status == STATUS_OK)
+      {
+        status_begin(MODE_COMMAND, StartOffset, Length, 1);
+        Sectors = 0;
+        for (ChunkOffset = StartOffset; (ChunkOffset < (StartOffset + Length)) && (FlagAbort == FLAG_OFF); ChunkOffset += (Chunk * FLASH_SECTOR_SIZE))
+        {
+          Chunk = flash_hash_range(ChunkOffset, ((StartOffset + Length) - ChunkOffset));
+          for (Loop1UInt32 = 0; Loop1UInt32 < Chunk; ++Loop1UInt32)
+            printf("HASH 0x%8.8X 0x%8.8X\r", (ChunkOffset + (Loop1UInt32 * FLASH_SECTOR_SIZE)), SectorHash[Loop1UInt32]);
+          Sectors += Chunk;
+        }
+        status_end();
+        sprintf(Details, "sectors=%lu", Sectors);
+        if (FlagAbort == FLAG_ON) Status = STATUS_ERRORS;
+      }
+    }
+    else if (strcmp(Command, "HELP") == 0)
+    {
+      printf("BLANK <start> <length>\r");
+      printf("COMPARE <start> <length>\r");
+      printf("DUMP <start> <length>\r");
+      printf("ERASE <start> <length>\r");
+      printf("HASH <start> <length>\r");
+      printf("HELP\r");
+      printf("LOG [BLOCK/DROP]\r");
+      printf("MAP\r");
+      printf("QUIT\r");
+      printf("RESUME\r");
+      printf("STATS\r");
+      printf("STORE [ERASE]\r");
+      printf("TEST <profile 1-%u> [N/M/F] [P]\r", TEST_PLAN_PROFILES);
+      printf("UPLOAD <start> <length>\r");
+      Status = STATUS_OK;
+    }
+    else if (strcmp(Command, "LOG") == 0)
+    {
+      /* Without argument, current log policy is only reported. */
+      Status = STATUS_OK;
+      if ((Argument[0] != NULL) && ((strcmp(Argument[0], "BLOCK") == 0) || (strcmp(Argument[0], "block") == 0)))
+        LogPolicy = LOG_POLICY_BLOCK;
+      else if ((Argument[0] != NULL) && ((strcmp(Argument[0], "DROP") == 0) || (strcmp(Argument[0], "drop") == 0)))
+        LogPolicy = LOG_POLICY_DROP;
+      else if (Argument[0] != NULL)
+        Status = STATUS_ARGUMENT;
+      sprintf(Details, "policy=%s dropped=%lu", ((LogPolicy == LOG_POLICY_DROP) ? "drop" : "block"), LogDropped);
+    }
+    else if (strcmp(Command, "MAP") == 0)
+    {
+      /* RAM memory map: one line per region, stacks in use are the part below their top that has been used. */
+      Sectors = ram_map(Region);
+      for (Loop1UInt32 = 0; Loop1UInt32 < Sectors; ++Loop1UInt32)
+        printf("REGION 0x%8.8X 0x%8.8X %s\r", Region[Loop1UInt32].Start, Region[Loop1UInt32].Length, Region[Loop1UInt32].Name);
+      sprintf(Details, "regions=%lu", Sectors);
+      Status = STATUS_OK;
+    }
+    else if (strcmp(Command, "UPLOAD") == 0)
+    {
+      Status = command_range(Argument[0], Argument[1], &StartOffset, &Length);
+      if ((Status == STATUS_OK) && (flash_excluded(StartOffset, Length, EXCLUDE_SKIP) != NULL)) Status = STATUS_ARGUMENT;
+      if (Status == STATUS_OK)
+      {
+        /* Tell host that binary frames may be sent, and on which channel. */
+        printf("UPLOAD 0x%8.8X 0x%8.8X %s\r", (XIP_BASE + StartOffset), Length, ((binary_vendor_claimed() == FLAG_ON) ? "VENDOR" : "CDC"));
+        Status = image_upload(StartOffset, Length, Details);
+      }
+    }
+    else if (strcmp(Command, "QUIT") == 0)
+    {
+      command_reply(STATUS_OK, Command, "");
+
+      return;
+    }
+    else if (strcmp(Command, "RESUME") == 0)
+    {
+      Status = STATUS_NOT_FOUND;
+      if (checkpoint_find(&Checkpoint) == FLAG_ON)
+      {
+        FlagPipeline = Checkpoint.FlagPipeline;
+        SoftwareMode = MODE_FLASH_TEST;  // blink current cycle number while test is running.
+        Status       = command_test(&Checkpoint.Plan, &Checkpoint, Details);
+        SoftwareMode = MODE_COMMAND;
+      }
+    }
+    else if (strcmp(Command, "STATS") == 0)
+    {
+      /* One line per flash test phase: index, runs, bytes, total time and min / max time per sector (usec). */
+      for (Phase = 0; Phase < PHASE_COUNT; ++Phase)
+        printf("PHASE %u runs=%lu bytes=%llu usec=%llu sector_min=%lu sector_max=%lu\r", Phase, PhaseProfile[Phase].Runs, PhaseProfile[Phase].TotalBytes, PhaseProfile[Phase].TotalTime,
+               (PhaseProfile[Phase].Runs ? PhaseProfile[Phase].MinSectorTime : 0), PhaseProfile[Phase].MaxSectorTime);
+      Status = STATUS_OK;
+    }
+    else if (strcmp(Command, "STORE") == 0)
+    {
+      Status = STATUS_OK;
+      Loop1UInt8 = (((Argument[0] != NULL) && ((strcmp(Argument[0], "ERASE") == 0) || (strcmp(Argument[0], "erase") == 0))) ? FLAG_ON : FLAG_OFF);
+      if (command_flash_run(Details) == FLAG_ON)
+        Status = STATUS_FLASH_RUN;
+      else switch (kv_create(Loop1UInt8))
+      {
+        case (1):
+          Status = STATUS_ERRORS;
+          strcpy(Details, "reason=program");
+        break;
+
+        case (2):
+          Status = STATUS_ERRORS;
+          strcpy(Details, "reason=not_blank");
+        break;
+      }
+      if (Status == STATUS_OK) sprintf(Details, "start=0x%8.8X length=0x%8.8X", KV_OFFSET, (KV_SECTORS * FLASH_SECTOR_SIZE));
+    }
+    else if (strcmp(Command, "TEST") == 0)
+    {
+      Status = STATUS_ARGUMENT;
+      if ((Argument[0] != NULL) && (atoi(Argument[0]) >= 1) && (atoi(Argument[0]) <= TEST_PLAN_PROFILES))
+      {
+        memcpy(&Plan, &TestPlanProfile[atoi(Argument[0]) - 1], sizeof(struct test_plan));
+        if ((Argument[1] != NULL) && ((Argument[1][0] == 'N') || (Argument[1][0] == 'n'))) Plan.Snapshot = SNAPSHOT_NONE;
+        if ((Argument[1] != NULL) && ((Argument[1][0] == 'F') || (Argument[1][0] == 'f'))) Plan.Snapshot = SNAPSHOT_FULL;
+        FlagPipeline = (((Argument[2] != NULL) && ((Argument[2][0] == 'P') || (Argument[2][0] == 'p'))) ? FLAG_ON : FLAG_OFF);
+
+        SoftwareMode = MODE_FLASH_TEST;  // blink current cycle number while test is running.
+        Status       = command_test(&Plan, NULL, Details);
+        SoftwareMode = MODE_COMMAND;
+      }
+    }
+    else
+    {
+      Status = STATUS_UNKNOWN;
+    }
+
+    command_reply(Status, Command, Details);
+  }
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=command_range() */
+/* ------------------------------------------------------------------ *\
+           Parse a flash range given as command arguments.
+     Start offset and length are in hex and must be aligned on a
+     sector boundary, and the range must fit in flash memory.
+\* ------------------------------------------------------------------ */
+UINT8 command_range(UCHAR *StartString, UCHAR *LengthString, UINT32 *StartOffset, UINT32 *Length)
+{
+  if ((StartString == NULL) || (LengthString == NULL)) return STATUS_ARGUMENT;
+
+  *StartOffset = strtoul(StartString,  NULL, 16);
+  *Length      = strtoul(LengthString, NULL, 16);
+
+  if ((*Length == 0) || (*StartOffset >= FlashChip.Size) || (*Length > (FlashChip.Size - *StartOffset))) return STATUS_ARGUMENT;
+
+  if ((*StartOffset % FLASH_SECTOR_SIZE) || (*Length % FLASH_SECTOR_SIZE)) return STATUS_ALIGNMENT;
+
+  return STATUS_OK;
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=command_reply() */
+/* ------------------------------------------------------------------ *\
+         Send a machine-parseable status reply for a command.
+     NOTE: printf() is used instead of uart_send() so that the reply
+           line has no line number nor time stamp prefix.
+\* ------------------------------------------------------------------ */
+void command_reply(UINT8 Status, UCHAR *Command, UCHAR *Details)
+{
+  printf("STATUS %3.3u %s %s\r", Status, Command, Details);
+
+  return;
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=command_test() */
+/* ------------------------------------------------------------------ *\
+       Run a flash test plan from command mode and build the
+                        status reply.
+     NOTE: A test that could not be run is reported as such, never as
+           a test without errors.
+\* ------------------------------------------------------------------ */
+UINT8 command_test(struct test_plan *Plan, struct test_checkpoint *Resume, UCHAR *Details)
+{
+  UINT64 TotalErrors;
+
+
+  if (flash_test_run(Plan, Resume, &TotalErrors) == FLAG_OFF)
+  {
+    sprintf(Details, "reason=running_from_flash");
+
+    return STATUS_FLASH_RUN;
+  }
+
+  sprintf(Details, "errors=%llu", TotalErrors);
+
+  return (TotalErrors ? STATUS_ERRORS : STATUS_OK);
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=console_command() */
+/* ------------------------------------------------------------------ *\
+    Execute a command received by console_poll() during a long
+                            operation.
+\* ------------------------------------------------------------------ */
+void console_command(UCHAR *Line)
+{
+  UCHAR Details[128];
+
+  UINT8 Loop1UInt8;
+
+  struct job_status Status;
+
+
+  for (Loop1UInt8 = 0; Line[Loop1UInt8]; ++Loop1UInt8)
+    if ((Line[Loop1UInt8] >= 'A') && (Line[Loop1UInt8] <= 'Z')) Line[Loop1UInt8] += ('a' - 'A');
+
+  if (strcmp(Line, "abort") == 0)
+  {
+    FlagAbort = FLAG_ON;
+    command_reply(STATUS_OK, "ABORT", "");
+  }
+  else if (strcmp(Line, "pause") == 0)
+  {
+    command_reply(STATUS_OK, "PAUSE", "");
+  }
+  else if (strcmp(Line, "resume") == 0)
+  {
+    command_reply(STATUS_OK, "RESUME", "");
+  }
+  else if (strcmp(Line, "status?") == 0)
+  {
+    status_read(&Status);  // always consistent here, since updates are only done by this code path (core 0 thread mode).
+    sprintf(Details, "mode=%u phase=%u cycle=%u offset=0x%8.8X percent=%u errors=%llu elapsed=%llu", SoftwareMode, Status.Phase, Status.Cycle + 1, Status.Offset,
+            Status.Percent, Status.Errors, ((Status.FlagActive == FLAG_ON) ? ((time_us_64() - Status.StartTime) / 1000000) : 0));
+    command_reply(STATUS_OK, "PROGRESS", Details);
+  }
+  else
+  {
+    command_reply(STATUS_UNKNOWN, Line, "");
+  }
+
+  return;
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=console_poll() */
+/* ------------------------------------------------------------------ *\
+      Check for <abort>, <pause> or <status?> commands between
+                   sectors of a long operation.
+     NOTES:
+     - Called by long-running loops (erase, write, blank check,
+       verify, display) before each sector. It never waits for input,
+       characters received are accumulated until <Enter> is received.
+     - Commands (not case sensitive, no echo):
+         abort     stop the on-going operation at the next sector.
+         pause     wait until <resume> or <abort> is received.
+         resume    continue a paused operation.
+         status?   reply right away with the current progress.
+     - Returns FLAG_ON when the on-going operation must be aborted.
+\* ------------------------------------------------------------------ */
+UINT8 console_poll(UINT32 Offset)
+{
+  static UCHAR Line[32];
+  static UINT8 LineLength = 0;
+
+  int DataInput;
+
+  UINT8 FlagPause;
+
+
+  /* Initializations. */
+  FlagPause = FLAG_OFF;
+  status_offset(Offset);
+
+
+  do
+  {
+    /* While paused, there is no hurry: wait a little for each character. */
+    DataInput = getchar_timeout_us((FlagPause == FLAG_ON) ? 50000 : 0);
+    if (DataInput == PICO_ERROR_TIMEOUT) continue;
+
+    if ((DataInput != 0x0D) && (DataInput != 0x0A))
+    {
+      if (LineLength < (sizeof(Line) - 1)) Line[LineLength++] = (UCHAR)DataInput;
+      continue;
+    }
+
+    /* <Enter>: execute the command received. */
+    if (LineLength == 0) continue;
+    Line[LineLength] = 0x00;
+    LineLength       = 0;
+    console_command(Line);
+
+    if (strcmp(Line, "pause")  == 0) FlagPause = FLAG_ON;
+    if (strcmp(Line, "resume") == 0) FlagPause = FLAG_OFF;
+    if (FlagAbort == FLAG_ON)        FlagPause = FLAG_OFF;
+  } while ((FlagPause == FLAG_ON) || (DataInput != PICO_ERROR_TIMEOUT));
+
+  return FlagAbort;
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=core1_main() */
+/* ------------------------------------------------------------------ *\
+        Core 1 entry point. Execute the blank check and verification
+                    jobs posted by core 0 in flash_test().
+     NOTES:
+     - This function runs from RAM and only reads the XIP window while
+       executing a job.
+     - Core 0 pauses core 1 (multicore lockout) for the duration of
+       every flash erase or program operation (see
+       flash_enter_critical()), so core 1 never reads the XIP window
+       while the flash IC is busy.
+     - Verification jobs regenerate the expected data with the
+       pattern generator, no reference copy is needed.
+     - Core 1 only flags the sectors in error. Core 0 re-examines
+       those sectors later to display and count the bytes in error.
+     - Protected regions are skipped (see flash_span_next()), so that
+       the sector of Pico's manufacturing test results is not flagged.
+     - When there is no job waiting, core 1 sends the log buffer to
+       the terminal (see log_drain()).
+     - Program jobs (see image_upload()) are the only flash operations
+       done by core 1: core 0 is then running from RAM without
+       touching the XIP window, so it is not paused and keeps
+       receiving USB data with its interrupts enabled.
+\* ------------------------------------------------------------------ */
+void __not_in_flash_func(core1_main)(void)
+{
+  UINT32 Difference;
+  UINT32 EndOffset;
+  UINT32 Expected;
+  UINT32 InterruptMask;
+  UINT32 Offset;
+  UINT32 Sector;
+  UINT32 SpanEnd;
+  UINT32 SpanStart;
+
+  struct pattern_generator Generator;
+  struct pipeline_job *Job;
+
+
+  /* Fill unused core 1 stack space, to find its high-water mark later (see display_ram_map()). */
+  stack_paint((UINT32)__StackOneBottom);
+
+  /* Allow core 0 to pause core 1 during flash operations. */
+  multicore_lockout_victim_init();
+  Core1Ready = FLAG_ON;
+
+  while (true)
+  {
+    /* While there is no job posted by core 0, send log buffer to the terminal. */
+    if (PipelineTail == PipelineHead)
+    {
+      log_drain();
+      tight_loop_contents();
+      continue;
+    }
+    __dmb();
+
+    Job       = &PipelineJob[PipelineTail % PIPELINE_QUEUE_SIZE];
+    EndOffset = Job->Offset + Job->Length;
+
+    if (Job->Type == JOB_PROGRAM)
+    {
+      /* The uncached alias is only read by 32 bits words (Job->Data is a sector buffer allocated by malloc(), so it is aligned). */
+      for (Offset = Job->Offset; Offset < EndOffset; Offset += 4)
+        if (*(UINT32 *)&FlashReadAddress[Offset] != *(UINT32 *)&Job->Data[Offset - Job->Offset]) break;
+
+      if (Offset == EndOffset)
+      {
+        Job->Result = JOB_RESULT_SAME;
+      }
+      else
+      {
+        InterruptMask = save_and_disable_interrupts();
+        flash_range_erase(Job->Offset, Job->Length);
+        flash_range_program(Job->Offset, Job->Data, Job->Length);
+        restore_interrupts(InterruptMask);
+
+        /* Read back through the uncached alias and compare with the data to program. */
+        for (Offset = Job->Offset; Offset < EndOffset; Offset += 4)
+          if (*(UINT32 *)&FlashReadAddress[Offset] != *(UINT32 *)&Job->Data[Offset - Job->Offset]) break;
+        Job->Result = ((Offset == EndOffset) ? JOB_RESULT_OK : JOB_RESULT_FAIL);
+      }
+
+      __dmb();
+      ++PipelineTail;
+      continue;
+    }
+
+    for (SpanStart = flash_span_next(Job->Offset, EndOffset, &SpanEnd); SpanStart < EndOffset; SpanStart = flash_span_next(SpanEnd, EndOffset, &SpanEnd))
+    {
+      /* Words partly protected at both ends of the span are compared too, their protected bytes are masked out on mismatch. */
+      if (Job->Type == JOB_VERIFY) pattern_start(&Generator, Job->Pattern, Job->Cycle, SpanStart & ~3);
+      for (Offset = (SpanStart & ~3); Offset < SpanEnd; Offset += 4)
+      {
+        if (Job->Type == JOB_BLANK_CHECK)
+          Expected = 0xFFFFFFFF;
+        else
+          Expected = pattern_next(&Generator);
+
+        if (*(UINT32 *)&FlashReadAddress[Offset] != Expected)
+        {
+          Difference = *(UINT32 *)&FlashReadAddress[Offset] ^ Expected;
+          if (Offset < SpanStart)         Difference &= (0xFFFFFFFF << ((SpanStart - Offset) * 8));
+          if ((Offset + 4) > SpanEnd)     Difference &= (0xFFFFFFFF >> ((Offset + 4 - SpanEnd) * 8));
+          if (Difference == 0) continue;
+
+          /* Flag this sector and skip to the next one. */
+          Sector = Offset / FLASH_SECTOR_SIZE;
+          PipelineSectorFlags[Sector / 32] |= (1u << (Sector % 32));
+          Offset = ((Sector + 1) * FLASH_SECTOR_SIZE) - 4;
+          if (Job->Type == JOB_VERIFY) pattern_start(&Generator, Job->Pattern, Job->Cycle, Offset + 4);
+        }
+      }
+    }
+
+    /* Make results visible to core 0 before telling it that the job is done. */
+    __dmb();
+    ++PipelineTail;
+  }
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=crc32_update() */
+/* ------------------------------------------------------------------ *\
+       Update a standard CRC-32 (same as zlib / Python binascii)
+                         with a memory area.
+     Start with Crc = 0 and give back the value returned for the
+     following memory areas to compute the CRC of consecutive areas.
+\* ------------------------------------------------------------------ */
+UINT32 crc32_update(UINT32 Crc, UINT8 *Data, UINT32 Length)
+{
+  static UINT32 Crc32Table[256];
+
+  UINT8 Loop1UInt8;
+
+  UINT32 Loop1UInt32;
+  UINT32 Value;
+
+
+  /* Build lookup table on first call. */
+  if (Crc32Table[1] == 0)
+  {
+    for (Loop1UInt32 = 0; Loop1UInt32 < 256; ++Loop1UInt32)
+    {
+      Value = Loop1UInt32;
+      for (Loop1UInt8 = 0; Loop1UInt8 < 8; ++Loop1UInt8)
+        Value = (Value & 1) ? ((Value >> 1) ^ 0xEDB88320) : (Value >> 1);
+      Crc32Table[Loop1UInt32] = Value;
+    }
+  }
+
+  Crc = ~Crc;
+  for (Loop1UInt32 = 0; Loop1UInt32 < Length; ++Loop1UInt32)
+    Crc = Crc32Table[(Crc ^ Data[Loop1UInt32]) & 0xFF] ^ (Crc >> 8);
+
+  return ~Crc;
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=dma_crc32() */
+/* ------------------------------------------------------------------ *\
+     Compute a CRC32 of a memory area with the DMA sniffer hardware.
+     NOTES:
+     - The memory area is streamed 32 bits at a time through a DMA
+       channel to a dummy destination while the sniffer computes the
+       CRC32, so the CPU doesn't have to read the data itself.
+     - Address must be aligned on 32 bits and Length must be a
+       multiple of 4.
+     - The result is meant to compare memory areas between them
+       (no bit reversal, nor final inversion).
+\* ------------------------------------------------------------------ */
+UINT32 dma_crc32(UINT8 *Address, UINT32 Length)
+{
+  static UINT32 DummyTarget;
+
+  dma_channel_config DmaConfig;
+
+
+  /* Reserve a DMA channel on first call. */
+  if (DmaChannel < 0)
+    DmaChannel = dma_claim_unused_channel(true);
+
+  /* Read 32 bits words from memory area, always write to the same dummy target, as fast as possible. */
+  DmaConfig = dma_channel_get_default_config(DmaChannel);
+  channel_config_set_transfer_data_size(&DmaConfig, DMA_SIZE_32);
+  channel_config_set_read_increment(&DmaConfig, true);
+  channel_config_set_write_increment(&DmaConfig, false);
+  channel_config_set_dreq(&DmaConfig, DREQ_FORCE);
+  channel_config_set_sniff_enable(&DmaConfig, true);
+
+  /* Seed the sniffer and start the transfer. */
+  dma_sniffer_enable(DmaChannel, DMA_SNIFF_CTRL_CALC_VALUE_CRC32, true);
+  dma_hw->sniff_data = 0xFFFFFFFF;
+  dma_channel_configure(DmaChannel, &DmaConfig, &DummyTarget, Address, (Length / 4), true);
+
+  dma_channel_wait_for_finish_blocking(DmaChannel);
+
+  return dma_hw->sniff_data;
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=dma_crc32_flash() */
+/* ------------------------------------------------------------------ *\
+      Compute a CRC32 of a flash memory area streamed through the
+                        XIP streaming FIFO.
+     NOTES:
+     - The XIP controller reads the flash memory area on its own and
+       pushes it into its streaming FIFO, bypassing the XIP cache.
+       The DMA channel drains the FIFO while the sniffer computes the
+       CRC32, so the flash is read at full QSPI bandwidth and nothing
+       is evicted from the XIP cache.
+     - Offset (relative to XIP_BASE) must be aligned on 32 bits and
+       Length must be a multiple of 4.
+     - Result is the same as dma_crc32() on the same data.
+\* ------------------------------------------------------------------ */
+UINT32 dma_crc32_flash(UINT32 Offset, UINT32 Length)
+{
+  static UINT32 DummyTarget;
+
+  dma_channel_config DmaConfig;
+
+
+  /* Reserve a DMA channel on first call. */
+  if (DmaChannel < 0)
+    DmaChannel = dma_claim_unused_channel(true);
+
+  /* Make sure the streaming FIFO is empty before starting. */
+  while ((xip_ctrl_hw->stat & XIP_STAT_FIFO_EMPTY) == 0)
+    (void)xip_ctrl_hw->stream_fifo;
+
+  /* Ask XIP controller to stream the flash memory area. */
+  xip_ctrl_hw->stream_addr = XIP_BASE + Offset;
+  xip_ctrl_hw->stream_ctr  = Length / 4;
+
+  /* Read 32 bits words from the streaming FIFO as they become available, always write to the same dummy target. */
+  DmaConfig = dma_channel_get_default_config(DmaChannel);
+  channel_config_set_transfer_data_size(&DmaConfig, DMA_SIZE_32);
+  channel_config_set_read_increment(&DmaConfig, false);
+  channel_config_set_write_increment(&DmaConfig, false);
+  channel_config_set_dreq(&DmaConfig, DREQ_XIP_STREAM);
+  channel_config_set_sniff_enable(&DmaConfig, true);
+
+  /* Seed the sniffer and start the transfer. */
+  dma_sniffer_enable(DmaChannel, DMA_SNIFF_CTRL_CALC_VALUE_CRC32, true);
+  dma_hw->sniff_data = 0xFFFFFFFF;
+  dma_channel_configure(DmaChannel, &DmaConfig, &DummyTarget, (const volatile void *)XIP_AUX_BASE, (Length / 4), true);
+
+  dma_channel_wait_for_finish_blocking(DmaChannel);
+
+  return dma_hw->sniff_data;
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=display_all_flash() */
+/* ------------------------------------------------------------------ *\
+             Display Pico's complete flash address space.
+\* ------------------------------------------------------------------ */
+void display_all_flash(UINT8 DumpFormat)
+{
+  UCHAR String[256];
+
+  UINT32 StartOffset;
+  UINT32 Length;
+
+  
+  StartOffset = 0x00000000;
+  Length      = FlashChip.Size;
+
+
+
+  printf("=======================================================================================================\r");
+  sprintf(String, "Display Pico's complete flash address space:\r");
+  uart_send(__LINE__, String);
+
+  sprintf(String, "XIP_BASE: 0x%p   StartOffset: 0x%8.8X   Length: 0x%8.8X (%u)\r", XIP_BASE, StartOffset, Length, Length);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "(Note: Pico's flash memory space goes from 0x%8.8X to 0x%8.8X)\r\r", XIP_BASE, (XIP_BASE + FlashChip.Size - 1));
+  uart_send(__LINE__, String);
+
+  display_memory(XIP_BASE, StartOffset, Length, DumpFormat);
+
+  printf("\r");
+  sprintf(String, "End of display Pico's complete flash address space.\r");
+  uart_send(__LINE__, String);
+  printf("=======================================================================================================\r\r\r");
+
+  return;
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=display_all_ram() */
+/* ------------------------------------------------------------------ *\
+               Display Pico's complete RAM address space.
+\* ------------------------------------------------------------------ */
+void display_all_ram(UINT8 DumpFormat)
+{
+  UCHAR String[256];
+
+  UINT32 StartOffset;
+  UINT32 Length;
+
+  
+  StartOffset = 0x00000000;
+  Length      = 0x00042000;
+
+
+  printf("=======================================================================================================\r");
+  sprintf(String, "Display Pico's complete RAM address space:\r");
+  uart_send(__LINE__, String);
+
+  sprintf(String, "RAM base address: 0x%p   StartOffset: 0x%6.6X   Length: 0x%X (%u)\r", RAM_BASE_ADDRESS, StartOffset, Length, Length);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "(Note: Pico's RAM memory space goes from 0x20000000 to 0x20041FFF)\r\r");
+  uart_send(__LINE__, String);
+
+  display_memory(RAM_BASE_ADDRESS, StartOffset, Length, DumpFormat);
+
+  printf("\r");
+  sprintf(String, "End of Pico's RAM address space.\r");
+  uart_send(__LINE__, String);
+  printf("=======================================================================================================\r\r\r");
+
+  return;
+}
+
+
+
+
+
+/* $TITLE=display_complete_log() */
+/* ------------------------------------------------------------------- *\
+                  Erase all flash memory and display
+               complete log for this Raspberry Pi Pico.
+\* ------------------------------------------------------------------- */
+void display_complete_log(void)
+{
+  UCHAR String[256];
+
+
+  printf("                    This will erase Pico's whole flash address space except Pico's manufacturing test results.\r");
+  printf("                    Are you sure you want to proceed <Y/N>: ");
+  input_string(String);
+  if ((strcmp(String, "Y") != 0) && (strcmp(String, "y") != 0))
+    return;
+
+
+  display_manufacturing_test();
+  erase_all_flash(FLAG_ON);
+  flash_blank_check();
+  display_all_flash(DUMP_TEXT);
+  display_function_addresses();
+
+  return;
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=display_flash_mismatch() */
+/* ------------------------------------------------------------------ *\
+     Display the rows of a range of flash memory that don't match a
+                            test pattern.
+     NOTES:
+     - StartOffset and Length must be multiples of a sector (4096).
+     - This is the default flash test snapshot: a passing run displays
+       nothing and costs no more than a fast compare of the range.
+     - Sectors already checked by core 1 (dual-core pipeline) or found
+       good by the DMA sniffer (DMA_VERIFY) are not scanned again.
+       Other sectors are compared word by word to the pattern
+       generator output.
+     - Without the pipeline, the sectors found in error here are
+       flagged in PipelineSectorFlags[], the same way core 1 does, so
+       that flash_verify_pattern() doesn't check the whole range again.
+\* ------------------------------------------------------------------ */
+void display_flash_mismatch(UINT32 StartOffset, UINT32 Length, UINT8 Pattern, UINT8 Cycle)
+{
+  UCHAR String[256];
+
+  UINT8 FlagMismatch;
+  UINT8 Loop1UInt8;
+
+  UINT32 Loop1UInt32;
+  UINT32 Rows;
+  UINT32 Row[4];
+  UINT32 *RowWords;
+  UINT32 Sector;
+  UINT32 SectorOffset;
+
+  struct pattern_generator Generator;
+
+
+  /* Initializations. */
+  Rows = 0;
+
+
+  printf("=======================================================================================================\r");
+  sprintf(String, "Display flash memory rows not matching pattern from offset 0x%8.8X to offset 0x%8.8X:\r\r", StartOffset, (StartOffset + Length - 1));
+  uart_send(__LINE__, String);
+
+  FlagSectorFlags = FLAG_OFF;
+  if (FlagPipeline == FLAG_ON) pipeline_wait();
+
+  for (SectorOffset = StartOffset; SectorOffset < (StartOffset + Length); SectorOffset += FLASH_SECTOR_SIZE)
+  {
+    if (console_poll(SectorOffset) == FLAG_ON) break;
+
+    Sector = SectorOffset / FLASH_SECTOR_SIZE;
+    if (FlagPipeline == FLAG_ON)
+    {
+      /* Keep core 1 flags untouched, flash_verify_pattern() will need them. */
+      if ((PipelineSectorFlags[Sector / 32] & (1u << (Sector % 32))) == 0) continue;
+    }
+    else
+    {
+      /* Sector is flagged below if it is found in error, flash_verify_pattern() won't check it again otherwise. */
+      PipelineSectorFlags[Sector / 32] &= ~(1u << (Sector % 32));
+      #ifdef DMA_VERIFY
+      /* Same check as flash_verify_pattern() (protected content is expected as is). */
+      pattern_fill(Pattern, Cycle, SectorOffset, FlashOldData);
+      flash_preserve(SectorOffset, FlashOldData);
+      if (dma_crc32_flash(SectorOffset, FLASH_SECTOR_SIZE) == dma_crc32(FlashOldData, FLASH_SECTOR_SIZE)) continue;
+      PipelineSectorFlags[Sector / 32] |= (1u << (Sector % 32));
+      #endif
+    }
+
+    pattern_start(&Generator, Pattern, Cycle, SectorOffset);
+    for (Loop1UInt32 = 0; Loop1UInt32 < FLASH_SECTOR_SIZE; Loop1UInt32 += 16)
+    {
+      /* Always generate the four words of the row, so that the generator stays in sync with the offset. */
+      RowWords     = (UINT32 *)&FlashReadAddress[SectorOffset + Loop1UInt32];
+      FlagMismatch = FLAG_OFF;
+      for (Loop1UInt8 = 0; Loop1UInt8 < 4; ++Loop1UInt8)
+      {
+        Row[Loop1UInt8] = RowWords[Loop1UInt8];  // row is kept in RAM, to be formatted byte by byte.
+        if (Row[Loop1UInt8] != pattern_next(&Generator)) FlagMismatch = FLAG_ON;
+      }
+      if (FlagMismatch == FLAG_OFF) continue;
+
+      PipelineSectorFlags[Sector / 32] |= (1u << (Sector % 32));
+      format_memory_row(String, (XIP_BASE + SectorOffset + Loop1UInt32), (UINT8 *)Row, 16);
+      uart_send(__LINE__, String);
+      ++Rows;
+    }
+  }
+
+  /* Flags are complete only if the whole range has been looked at. */
+  if ((FlagPipeline == FLAG_OFF) && (SectorOffset >= (StartOffset + Length))) FlagSectorFlags = FLAG_ON;
+
+  printf("\r");
+  sprintf(String, "End of display flash memory rows not matching pattern: %lu row(s) displayed.\r", Rows);
+  uart_send(__LINE__, String);
+  printf("=======================================================================================================\r\r\r");
+
+  return;
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=display_flash_range() */
+/* ------------------------------------------------------------------ *\
+             Display a range of Pico's flash address space.
+\* ------------------------------------------------------------------ */
+void display_flash_range(UINT32 StartOffset, UINT32 Length, UINT8 DumpFormat)
+{
+  UCHAR String[256];
+
+
+  printf("=======================================================================================================\r");
+  sprintf(String, "Display Pico's flash address space from offset 0x%8.8X to offset 0x%8.8X:\r", StartOffset, (StartOffset + Length - 1));
+  uart_send(__LINE__, String);
+
+  sprintf(String, "XIP_BASE: 0x%p   StartOffset: 0x%8.8X   Length: 0x%8.8X (%u)\r\r", XIP_BASE, StartOffset, Length, Length);
+  uart_send(__LINE__, String);
+
+  display_memory(XIP_BASE, StartOffset, Length, DumpFormat);
+
+  printf("\r");
+  sprintf(String, "End of display Pico's flash address space from offset 0x%8.8X to offset 0x%8.8X.\r", StartOffset, (StartOffset + Length - 1));
+  uart_send(__LINE__, String);
+  printf("=======================================================================================================\r\r\r");
+
+  return;
+}
+
+
+
+
+
+/* $TITLE=display_function_addresses() */
+/* ------------------------------------------------------------------- *\
+                      Display addresses of functions.
+   They should be in RAM, somewhere between 0x20000000 and 0x20041FFF.
+\* ------------------------------------------------------------------- */
+void display_function_addresses(void)
+{
+  UCHAR String[256];
+
+
+  printf("=======================================================================================================\r");
+  sprintf(String, "Display functions' address:\r");
+  uart_send(__LINE__, String);
+  
+  sprintf(String, "FLASH_BASE_ADDRESS: 0x%p         RAM_BASE_ADDRESS: 0x%p\r", XIP_BASE, RAM_BASE_ADDRESS);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "(Note: Pico's FLASH memory space goes from 0x%8.8X to 0x%8.8X)\r", XIP_BASE, (XIP_BASE + FlashChip.Size - 1));
+  uart_send(__LINE__, String);
+
+  sprintf(String, "(Note: Pico's  RAM  memory space goes from 0x20000000 to 0x20041FFF)\r\r");
+  uart_send(__LINE__, String);
+
+  sprintf(String, "main():                             0x%p\r", main);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "benchmark():                        0x%p\r", benchmark);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "benchmark_report():                 0x%p\r", benchmark_report);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "binary_discard():                   0x%p\r", binary_discard);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "binary_receive():                   0x%p\r", binary_receive);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "binary_send():                      0x%p\r", binary_send);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "binary_vendor_claimed():            0x%p\r", binary_vendor_claimed);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "checkpoint_clear():                 0x%p\r", checkpoint_clear);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "checkpoint_find():                  0x%p\r", checkpoint_find);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "checkpoint_save():                  0x%p\r", checkpoint_save);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "command_flash_run():                0x%p\r", command_flash_run);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "command_mode():                     0x%p\r", command_mode);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "command_range():                    0x%p\r", command_range);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "command_reply():                    0x%p\r", command_reply);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "command_test():                     0x%p\r", command_test);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "console_command():                  0x%p\r", console_command);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "console_poll():                     0x%p\r", console_poll);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "core1_main():                       0x%p\r", core1_main);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "crc32_update():                     0x%p\r", crc32_update);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "dma_crc32():                        0x%p\r", dma_crc32);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "dma_crc32_flash():                  0x%p\r", dma_crc32_flash);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "display_all_flash():                0x%p\r", display_all_flash);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "display_all_ram():                  0x%p\r", display_all_ram);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "display_complete_log():             0x%p\r", display_complete_log);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "display_flash_mismatch():           0x%p\r", display_flash_mismatch);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "display_flash_range():              0x%p\r", display_flash_range);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "display_function_addresses():       0x%p\r", display_function_addresses);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "display_manufacturing_test():       0x%p\r", display_manufacturing_test);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "display_memory():                   0x%p\r", display_memory);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "display_memory_binary():            0x%p\r", display_memory_binary);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "display_microcontroller_id():       0x%p\r", display_microcontroller_id);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "display_ram_map():                  0x%p\r", display_ram_map);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "display_specific_sector():          0x%p\r", display_specific_sector);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "display_test_history():             0x%p\r", display_test_history);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "erase_all_flash()):                 0x%p\r", erase_all_flash);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "erase_count_add():                  0x%p\r", erase_count_add);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "erase_count_load():                 0x%p\r", erase_count_load);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "erase_count_save():                 0x%p\r", erase_count_save);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "erase_specific_sector()):           0x%p\r", erase_specific_sector);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "flash_blank_check():                0x%p\r", flash_blank_check);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "flash_blank_check_range():          0x%p\r", flash_blank_check_range);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "flash_blank_check_region():         0x%p\r", flash_blank_check_region);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "flash_enter_critical():             0x%p\r", flash_enter_critical);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "flash_erase():                      0x%p\r", flash_erase);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "flash_erase_block32():              0x%p\r", flash_erase_block32);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "flash_erase_range():                0x%p\r", flash_erase_range);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "flash_excluded():                   0x%p\r", flash_excluded);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "flash_exit_critical():              0x%p\r", flash_exit_critical);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "flash_hash_range():                 0x%p\r", flash_hash_range);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "flash_preserve():                   0x%p\r", flash_preserve);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "flash_probe():                      0x%p\r", flash_probe);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "flash_program():                    0x%p\r", flash_program);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "flash_sfdp_read():                  0x%p\r", flash_sfdp_read);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "flash_span_next():                  0x%p\r", flash_span_next);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "flash_test():                       0x%p\r", flash_test);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "flash_test_describe():              0x%p\r", flash_test_describe);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "flash_test_run():                   0x%p\r", flash_test_run);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "flash_verify_bisect():              0x%p\r", flash_verify_bisect);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "flash_verify_pattern():             0x%p\r", flash_verify_pattern);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "flash_verify_region():              0x%p\r", flash_verify_region);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "flash_write():                      0x%p\r", flash_write);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "flash_write_pattern():              0x%p\r", flash_write_pattern);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "format_memory_row():                0x%p\r", format_memory_row);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "image_upload():                     0x%p\r", image_upload);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "image_upload_result():              0x%p\r", image_upload_result);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "input_dump_format():                0x%p\r", input_dump_format);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "input_string():                     0x%p\r", input_string);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "input_string_echo():                0x%p\r", input_string_echo);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "input_test_plan():                  0x%p\r", input_test_plan);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "kv_append():                        0x%p\r", kv_append);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "kv_collect():                       0x%p\r", kv_collect);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "kv_create():                        0x%p\r", kv_create);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "kv_delete():                        0x%p\r", kv_delete);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "kv_init():                          0x%p\r", kv_init);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "kv_read():                          0x%p\r", kv_read);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "kv_scan():                          0x%p\r", kv_scan);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "kv_write():                         0x%p\r", kv_write);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "latency_record():                   0x%p\r", latency_record);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "latency_report():                   0x%p\r", latency_report);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "latency_reset():                    0x%p\r", latency_reset);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "log_drain():                        0x%p\r", log_drain);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "log_flush():                        0x%p\r", log_flush);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "log_in_chars():                     0x%p\r", log_in_chars);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "log_out_chars():                    0x%p\r", log_out_chars);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "log_write():                        0x%p\r", log_write);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "pattern_fill():                     0x%p\r", pattern_fill);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "pattern_next():                     0x%p\r", pattern_next);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "pattern_start():                    0x%p\r", pattern_start);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "pipeline_post():                    0x%p\r", pipeline_post);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "pipeline_sector_failed():           0x%p\r", pipeline_sector_failed);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "pipeline_wait():                    0x%p\r", pipeline_wait);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "profile_end():                      0x%p\r", profile_end);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "profile_report():                   0x%p\r", profile_report);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "profile_reset():                    0x%p\r", profile_reset);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "profile_start():                    0x%p\r", profile_start);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "ram_map():                          0x%p\r", ram_map);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "stack_high_water():                 0x%p\r", stack_high_water);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "stack_paint():                      0x%p\r", stack_paint);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "status_begin():                     0x%p\r", status_begin);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "status_end():                       0x%p\r", status_end);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "status_errors():                    0x%p\r", status_errors);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "status_offset():                    0x%p\r", status_offset);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "status_phase():                     0x%p\r", status_phase);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "status_read():                      0x%p\r", status_read);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "uart_send():                        0x%p\r", uart_send);
+  uart_send(__LINE__, String);
+
+
+  printf("\r");
+  sprintf(String, "End of functions' address display.\r");
+  uart_send(__LINE__, String);
+  printf("========================================================================================================\r\r\r");
+  printf("\r\r");
+
+  return;
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=display_manufacturing_test() */
+/* ------------------------------------------------------------------ *\
+               Display Pico's manufacturing test results.
+     This data has been saved in Pico's flash at address 0x1007F000
+                       and it is 107 bytes long.
+\* ------------------------------------------------------------------ */
+void display_manufacturing_test(void)
+{
+  UCHAR String[256];
+
+  UINT8 Copy[KV_MAX_VALUE];
+  UINT8 TestResultSize;
+
+  UINT16 CopyLength;
+
+  UINT32 TestResultOffset;
+
+
+  TestResultOffset = TEST_RESULT_OFFSET;
+  TestResultSize   = TEST_RESULT_SIZE;
+
+
+  printf("=======================================================================================================\r");
+  uart_send(__LINE__, "Display Pico's manufacturing test results:\r");
+
+  sprintf(String, "XIP_BASE: 0x%p   Offset: 0x%6.6X   Length: 0x%X (%u)\r", XIP_BASE, TestResultOffset, TestResultSize, TestResultSize);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "(Note: Pico's flash memory space goes from 0x%8.8X to 0x%8.8X)\r\r", XIP_BASE, (XIP_BASE + FlashChip.Size - 1));
+  uart_send(__LINE__, String);
+
+  display_memory(XIP_BASE, TestResultOffset, TestResultSize, DUMP_TEXT);
+
+  /* Compare with the copy kept in the metadata region. */
+  printf("\r");
+  if (kv_read(KV_KEY_MANUFACTURING, Copy, &CopyLength) != 0)
+  {
+    uart_send(__LINE__, "No copy of Pico's manufacturing test results has been kept in the metadata region.\r");
+  }
+  else if ((CopyLength == TestResultSize) && (memcmp(Copy, &FlashBaseAddress[TestResultOffset], TestResultSize) == 0))
+  {
+    uart_send(__LINE__, "The copy kept in the metadata region matches.\r");
+  }
+  else
+  {
+    uart_send(__LINE__, "<<<<< WARNING >>>>> The copy kept in the metadata region doesn't match:\r\r");
+    display_memory(RAM_BASE_ADDRESS, (UINT32)(Copy - (UINT8 *)RAM_BASE_ADDRESS), CopyLength, DUMP_TEXT);
+  }
+
+  printf("\r");
+  sprintf(String, "End of Pico's manufacturing test results.\r");
+  uart_send(__LINE__, String);
+  printf("=======================================================================================================\r\r\r");
+
+  return;
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=display_memory() */
+/* ------------------------------------------------------------------ *\
+           Display memory content through external monitor.
+     DumpFormat may be:
+     - DUMP_TEXT:    every line is displayed in hex and in ASCII.
+     - DUMP_COMPACT: same as DUMP_TEXT, but complete lines identical
+                     to the previous one are not displayed. They are
+                     summarized by "* <n> identical lines" before the
+                     next line displayed (like "hexdump").
+     - DUMP_BINARY:  see display_memory_binary().
+\* ------------------------------------------------------------------ */
+void display_memory(UINT32 BaseAddress, UINT32 Offset, UINT32 Length, UINT8 DumpFormat)
+{
+  UCHAR String[256];
+
+  UINT8 PreviousRow[16];
+  UINT8 *MemoryBaseAddress;
+  UINT8 *MemoryReadAddress;
+
+  UINT32 IdenticalRows;
+  UINT32 Loop1UInt32;
+
+
+  /* Binary frames are handled separately. */
+  if (DumpFormat == DUMP_BINARY)
+  {
+    display_memory_binary(BaseAddress, Offset, Length);
+    return;
+  }
+
+
+  /* Initializations. */
+  IdenticalRows = 0;
+
+  /* Point to target memory address (either RAM of flash). */
+  MemoryBaseAddress = (UINT8 *)(BaseAddress);
+
+  /* Rows are compared and formatted byte by byte, so flash memory is read through the cached XIP alias
+     (with the uncached alias, every byte read would be a QSPI transaction of its own). */
+  MemoryReadAddress = MemoryBaseAddress;
+
+  for (Loop1UInt32 = Offset; Loop1UInt32 < (Offset + Length); Loop1UInt32 += 16)
+  {
+    if ((((Loop1UInt32 - Offset) % FLASH_SECTOR_SIZE) == 0) && (console_poll(Loop1UInt32) == FLAG_ON)) break;
+
+    if (DumpFormat == DUMP_COMPACT)
+    {
+      /* Skip a complete line identical to the previous one, and summarize skipped lines before the next line displayed. */
+      if ((Loop1UInt32 != Offset) && ((Offset + Length - Loop1UInt32) >= 16) && (memcmp(PreviousRow, &MemoryReadAddress[Loop1UInt32], 16) == 0))
+      {
+        ++IdenticalRows;
+        continue;
+      }
+
+      if (IdenticalRows)
+      {
+        sprintf(String, "* %lu identical lines (0x%X bytes)\r", IdenticalRows, (IdenticalRows * 16));
+        uart_send(__LINE__, String);
+        IdenticalRows = 0;
+      }
+
+      if ((Offset + Length - Loop1UInt32) >= 16) memcpy(PreviousRow, &MemoryReadAddress[Loop1UInt32], 16);
+    }
+
+    /* Display memory address, memory content in hex and in ASCII. */
+    if ((Offset + Length - Loop1UInt32) < 16)
+      format_memory_row(String, (UINT32)(MemoryBaseAddress + Loop1UInt32), &MemoryReadAddress[Loop1UInt32], (Offset + Length - Loop1UInt32));
+    else
+      format_memory_row(String, (UINT32)(MemoryBaseAddress + Loop1UInt32), &MemoryReadAddress[Loop1UInt32], 16);
+
+    uart_send(__LINE__, String);
+  }
+
+  /* Summarize identical lines at the end of memory area. */
+  if (IdenticalRows)
+  {
+    sprintf(String, "* %lu identical lines (0x%X bytes)\r", IdenticalRows, (IdenticalRows * 16));
+    uart_send(__LINE__, String);
+  }
+
+  return;
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=display_memory_binary() */
+/* ------------------------------------------------------------------ *\
+          Send memory content to the host as binary frames.
+     NOTES:
+     - Frames are sent through USB CDC, or through the USB vendor bulk
+       endpoint when the host has claimed it (see binary_send()).
+     - Each frame is made of (multi-byte fields are little endian):
+         0x01 (SOH)      1 byte
+         Address         4 bytes  (absolute address of first byte)
+         Length          2 bytes  (1 to 1024)
+         Data            <Length> bytes
+         CRC32           4 bytes  (standard CRC-32 of Address,
+                                   Length and Data fields)
+     - The transfer ends with a frame whose Length is 0 (no data),
+       giving the address following the last byte sent.
+     - A host script waits for the first SOH after the header text
+       line, then reads frames until the end frame, checking the CRC
+       of every frame.
+     - Returns FLAG_OFF if the transfer has been abandoned because the
+       host stopped reading (see binary_send()), FLAG_ON otherwise.
+\* ------------------------------------------------------------------ */
+UINT8 display_memory_binary(UINT32 BaseAddress, UINT32 Offset, UINT32 Length)
+{
+  static UINT32 FrameWords[(1 + 7 + DUMP_FRAME_SIZE + 4 + 3) / 4];  // kept off core 0's stack.
+
+  UINT8 *Frame;
+  UINT8 *MemoryReadAddress;
+
+  UINT16 FrameLength;
+
+  UINT32 Address;
+  UINT32 Crc;
+  UINT32 Loop1UInt32;
+  UINT32 Loop2UInt32;
+
+
+  /* One byte of padding before the 7-byte header, so that frame data is aligned on 32 bits. */
+  Frame = (UINT8 *)FrameWords + 1;
+
+  /* Flash memory is read through the XIP alias that bypasses the XIP cache, by 32 bits words only. */
+  if (BaseAddress == XIP_BASE)
+    MemoryReadAddress = FlashReadAddress;
+  else
+    MemoryReadAddress = (UINT8 *)BaseAddress;
+
+  Loop1UInt32 = Offset;
+  do
+  {
+    /* Last frame (with no data) marks the end of the transfer. */
+    if ((Offset + Length - Loop1UInt32) > DUMP_FRAME_SIZE)
+      FrameLength = DUMP_FRAME_SIZE;
+    else
+      FrameLength = (Offset + Length - Loop1UInt32);
+    Address = BaseAddress + Loop1UInt32;
+
+    /* Frame header. */
+    Frame[0] = 0x01;
+    Frame[1] = (Address);
+    Frame[2] = (Address >> 8);
+    Frame[3] = (Address >> 16);
+    Frame[4] = (Address >> 24);
+    Frame[5] = (FrameLength);
+    Frame[6] = (FrameLength >> 8);
+
+    /* Frame data and CRC32. */
+    if ((BaseAddress == XIP_BASE) && ((Loop1UInt32 % 4) == 0))
+    {
+      /* Last word may go beyond the frame data, it is then overwritten by the CRC32. */
+      for (Loop2UInt32 = 0; Loop2UInt32 < FrameLength; Loop2UInt32 += 4)
+        FrameWords[2 + (Loop2UInt32 / 4)] = *(UINT32 *)&FlashReadAddress[Loop1UInt32 + Loop2UInt32];
+    }
+    else if (BaseAddress == XIP_BASE)
+      memcpy(&Frame[7], &FlashBaseAddress[Loop1UInt32], FrameLength);  // unaligned offset: read through the cached alias.
+    else
+      memcpy(&Frame[7], &MemoryReadAddress[Loop1UInt32], FrameLength);
+    Crc = crc32_update(0, &Frame[1], (6 + FrameLength));
+    Frame[7 + FrameLength]     = (Crc);
+    Frame[7 + FrameLength + 1] = (Crc >> 8);
+    Frame[7 + FrameLength + 2] = (Crc >> 16);
+    Frame[7 + FrameLength + 3] = (Crc >> 24);
+
+    if (binary_send(Frame, (7 + FrameLength + 4)) == FLAG_OFF) return FLAG_OFF;
+
+    Loop1UInt32 += FrameLength;
+  } while (FrameLength != 0);
+
+  return FLAG_ON;
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=display_microcontroller_id() */
+/* ------------------------------------------------------------------ *\
+         Determine if the microcontroller is a Pico or a Pico W
+                     and display its Unique Number.
+\* ------------------------------------------------------------------ */
+UINT8 display_microcontroller_id(void)
+{
+  UCHAR String[256];
+
+  UINT8 Loop1UInt8;
+  UINT8 PicoType;
+  
+  UINT16 AdcValue1;
+  UINT16 AdcValue2;
+
+  float Volts1;
+  float Volts2;
+
+  pico_unique_board_id_t board_id;
+
+
+  printf("=======================================================================================================\r");
+  printf("                                          Pico-Flash-Utility\r");
+
+
+  /* Select power supply input. */
+  adc_select_input(3);
+  gpio_put(PICO_LED, true);
+
+  /* Read ADC converter raw value. */
+  AdcValue1 = adc_read();
+
+  /* Convert raw value to voltage value. */
+  Volts1 = (3 * (AdcValue1 * 3.3f / 4096));
+
+
+
+  /* The important power supply value to consider is when GPIO25 is Low. */
+  gpio_put(PICO_LED, false);
+    
+  /* Read ADC converter raw value. */
+  AdcValue2 = adc_read();
+
+  /* Convert raw value to voltage value. */
+  Volts2 = (3 * (AdcValue2 * 3.3f / 4096));
+  if (Volts2 > 3)
+  {
+    printf("                                Microcontroller is a Raspberry Pi Pico\r");
+    PicoType = TYPE_PICO;
+  }
+  else
+  {
+    printf("                               Microcontroller is a Raspberry Pi Pico W\r");
+    PicoType = TYPE_PICO_W;
+  }
+
+
+
+  /* Retrieve Pico Unique Number from flash memory IC. */
+  pico_get_unique_board_id(&board_id);
+    
+  /* Build-up the Unique ID string in hex. */
+  sprintf(String, "                                     Pico ID: ");
+  for (Loop1UInt8 = 0; Loop1UInt8 < PICO_UNIQUE_BOARD_ID_SIZE_BYTES; ++Loop1UInt8)
+  {
+    sprintf(&String[strlen(String)], "%2.2X", board_id.id[Loop1UInt8]);
     if ((Loop1UInt8 % 2) && (Loop1UInt8 != 7))
       sprintf(&String[strlen(String)], " ");
   }
-  sprintf(&String[strlen(String)], "\r");
-  printf(String);
+  sprintf(&String[strlen(String)], "\r");
+  printf(String);
+
+  /* Flash IC characteristics have been retrieved at startup (see flash_probe()). */
+  printf("                 Flash IC JEDEC ID: %2.2X %2.2X %2.2X   size: %lu KB   SFDP: %s\r", FlashChip.JedecId[0], FlashChip.JedecId[1], FlashChip.JedecId[2], (FlashChip.Size / 1024), (FlashChip.FlagSfdp == FLAG_ON) ? "yes" : "no");
+  printf("                      Largest erase: %lu KB (opcode 0x%2.2X)   page size: %u bytes\r", (FlashChip.EraseSize / 1024), FlashChip.EraseCommand, FlashChip.PageSize);
+  
+  // printf("                                  AdcValue with PICO_LED true: %4.4u\r", AdcValue1);
+  // printf("            Voltage is between 1.8 and 5 volts on a Pico but near 0 volt on a Pico W: %2.2f\r", Volts1);
+  
+  // printf("                                  AdcValue with PICO_LED false: %4.4u\r", AdcValue2);
+  // printf("            Voltage is between 1.8 and 5 volts on a Pico but near 0 volt on a Pico W: %2.2f\r", Volts2);
+
+  printf("=======================================================================================================\r\r\r");
+
+  return PicoType;
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=display_ram_map() */
+/* ------------------------------------------------------------------ *\
+       Display Pico's RAM memory map, stack high-water marks and the
+                   content of meaningful RAM regions.
+     NOTES:
+     - Memory map comes from the linker script symbols (see
+       ram_map()).
+     - Code and free space are not displayed (code may be found in
+       the .elf file). Other regions are displayed with identical
+       lines summarized (DUMP_COMPACT), so that zero-filled areas
+       take a single line.
+     - Only the part of each stack that has been used since power-up
+       is displayed (see stack_paint()).
+\* ------------------------------------------------------------------ */
+void display_ram_map(void)
+{
+  UCHAR String[256];
+
+  UINT8 Loop1UInt8;
+  UINT8 Regions;
+
+  struct ram_region Region[RAM_MAP_REGIONS];
+
+
+  Regions = ram_map(Region);
+
+  printf("=======================================================================================================\r");
+  uart_send(__LINE__, "Pico's RAM memory map:\r\r");
+
+  uart_send(__LINE__, "Region                             Start        End          Length\r");
+  for (Loop1UInt8 = 0; Loop1UInt8 < Regions; ++Loop1UInt8)
+  {
+    sprintf(String, "%-32s   0x%8.8X   0x%8.8X   0x%6.6X (%lu)\r", Region[Loop1UInt8].Name, Region[Loop1UInt8].Start, (Region[Loop1UInt8].Start + Region[Loop1UInt8].Length - 1),
+            Region[Loop1UInt8].Length, Region[Loop1UInt8].Length);
+    uart_send(__LINE__, String);
+  }
+  printf("\r");
+
+  sprintf(String, "Core 0 stack high-water mark: %lu bytes used out of %lu bytes reserved.\r", ((UINT32)__StackTop - stack_high_water((UINT32)__StackBottom, (UINT32)__StackTop)),
+          ((UINT32)__StackTop - (UINT32)__StackBottom));
+  uart_send(__LINE__, String);
+  sprintf(String, "Core 1 stack high-water mark: %lu bytes used out of %lu bytes reserved.\r", ((UINT32)__StackOneTop - stack_high_water((UINT32)__StackOneBottom, (UINT32)__StackOneTop)),
+          ((UINT32)__StackOneTop - (UINT32)__StackOneBottom));
+  uart_send(__LINE__, String);
+  if ((stack_high_water((UINT32)__StackBottom, (UINT32)__StackTop) == (UINT32)__StackBottom) || (stack_high_water((UINT32)__StackOneBottom, (UINT32)__StackOneTop) == (UINT32)__StackOneBottom))
+    uart_send(__LINE__, "WARNING: a stack has been used up to its bottom and may have overflowed.\r");
+  printf("\r\r");
+
+  for (Loop1UInt8 = 0; Loop1UInt8 < Regions; ++Loop1UInt8)
+  {
+    if ((Region[Loop1UInt8].FlagDump == FLAG_OFF) || (Region[Loop1UInt8].Length == 0)) continue;
+
+    sprintf(String, "%s:\r", Region[Loop1UInt8].Name);
+    uart_send(__LINE__, String);
+    display_memory(RAM_BASE_ADDRESS, (Region[Loop1UInt8].Start - RAM_BASE_ADDRESS), Region[Loop1UInt8].Length, DUMP_COMPACT);
+    printf("\r");
+
+    if (FlagAbort == FLAG_ON) break;
+  }
+
+  sprintf(String, "End of Pico's RAM memory map.\r");
+  uart_send(__LINE__, String);
+  printf("=======================================================================================================\r\r\r");
+
+  return;
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=display_specific_sector() */
+/* ------------------------------------------------------------------ *\
+              Display Pico's specific flash memory sector.
+\* ------------------------------------------------------------------ */
+void display_specific_sector(void)
+{
+  UCHAR String[256];
+
+  UINT32 SectorOffset;
+
+
+  /* Request sector to be displayed. */
+  printf("                    Enter sector offset in hex (0x000000 to 0x%6.6X): ", (FlashChip.Size - 1));
+  input_string(String);
+  SectorOffset = strtol(String, NULL, 16);
+  printf("\r\r");
+  
+  
+  /* Validate sector number entered. */
+  while (SectorOffset > (FlashChip.Size - 1))
+  {
+    printf("                    Invalid sector offset entered...[0x%5.5X]\r", SectorOffset);
+    printf("                    Sector offset must be a value in hexadecimal between 0 and %X\r", (FlashChip.Size - 1));
+    printf("                    Enter sector offset (or <Enter> to return to menu): ");
+    input_string(String);
+    if (String[0] == 0x0D) break;  // if user pressed <Enter> only.
+    SectorOffset = strtol(String, NULL, 16);
+  }
+  if (String[0] == 0x0D) return;  // if user pressed <Enter> only.
+
+  
+  /* Make sure display begins on a sector boundary. */
+  while ((SectorOffset % FLASH_SECTOR_SIZE) != 0)
+    --SectorOffset;
+
+  
+  printf("=======================================================================================================\r");
+  sprintf(String, "Display Pico's flash memory sector:\r");
+  uart_send(__LINE__, String);
+  
+  sprintf(String, "XIP_BASE: 0x%p   Offset: 0x%6.6X   Length: 0x%X (%u)\r", XIP_BASE, SectorOffset, FLASH_SECTOR_SIZE, FLASH_SECTOR_SIZE);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "(Note: Pico's flash memory space goes from 0x%8.8X to 0x%8.8X)\r\r", XIP_BASE, (XIP_BASE + FlashChip.Size - 1));
+  uart_send(__LINE__, String);
+
+  display_memory(XIP_BASE, SectorOffset, FLASH_SECTOR_SIZE, DUMP_TEXT);
+
+  printf("\r");
+  sprintf(String, "End of flash specific sector display.\r");
+  uart_send(__LINE__, String);
+  printf("=======================================================================================================\r\r\r");
+
+  return;
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=display_test_history() */
+/* ------------------------------------------------------------------ *\
+      Display the summary of the last flash tests and the erase
+           counts kept in the metadata region of flash memory.
+     NOTE: Start time is the time since power-up when the test was
+           started, since Pico has no real-time clock.
+\* ------------------------------------------------------------------ */
+void display_test_history(void)
+{
+  UCHAR String[256];
+
+  UINT8 Loop1UInt8;
+  UINT8 Phase;
+
+  UINT16 ResultLength;
+
+  UINT32 Loop1UInt32;
+  UINT32 MaxCount;
+  UINT32 MaxOffset;
+  UINT32 Runs;
+  UINT32 SectorCount;
+
+  UINT64 TotalCount;
+
+  struct test_result Result;
+
+
+  printf("=======================================================================================================\r");
+  uart_send(__LINE__, "Flash test history (most recent first).\r\r");
+
+  if ((kv_read(KV_KEY_TEST_RESULT, (UINT8 *)&Result, &ResultLength) != 0) || (ResultLength != sizeof(Result)))
+  {
+    uart_send(__LINE__, "No flash test has been run on this Pico yet.\r\r");
+  }
+  else
+  {
+    Runs = Result.Runs;
+    for (Loop1UInt8 = 0; (Loop1UInt8 < TEST_HISTORY_SIZE) && (Loop1UInt8 < Runs); ++Loop1UInt8)
+    {
+      if ((kv_read(KV_KEY_HISTORY + ((Runs - Loop1UInt8) % TEST_HISTORY_SIZE), (UINT8 *)&Result, &ResultLength) != 0) || (ResultLength != sizeof(Result))) continue;
+
+      sprintf(String, "Run %4lu  <%s>  started at %llu sec  duration %lu sec  %u cycle(s)  %llu errors%s\r", Result.Runs, Result.Name, Result.StartTime / 1000000,
+              Result.Duration, Result.Cycles, Result.TotalErrors, ((Result.FlagAborted == FLAG_ON) ? "  (aborted)" : ""));
+      uart_send(__LINE__, String);
+
+      String[0] = 0x00;
+      for (Phase = 0; Phase < PHASE_COUNT; ++Phase)
+        sprintf(&String[strlen(String)], "  %s: %lu KB/sec", PhaseName[Phase], Result.Throughput[Phase]);
+      strcat(String, "\r\r");
+      uart_send(__LINE__, String);
+    }
+  }
+
+  /* Erase counts summary. */
+  TotalCount  = 0;
+  SectorCount = 0;
+  MaxCount    = 0;
+  MaxOffset   = 0;
+  for (Loop1UInt32 = 0; Loop1UInt32 < (FlashChip.Size / FLASH_SECTOR_SIZE); ++Loop1UInt32)
+  {
+    if (EraseCount[Loop1UInt32] == 0) continue;
+
+    TotalCount += EraseCount[Loop1UInt32];
+    ++SectorCount;
+    if (EraseCount[Loop1UInt32] > MaxCount)
+    {
+      MaxCount  = EraseCount[Loop1UInt32];
+      MaxOffset = Loop1UInt32 * FLASH_SECTOR_SIZE;
+    }
+  }
+
+  sprintf(String, "Sector erases: %llu total on %lu sectors, most erased sector is 0x%8.8X with %lu erases.\r", TotalCount, SectorCount, MaxOffset, MaxCount);
+  uart_send(__LINE__, String);
+  printf("=======================================================================================================\r\r\r");
+
+  return;
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=erase_all_flash() */
+/* ------------------------------------------------------------------ *\
+                 Erase Pico's whole flash address space
+       except protected regions (Pico's manufacturing test results
+                       and metadata region).
+\* ------------------------------------------------------------------ */
+void erase_all_flash(UINT8 FlagUnattended)
+{
+  UCHAR String[256];
+
+  UINT32 StartOffset;
+  UINT32 EndOffset;
+  
+  
+  /* Initializations. */
+  StartOffset = 0x00000000;
+  EndOffset   = FlashChip.Size - 1;
+
+
+  if (FlagUnattended == FLAG_OFF)
+  {
+    printf("                    This will erase Pico's whole flash address space except Pico's manufacturing test results and metadata region.\r");
+    printf("                    Are you sure you want to proceed <Y/N>: ");
+    input_string(String);
+    if ((strcmp(String, "Y") != 0) && (strcmp(String, "y") != 0))
+      return;
+  }
+
+
+  if (((void *)main < (void *)0x20000000) || ((void *)main > (void *)0x20041FFF))
+  {
+    sprintf(String, "<<<<< FATAL >>>>> YOU CAN'T ERASE FLASH MEMORY WHILE YOU RUN THE APPLICATION FROM FLASH.\r");
+    uart_send(__LINE__, String);
+
+    sprintf(String, "                  THIS WOULD BE PROGRAM SELF-DESTRUCTION !!!\r\r\r");
+    uart_send(__LINE__, String);
+
+    return;
+  }
+
+
+  printf("=======================================================================================================\r");
+  sprintf(String, "Erase Pico's whole flash address space.\r");
+  uart_send(__LINE__, String);
+  
+  sprintf(String, "XIP_BASE: 0x%p   StartOffset: 0x%8.8X   EndOffset: 0x%8.8X (%u)\r\r", XIP_BASE, StartOffset, EndOffset, EndOffset);
+  uart_send(__LINE__, String);
+
+  printf("Erasing blocks...\r");
+  status_begin(MODE_ERASE_WHOLE_FLASH, StartOffset, (EndOffset - StartOffset + 1), 1);
+  flash_erase_range(StartOffset, (EndOffset - StartOffset + 1));
+  erase_count_save();
+  status_end();
+
+
+  printf("\r");
+  sprintf(String, "End erasing whole flash address space.\r");
+  uart_send(__LINE__, String);
+  printf("=======================================================================================================\r\r\r");
+  printf("\r\r");
+
+  return;
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=erase_count_add() */
+/* ------------------------------------------------------------------ *\
+       Add one erase to the erase count of each sector in a range.
+     NOTES:
+     - Counts are kept in RAM and saved to flash by erase_count_save().
+     - Counts stop at 0xFFFE since 0xFFFF is erased flash.
+\* ------------------------------------------------------------------ */
+void erase_count_add(UINT32 Offset, UINT32 Length)
+{
+  UINT32 SectorOffset;
+
+
+  for (SectorOffset = (Offset - (Offset % FLASH_SECTOR_SIZE)); (SectorOffset < (Offset + Length)) && (SectorOffset < FlashChip.Size); SectorOffset += FLASH_SECTOR_SIZE)
+  {
+    if (EraseCount[SectorOffset / FLASH_SECTOR_SIZE] < 0xFFFE) ++EraseCount[SectorOffset / FLASH_SECTOR_SIZE];
+    ++EraseCountPending;
+  }
+
+  return;
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=erase_count_load() */
+/* ------------------------------------------------------------------ *\
+       Read the erase count of each sector from the metadata region.
+\* ------------------------------------------------------------------ */
+void erase_count_load(void)
+{
+  UINT32 Loop1UInt32;
+
+
+  memcpy(EraseCount, &FlashBaseAddress[ERASE_COUNT_OFFSET], ERASE_COUNT_SIZE);
+
+  /* Erased flash means no erase counted yet. */
+  for (Loop1UInt32 = 0; Loop1UInt32 < (FlashChip.Size / FLASH_SECTOR_SIZE); ++Loop1UInt32)
+    if (EraseCount[Loop1UInt32] == 0xFFFF) EraseCount[Loop1UInt32] = 0;
+
+  return;
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=erase_count_save() */
+/* ------------------------------------------------------------------ *\
+       Save the erase count of each sector to the metadata region.
+     NOTES:
+     - Called at the end of long operations only (flash test, whole
+       flash erase, image upload and benchmark).
+     - Saving erases the erase count sectors themselves, so counts are
+       only saved once at least ERASE_COUNT_SAVE_MIN sector erases have
+       been counted since they were last saved. Otherwise, the erase
+       count sectors would wear out faster than the sectors they count.
+       Up to ERASE_COUNT_SAVE_MIN - 1 erases may be lost at power-off,
+       which doesn't matter for an estimate of the wear.
+\* ------------------------------------------------------------------ */
+void erase_count_save(void)
+{
+  UINT8 Loop1UInt8;
+
+
+  if (EraseCountPending < ERASE_COUNT_SAVE_MIN) return;
+
+  /* flash_write() only erases the sectors whose content has changed. Only ERASE_COUNT_SIZE bytes are in use for the flash IC found. */
+  for (Loop1UInt8 = 0; (Loop1UInt8 * FLASH_SECTOR_SIZE) < ERASE_COUNT_SIZE; ++Loop1UInt8)
+    flash_write(ERASE_COUNT_OFFSET + (Loop1UInt8 * FLASH_SECTOR_SIZE), (UINT8 *)EraseCount + (Loop1UInt8 * FLASH_SECTOR_SIZE), (((ERASE_COUNT_SIZE - (Loop1UInt8 * FLASH_SECTOR_SIZE)) < FLASH_SECTOR_SIZE) ? (ERASE_COUNT_SIZE - (Loop1UInt8 * FLASH_SECTOR_SIZE)) : FLASH_SECTOR_SIZE));
+
+  /* The erases of the erase count sectors above are counted in RAM and will be saved next time. */
+  EraseCountPending = 0;
+
+  return;
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=erase_specific_sector() */
+/* ------------------------------------------------------------------ *\
+               Erase a specific sector of Pico's flash.
+\* ------------------------------------------------------------------ */
+void erase_specific_sector(void)
+{
+  UCHAR String[256];
+
+  UINT32 SectorOffset;
+
+  
+  printf("                    Enter offset of the sector to erase in hex (or <Enter> to return to menu): ");
+  input_string(String);
+  SectorOffset = strtol(String, NULL, 16);
+  printf("\r\r");
+
+  while (SectorOffset % 4096)
+  {
+    printf("                    Invalid sector offset entered...[0x%5.5X]\r", SectorOffset);
+    printf("                    Sector offset must be aligned on a sector boundary (0x3000, 0xB000, 0x7A000, 1EC000)\r");
+    printf("                    Enter offset of the sector to erase in hex (or <Enter> to return to menu): ");
+    input_string(String);
+    if (String[0] == 0x0D) break;  // if user pressed <Enter> only.
+    SectorOffset = strtol(String, NULL, 16);
+  }
+  if (String[0] == 0x0D) return;  // if user pressed <Enter> only.
+
+  
+  printf("=======================================================================================================\r");
+  sprintf(String, "Erase Pico's specific flash memory sector at offset 0x%8.8X\r", SectorOffset);
+  uart_send(__LINE__, String);
+  
+  sprintf(String, "XIP_BASE: 0x%p   Offset: 0x%6.6X   Length: 0x%X (%u)\r", XIP_BASE, SectorOffset, FLASH_SECTOR_SIZE, FLASH_SECTOR_SIZE);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "(Note: Pico's flash memory space goes from 0x%8.8X to 0x%8.8X)\r\r", XIP_BASE, (XIP_BASE + FlashChip.Size - 1));
+  uart_send(__LINE__, String);
+
+  display_memory(XIP_BASE, SectorOffset, FLASH_SECTOR_SIZE, DUMP_TEXT);
+  
+  printf("\r\r");
+  printf("                    Are you sure you want to erase this sector <Y/N>: ");
+  input_string(String);
+  if ((strcmp(String, "Y") != 0) && (strcmp(String, "y") != 0))
+    return;
+
+  printf("\r\r");
+  printf("=======================================================================================================\r");
+  sprintf(String, "Erase a specific sector of Pico's flash at offset 0x%8.8X.\r", SectorOffset);
+  uart_send(__LINE__, String);
+  
+  sprintf(String, "XIP_BASE: 0x%p   Offset: 0x%X  Length: 0x%X (%u)\r", XIP_BASE, SectorOffset, FLASH_SECTOR_SIZE, FLASH_SECTOR_SIZE);
+  uart_send(__LINE__, String);
+
+  flash_erase(SectorOffset);
+  
+  printf("\r");
+  sprintf(String, "End of erase specific flash sector.\r");
+  uart_send(__LINE__, String);
+  printf("=======================================================================================================\r\r\r");
+
+  return;
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=flash_blank_check() */
+/* ------------------------------------------------------------------ *\
+                 Check if flash area is blank (0xFF).
+\* ------------------------------------------------------------------ */
+UINT64 flash_blank_check(void)
+{
+  UCHAR String[256];
+
+  UINT32 StartOffset;
+  UINT32 EndOffset;
+
+  UINT64 TotalErrors;
+
+
+  /* Initializations. */
+  StartOffset = 0x00000000;
+  EndOffset   = FlashChip.Size - 1;
+
+
+  /***
+  // This block would allow for a restricted flash blank test, but I didn't see a great utility for it.
+  // Since this function may be called from the option 6 "macro", asking for a start address from user would require
+  // a small change to remain unattended.
+  printf("                    Enter start offset for flash blank check (in hex): ");
+  input_string(String);
+  StartOffset = strtol(String, NULL, 16);
+
+  // Validate sector number entered.
+  while (StartOffset > 0x1FFFFF)
+  {
+    printf("                    Invalid start offset entered...[0x%8.8X]\r", StartOffset);
+    printf("                    Start offset must be an hexadecimal value between 000000 and 1FFFFF\r");
+    printf("                    Enter start offset (or press <Enter> to return to menu): ");
+    input_string(String);
+    if (String[0] == 0x0D) break;  // if user pressed <Enter> only.
+    StartOffset = strtol(String, NULL, 16);
+  }
+  if (String[0] == 0x0D) break;  // if user pressed <Enter> only.
+  printf("\r\r");
+  ***/
+
+
+  status_begin(MODE_BLANK_CHECK, StartOffset, (EndOffset - StartOffset + 1), 1);
+  TotalErrors = flash_blank_check_range(StartOffset, (EndOffset - StartOffset + 1));
+  status_end();
+
+  return TotalErrors;
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=flash_blank_check_range() */
+/* ------------------------------------------------------------------ *\
+     Check if a range of flash memory is blank (0xFF), with header
+                           and summary.
+     NOTE: StartOffset and Length must be multiples of a sector (4096)
+           when the dual-core pipeline is used.
+\* ------------------------------------------------------------------ */
+UINT64 flash_blank_check_range(UINT32 StartOffset, UINT32 Length)
+{
+  UCHAR String[256];
+
+  UINT32 Loop1UInt32;
+
+  UINT64 TotalErrors;
+
+
+  /* Initializations. */
+  TotalErrors = 0;
+
+
+  printf("======================================================================================================\r");
+  uart_send(__LINE__, "Pico's flash blank check.\r");
+   
+  sprintf(String, "XIP_BASE: 0x%p   StartOffset: 0x%8.8X   EndOffset: 0x%8.8X\r\r", XIP_BASE, StartOffset, (StartOffset + Length - 1));
+  uart_send(__LINE__, String);
+
+  
+  if (FlagPipeline == FLAG_ON)
+  {
+    /* Core 1 has already checked every block erased, only display the sectors where it found an error. */
+    pipeline_wait();
+    for (Loop1UInt32 = StartOffset; Loop1UInt32 < (StartOffset + Length); Loop1UInt32 += FLASH_SECTOR_SIZE)
+    {
+      if (pipeline_sector_failed(Loop1UInt32) == FLAG_ON)
+        TotalErrors += flash_blank_check_region(Loop1UInt32, FLASH_SECTOR_SIZE);
+    }
+  }
+  else
+  {
+    TotalErrors = flash_blank_check_region(StartOffset, Length);
+  }
+
+  printf("\r");
+  sprintf(String, "End of Pico's flash blank check from offset 0x%8.8X to offset 0x%8.8X\r", StartOffset, (StartOffset + Length - 1));
+  uart_send(__LINE__, String);
+  sprintf(String, "Total errors found: %llu (0x%X) (see documentation)\r", TotalErrors, TotalErrors);
+  uart_send(__LINE__, String);
+  printf("========================================================================================================\r\r\r");
+
+  return TotalErrors;
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=flash_blank_check_region() */
+/* ------------------------------------------------------------------ *\
+         Check if a region of flash memory is blank (0xFF) and
+                display the ranges that are not blank.
+     NOTES:
+     - Region is split into spans that don't overlap any protected
+       region (see flash_span_next()), so protected bytes are never
+       looked at nor counted as errors.
+     - Within a span, 16 bytes are checked at once. Bytes are looked
+       at only when a row is not blank.
+\* ------------------------------------------------------------------ */
+UINT64 flash_blank_check_region(UINT32 Offset, UINT32 Length)
+{
+  UCHAR String[256];
+
+  UINT8  FlagSkipLine;
+  UINT8  FlagStarted;
+
+  UINT32 FirstByte;
+  UINT32 LastByte;
+  UINT32 Loop1UInt32;
+  UINT32 Loop2UInt32;
+  UINT32 Row[4];
+  UINT32 RowErrors;
+  UINT32 *RowWords;
+  UINT32 SpanEnd;
+  UINT32 SpanStart;
+
+  UINT64 TotalErrors;
+
+
+  /* Initializations. */
+  FlagStarted = FLAG_OFF;
+  TotalErrors = 0;
+
+
+  FlagSkipLine = FLAG_OFF;
+  for (SpanStart = flash_span_next(Offset, (Offset + Length), &SpanEnd); SpanStart < (Offset + Length); SpanStart = flash_span_next(SpanEnd, (Offset + Length), &SpanEnd))
+  {
+    for (Loop1UInt32 = (SpanStart & ~15); Loop1UInt32 < SpanEnd; Loop1UInt32 += 16)
+    {
+      if (((Loop1UInt32 % FLASH_SECTOR_SIZE) == 0) && (console_poll(Loop1UInt32) == FLAG_ON)) break;
+
+      /* Fast path: check the four aligned 32-bit words of this range at once (blank flash reads 0xFFFFFFFF). */
+      RowWords  = (UINT32 *)&FlashReadAddress[Loop1UInt32];
+      RowErrors = 0;
+      if ((RowWords[0] & RowWords[1] & RowWords[2] & RowWords[3]) != 0xFFFFFFFF)
+      {
+        /* Slow path: range is not blank. Copy the row to RAM with word reads (byte reads through the uncached
+           alias would each be a QSPI transaction), then count the bytes in error that are part of the span. */
+        Row[0] = RowWords[0];
+        Row[1] = RowWords[1];
+        Row[2] = RowWords[2];
+        Row[3] = RowWords[3];
+        FirstByte = ((Loop1UInt32 < SpanStart) ? SpanStart : Loop1UInt32);
+        LastByte  = (((Loop1UInt32 + 16) > SpanEnd) ? SpanEnd : (Loop1UInt32 + 16));
+        for (Loop2UInt32 = FirstByte; Loop2UInt32 < LastByte; ++Loop2UInt32)
+          if (((UINT8 *)Row)[Loop2UInt32 - Loop1UInt32] != 0xFF) ++RowErrors;
+      }
+
+      if (RowErrors == 0)
+      {
+        if (FlagSkipLine == FLAG_OFF)
+        {
+          FlagSkipLine = FLAG_ON;
+
+          /* Prevent line feed on first pass. */
+          if (FlagStarted == FLAG_ON) printf("\r");
+        }
+
+        FlagStarted = FLAG_ON;
+        continue;
+      }
+
+
+      /* Range is not blank, display it. */
+      FlagSkipLine = FLAG_OFF;
+      TotalErrors += RowErrors;
+
+
+      /* Display start address, data in hex and in ASCII. */
+      String[0] = ' ';
+      format_memory_row(&String[1], (XIP_BASE + Loop1UInt32), (UINT8 *)Row, 16);
+      uart_send(__LINE__, String);
+
+      FlagStarted = FLAG_ON;
+    }
+    if (FlagAbort == FLAG_ON) break;
+  }
+
+  return TotalErrors;
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=flash_enter_critical() */
+/* ------------------------------------------------------------------ *\
+       Pause core 1 and disable interrupts before a flash erase or
+                          program operation.
+     Core 1 spins in RAM until flash_exit_critical() is called, so it
+     never reads the XIP window while the flash IC is busy.
+     Interrupt mask on entry is returned to be given back to
+     flash_exit_critical().
+\* ------------------------------------------------------------------ */
+UINT32 flash_enter_critical(void)
+{
+  if (Core1Ready == FLAG_ON) multicore_lockout_start_blocking();
+
+  return save_and_disable_interrupts();
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=flash_erase() */
+/* ------------------------------------------------------------------ *\
+                  Erase data in Pico's flash memory.
+     NOTES:
+     - The way the electronics is done, one sector of the flash
+       (4096 bytes) must be erased at a time.
+     - This function has been kept simple and one sector (4096 bytes)
+       will be erased, beginning at the specified offset, which must
+       be aligned on a sector boundary (4096).
+\* ------------------------------------------------------------------ */
+void flash_erase(UINT32 FlashMemoryOffset)
+{
+  UCHAR String[256];
+
+  UINT16 Loop1UInt16;
+
+  UINT32 EndTime;
+  UINT32 InterruptMask;
+  UINT32 StartTime;
+
+
+  /* Erase a sector of Pico's flash memory.
+     FlashMemoryOffset is the offset in flash memory (relative to XIP_BASE) and must be aligned on a sector boundary (a multiple of 4096). */
+  if (FlashMemoryOffset % FLASH_SECTOR_SIZE)
+  {
+    sprintf(String, "Offset specified for flash_erase(0x%8.8X) is not aligned on a sector boundary (multiple of 4096)\r", FlashMemoryOffset);
+    uart_send(__LINE__, String);
+
+    while (FlashMemoryOffset % FLASH_SECTOR_SIZE)
+      ++FlashMemoryOffset;
+
+    sprintf(String, "Offset has been shifted to 0x%8.8X\r", FlashMemoryOffset);
+    uart_send(__LINE__, String);
+  }
+
+
+  /* A sector with protected content (see FlashExclusion[]) is converted to a flash_write() with all 0xFF.
+     flash_write() will take care of keeping protected content unchanged. */
+  if (flash_excluded(FlashMemoryOffset, FLASH_SECTOR_SIZE, EXCLUDE_PRESERVE) != NULL)
+  {
+    /* Set all bytes to be written to flash equal to 0xFF. */
+    memset(FlashNewData, 0xFF, FLASH_SECTOR_SIZE);
+    
+    /* Write this sector to flash. (NOTE: flash_write() will take care of keeping protected content unchanged). */
+    flash_write(FlashMemoryOffset, FlashNewData, FLASH_SECTOR_SIZE);
+  }
+  else
+  {
+    /* Pause core 1 and keep track of interrupt mask on entry. */
+    InterruptMask = flash_enter_critical();
+
+    /* Erase flash area. */
+    StartTime = time_us_32();
+    flash_range_erase(FlashMemoryOffset, FLASH_SECTOR_SIZE);
+    EndTime   = time_us_32();
+
+    /* Restore original interrupt mask and resume core 1 when done. */
+    flash_exit_critical(InterruptMask);
+    erase_count_add(FlashMemoryOffset, FLASH_SECTOR_SIZE);
+
+    #ifdef SECTOR_LATENCY
+    latency_record(LATENCY_ERASE, FlashMemoryOffset, EndTime - StartTime);
+    #endif
+  }
+
+  return;
+}
+
+
+
+
+/* $PAGE */
+/* $TITLE=flash_erase_block32() */
+/* ------------------------------------------------------------------ *\
+      Erase a 32 KB flash block with the 32 KB block erase command
+                          of the flash IC.
+     NOTES:
+     - flash_range_erase() only sends the 4 KB sector erase and the
+       64 KB block erase commands, so a 32 KB range is erased by the
+       SDK as eight 4 KB sectors. This sends the 32 KB block erase
+       command (0x52) itself and waits until the flash IC is done.
+     - Offset must be aligned on a 32 KB boundary.
+     - Must be called between flash_enter_critical() and
+       flash_exit_critical(): flash can't be read during the erase.
+       flash_do_cmd() flushes the XIP cache after each command.
+\* ------------------------------------------------------------------ */
+void flash_erase_block32(UINT32 Offset)
+{
+  UINT8 RxBuffer[4];
+  UINT8 TxBuffer[4];
+
+
+  TxBuffer[0] = FLASH_CMD_WRITE_EN;
+  flash_do_cmd(TxBuffer, RxBuffer, 1);
+
+  TxBuffer[0] = FLASH_CMD_ERASE_32;
+  TxBuffer[1] = (Offset >> 16) & 0xFF;
+  TxBuffer[2] = (Offset >> 8)  & 0xFF;
+  TxBuffer[3] = Offset         & 0xFF;
+  flash_do_cmd(TxBuffer, RxBuffer, 4);
+
+  /* Wait until the erase is completed. */
+  TxBuffer[0] = FLASH_CMD_STATUS;
+  TxBuffer[1] = 0x00;
+  do
+  {
+    flash_do_cmd(TxBuffer, RxBuffer, 2);
+  } while (RxBuffer[1] & 0x01);
+
+  return;
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=flash_erase_range() */
+/* ------------------------------------------------------------------ *\
+     Erase a range of Pico's flash memory using the largest erase
+                      commands possible.
+     NOTES:
+     - StartOffset and Length must be multiples of a sector (4096).
+     - Every 64 KB block that is aligned, fully inside the range and
+       does not contain any protected region (see FlashExclusion[]) is
+       erased with a single block erase command. Remaining parts of
+       the range are erased one sector (4096 bytes) at a time.
+     - Sectors of EXCLUDE_SKIP regions are not erased. Sectors of
+       EXCLUDE_PRESERVE regions are handed to flash_erase() which will
+       take care of keeping their protected content unchanged.
+     - Interrupts are disabled only for the duration of each erase
+       command so that USB CDC communication is serviced in-between.
+\* ------------------------------------------------------------------ */
+UINT flash_erase_range(UINT32 StartOffset, UINT32 Length)
+{
+  UCHAR String[256];
+
+  UINT32 EndOffset;
+  UINT32 EndTime;
+  UINT32 EraseSize;
+  UINT32 InterruptMask;
+  UINT32 Offset;
+  UINT32 StartTime;
+
+
+  if ((StartOffset % FLASH_SECTOR_SIZE) || (Length % FLASH_SECTOR_SIZE))
+  {
+    sprintf(String, "Range specified for flash_erase_range(0x%8.8X, 0x%8.8X) is not aligned on a sector boundary (multiple of 4096)\r", StartOffset, Length);
+    uart_send(__LINE__, String);
+
+    return 1;
+  }
+
+
+  EndOffset = StartOffset + Length;
+  for (Offset = StartOffset; Offset < EndOffset; Offset += EraseSize)
+  {
+    if (console_poll(Offset) == FLAG_ON) break;
+
+    /* Protected regions that must not be touched are skipped. */
+    if (flash_excluded(Offset, FLASH_SECTOR_SIZE, EXCLUDE_SKIP) != NULL)
+    {
+      EraseSize = FLASH_SECTOR_SIZE;
+      continue;
+    }
+
+    /* Select the largest erase command that fits at this offset (block erase only if flash IC supports it). */
+    if ((FlashChip.EraseSize == FLASH_BLOCK_SIZE) && ((Offset % FLASH_BLOCK_SIZE) == 0) && ((Offset + FLASH_BLOCK_SIZE) <= EndOffset) && (flash_excluded(Offset, FLASH_BLOCK_SIZE, 0) == NULL))
+      EraseSize = FLASH_BLOCK_SIZE;
+    else
+      EraseSize = FLASH_SECTOR_SIZE;
+
+    /* Display one line for every 512 KB erased. */
+    if ((EraseSize == FLASH_BLOCK_SIZE) || ((Offset % FLASH_BLOCK_SIZE) == 0)) printf("0x%8.8X   ", Offset);
+    if (((Offset + EraseSize) % 0x80000) == 0) printf("\r");
+
+    if (flash_excluded(Offset, FLASH_SECTOR_SIZE, EXCLUDE_PRESERVE) != NULL)
+    {
+      /* flash_erase() will take care of keeping protected content unchanged. */
+      flash_erase(Offset);
+    }
+    else
+    {
+      /* Pause core 1 and keep track of interrupt mask on entry. */
+      InterruptMask = flash_enter_critical();
+
+      /* Erase flash area. The flash IC uses a block erase command for an aligned 64 KB block. */
+      StartTime = time_us_32();
+      flash_range_erase(Offset, EraseSize);
+      EndTime   = time_us_32();
+
+      /* Restore original interrupt mask and resume core 1 when done. */
+      flash_exit_critical(InterruptMask);
+      erase_count_add(Offset, EraseSize);
+
+      #ifdef SECTOR_LATENCY
+      latency_record(((EraseSize == FLASH_BLOCK_SIZE) ? LATENCY_BLOCK_ERASE : LATENCY_ERASE), Offset, EndTime - StartTime);
+      #endif
+    }
+
+    /* Let core 1 check this region while core 0 goes on. */
+    if (FlagPipeline == FLAG_ON) pipeline_post(JOB_BLANK_CHECK, Offset, EraseSize, 0, 0, NULL);
+  }
+
+  return 0;
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=flash_excluded() */
+/* ------------------------------------------------------------------ *\
+     Find the first protected flash region (see FlashExclusion[])
+                     overlapping a flash range.
+     NOTES:
+     - When Policy is 0, regions of any policy are considered.
+     - Returns NULL if the range doesn't overlap any protected region.
+\* ------------------------------------------------------------------ */
+struct flash_exclusion *flash_excluded(UINT32 Offset, UINT32 Length, UINT8 Policy)
+{
+  UINT8 Loop1UInt8;
+
+
+  for (Loop1UInt8 = 0; Loop1UInt8 < EXCLUSION_COUNT; ++Loop1UInt8)
+  {
+    if ((Policy != 0) && (FlashExclusion[Loop1UInt8].Policy != Policy)) continue;
+
+    if ((Offset < (FlashExclusion[Loop1UInt8].Offset + FlashExclusion[Loop1UInt8].Length)) && ((Offset + Length) > FlashExclusion[Loop1UInt8].Offset))
+      return &FlashExclusion[Loop1UInt8];
+  }
+
+  return NULL;
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=flash_exit_critical() */
+/* ------------------------------------------------------------------ *\
+       Restore interrupts and resume core 1 after a flash erase or
+                          program operation.
+\* ------------------------------------------------------------------ */
+void flash_exit_critical(UINT32 InterruptMask)
+{
+  restore_interrupts(InterruptMask);
+
+  if (Core1Ready == FLAG_ON) multicore_lockout_end_blocking();
+
+  return;
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=flash_hash_range() */
+/* ------------------------------------------------------------------ *\
+       Compute the CRC32 of each sector of a flash range, in one
+                     pass, into SectorHash[].
+     NOTES:
+     - StartOffset and Length must be aligned on a sector boundary.
+       SectorHash[0] is the hash of the sector at StartOffset.
+     - At most HASH_CHUNK_SECTORS sectors are hashed, so that
+       SectorHash[] doesn't have to hold the whole flash IC: caller
+       hashes a larger range one chunk at a time.
+     - Standard CRC-32 (see crc32_update()) is used rather than the
+       DMA sniffer, so that host can compute the same hash of its
+       image file with any zlib-compatible library.
+     - Returns the number of sectors hashed, which is smaller than
+       requested if range is larger than a chunk, or if user aborts
+       (see console_poll()).
+\* ------------------------------------------------------------------ */
+UINT32 flash_hash_range(UINT32 StartOffset, UINT32 Length)
+{
+  UINT32 Crc;
+  UINT32 Loop1UInt32;
+  UINT32 Offset;
+  UINT32 Row[4];
+  UINT32 Sector;
+
+
+  for (Sector = 0; (Sector < (Length / FLASH_SECTOR_SIZE)) && (Sector < HASH_CHUNK_SECTORS); ++Sector)
+  {
+    Offset = StartOffset + (Sector * FLASH_SECTOR_SIZE);
+    if (console_poll(Offset) == FLAG_ON) break;
+
+    /* The uncached alias is read by 32 bits words into a RAM row, the CRC is then updated byte by byte from RAM. */
+    Crc = 0;
+    for (Loop1UInt32 = 0; Loop1UInt32 < FLASH_SECTOR_SIZE; Loop1UInt32 += 16)
+    {
+      Row[0] = *(UINT32 *)&FlashReadAddress[Offset + Loop1UInt32];
+      Row[1] = *(UINT32 *)&FlashReadAddress[Offset + Loop1UInt32 + 4];
+      Row[2] = *(UINT32 *)&FlashReadAddress[Offset + Loop1UInt32 + 8];
+      Row[3] = *(UINT32 *)&FlashReadAddress[Offset + Loop1UInt32 + 12];
+      Crc = crc32_update(Crc, (UINT8 *)Row, 16);
+    }
+    SectorHash[Sector] = Crc;
+  }
+
+  return Sector;
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=flash_preserve() */
+/* ------------------------------------------------------------------ *\
+     Copy the current flash content of EXCLUDE_PRESERVE regions into
+    a sector buffer, so that programming the buffer leaves them as is.
+\* ------------------------------------------------------------------ */
+void flash_preserve(UINT32 SectorOffset, UINT8 *Buffer)
+{
+  UINT8 Loop1UInt8;
+
+  UINT32 EndOffset;
+  UINT32 StartOffset;
+
+
+  for (Loop1UInt8 = 0; Loop1UInt8 < EXCLUSION_COUNT; ++Loop1UInt8)
+  {
+    if (FlashExclusion[Loop1UInt8].Policy != EXCLUDE_PRESERVE) continue;
+
+    /* Part of the protected region that lies in this sector. */
+    StartOffset = ((FlashExclusion[Loop1UInt8].Offset > SectorOffset) ? FlashExclusion[Loop1UInt8].Offset : SectorOffset);
+    EndOffset   = FlashExclusion[Loop1UInt8].Offset + FlashExclusion[Loop1UInt8].Length;
+    if (EndOffset > (SectorOffset + FLASH_SECTOR_SIZE)) EndOffset = SectorOffset + FLASH_SECTOR_SIZE;
+
+    if (StartOffset < EndOffset)
+      memcpy(&Buffer[StartOffset - SectorOffset], &FlashBaseAddress[StartOffset], EndOffset - StartOffset);
+  }
+
+  return;
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=flash_probe() */
+/* ------------------------------------------------------------------ *\
+     Read flash IC JEDEC ID and SFDP table to find its size, erase
+                          and page sizes.
+     NOTES:
+     - Values found are kept in FlashChip. If the IC has no valid
+       SFDP table, the capacity code of the JEDEC ID (2^n bytes) is
+       used and the SDK defaults are kept for everything else.
+     - The SDK erases with either the 4 KB sector erase command or
+       the 64 KB block erase command (FLASH_BLOCK_ERASE_CMD), so block
+       erase is used only if the IC advertises it with this opcode.
+     - Size is limited to FLASH_SIZE_MAX, the XIP window of RP2040.
+     - Metadata region and test plans ending with PLAN_END_OF_FLASH are
+       resolved here, so that test plans stop before the metadata region.
+\* ------------------------------------------------------------------ */
+void flash_probe(void)
+{
+  UINT8 Loop1UInt8;
+  UINT8 RxBuffer[4];
+  UINT8 TxBuffer[4];
+
+  UINT32 Density;
+  UINT32 Parameter[11];
+  UINT32 ParameterHeader[2];
+  UINT32 SfdpHeader[2];
+  UINT32 InterruptMask;
+
+
+  /* Read JEDEC ID: manufacturer, memory type and capacity code. */
+  memset(TxBuffer, 0x00, sizeof(TxBuffer));
+  TxBuffer[0] = FLASH_CMD_JEDEC_ID;
+  InterruptMask = flash_enter_critical();
+  flash_do_cmd(TxBuffer, RxBuffer, sizeof(TxBuffer));
+  flash_exit_critical(InterruptMask);
+  memcpy(FlashChip.JedecId, &RxBuffer[1], 3);
+
+  if ((FlashChip.JedecId[2] >= 16) && (FlashChip.JedecId[2] <= 24))
+    FlashChip.Size = (1ul << FlashChip.JedecId[2]);
+
+
+  /* SFDP header is followed by the header of the JEDEC basic flash parameter table. */
+  flash_sfdp_read(0x000000, (UINT8 *)SfdpHeader, sizeof(SfdpHeader));
+  flash_sfdp_read(0x000008, (UINT8 *)ParameterHeader, sizeof(ParameterHeader));
+  if ((SfdpHeader[0] == SFDP_SIGNATURE) && ((ParameterHeader[0] & 0xFF) == 0x00))
+  {
+    FlashChip.FlagSfdp = FLAG_ON;
+    memset(Parameter, 0x00, sizeof(Parameter));
+    flash_sfdp_read((ParameterHeader[1] & 0x00FFFFFF), (UINT8 *)Parameter, ((((ParameterHeader[0] >> 24) * 4) < sizeof(Parameter)) ? ((ParameterHeader[0] >> 24) * 4) : sizeof(Parameter)));
+
+    /* DWORD 2: density in bits (value + 1), or 2^value bits when bit 31 is set. */
+    Density = Parameter[1];
+    if (Density & 0x80000000)
+      FlashChip.Size = (((Density & 0x7FFFFFFF) >= 35) ? FLASH_SIZE_MAX : (UINT32)((1ull << (Density & 0x7FFFFFFF)) / 8));
+    else
+      FlashChip.Size = (Density / 8) + 1;
+
+    /* DWORDS 8 and 9: up to four erase types, each one with a size of 2^n bytes and an opcode. */
+    FlashChip.EraseSize    = FLASH_SECTOR_SIZE;
+    FlashChip.EraseCommand = 0x20;
+    for (Loop1UInt8 = 0; Loop1UInt8 < 4; ++Loop1UInt8)
+    {
+      if ((((Parameter[7 + (Loop1UInt8 / 2)] >> ((Loop1UInt8 % 2) * 16)) & 0xFF) == 16) && (((Parameter[7 + (Loop1UInt8 / 2)] >> (((Loop1UInt8 % 2) * 16) + 8)) & 0xFF) == FLASH_BLOCK_ERASE_CMD))
+      {
+        FlashChip.EraseSize    = FLASH_BLOCK_SIZE;
+        FlashChip.EraseCommand = FLASH_BLOCK_ERASE_CMD;
+      }
+    }
+
+    /* DWORD 11 (JESD216A and later): page size is 2^n bytes. */
+    if ((ParameterHeader[0] >> 24) >= 11) FlashChip.PageSize = (1 << ((Parameter[10] >> 4) & 0x0F));
+  }
+
+  if (FlashChip.Size > FLASH_SIZE_MAX) FlashChip.Size = FLASH_SIZE_MAX;
+  FlashChip.Size -= (FlashChip.Size % FLASH_SECTOR_SIZE);
+
+
+  /* Metadata region is at the end of the flash IC, and full flash test plans end just before it. */
+  FlashExclusion[EXCLUSION_METADATA].Offset = METADATA_OFFSET;
+  FlashExclusion[EXCLUSION_METADATA].Length = METADATA_SECTORS * FLASH_SECTOR_SIZE;
+  for (Loop1UInt8 = 0; Loop1UInt8 < TEST_PLAN_PROFILES; ++Loop1UInt8)
+    if (TestPlanProfile[Loop1UInt8].EndOffset == PLAN_END_OF_FLASH) TestPlanProfile[Loop1UInt8].EndOffset = (METADATA_OFFSET - 1);
+
+  return;
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=flash_program() */
+/* ------------------------------------------------------------------ *\
+      Program data of any length into an erased flash area, one
+                      256-byte page at a time.
+     NOTES:
+     - Unlike flash_write(), nothing is erased nor read back first:
+       the area must already be erased (or only have bits that go
+       from 1 to 0). This is meant for small records appended to a
+       log or patched in place, without the cost of a sector erase.
+     - Offset and Length don't need to be aligned nor to stay in one
+       sector. Partial pages at both ends are padded with 0xFF, which
+       leaves the bytes around the data unchanged.
+     - All pages are programmed in a single critical section, so
+       Length should be kept small (each page takes up to 3 msec).
+       When PROGRAM_MAX_PAGES is defined, the critical section is left
+       and entered again after that many pages.
+     - Data must be in RAM: flash can't be read while programming.
+     - EXCLUDE_PRESERVE regions (see FlashExclusion[]) are never
+       overwritten. The metadata region may be written (this is how
+       the record store appends its records).
+     - Returns 0 if data read back matches, 1 otherwise.
+\* ------------------------------------------------------------------ */
+UINT flash_program(UINT32 Offset, UINT8 *Data, UINT32 Length)
+{
+  static UINT8 PageBuffer[FLASH_PAGE_SIZE];
+
+  UCHAR String[256];
+
+  UINT32 Chunk;
+  UINT32 Done;
+  UINT32 InterruptMask;
+  UINT32 PageOffset;
+  UINT32 Skip;
+
+
+  if ((Length == 0) || (Offset >= FlashChip.Size) || (Length > (FlashChip.Size - Offset)))
+  {
+    sprintf(String, "Range specified for flash_program(0x%8.8X, 0x%8.8X) is outside of flash memory\r", Offset, Length);
+    uart_send(__LINE__, String);
+
+    return 1;
+  }
+
+  if (flash_excluded(Offset, Length, EXCLUDE_PRESERVE) != NULL)
+  {
+    sprintf(String, "Range specified for flash_program(0x%8.8X, 0x%8.8X) would overwrite <%s>\r", Offset, Length, flash_excluded(Offset, Length, EXCLUDE_PRESERVE)->Name);
+    uart_send(__LINE__, String);
+
+    return 1;
+  }
+
+
+  /* Pause core 1 and disable interrupts once for the whole write. */
+  InterruptMask = flash_enter_critical();
+
+  for (Done = 0; Done < Length; Done += Chunk)
+  {
+    PageOffset = (Offset + Done) - ((Offset + Done) % FLASH_PAGE_SIZE);
+    Skip       = (Offset + Done) - PageOffset;
+    Chunk      = FLASH_PAGE_SIZE - Skip;
+    if (Chunk > (Length - Done)) Chunk = Length - Done;
+
+    if (Chunk == FLASH_PAGE_SIZE)
+    {
+      /* Program all the whole pages that follow with a single call. */
+      Chunk = (Length - Done) - ((Length - Done) % FLASH_PAGE_SIZE);
+      #ifdef PROGRAM_MAX_PAGES
+      if (Chunk > (PROGRAM_MAX_PAGES * FLASH_PAGE_SIZE)) Chunk = (PROGRAM_MAX_PAGES * FLASH_PAGE_SIZE);
+      #endif
+      flash_range_program(PageOffset, &Data[Done], Chunk);
+    }
+    else
+    {
+      /* Partial page: bytes programmed as 0xFF are left unchanged. */
+      memset(PageBuffer, 0xFF, FLASH_PAGE_SIZE);
+      memcpy(&PageBuffer[Skip], &Data[Done], Chunk);
+      flash_range_program(PageOffset, PageBuffer, FLASH_PAGE_SIZE);
+    }
+
+    #ifdef PROGRAM_MAX_PAGES
+    /* Let interrupts and core 1 run between two runs of pages. */
+    if ((Done + Chunk) < Length)
+    {
+      flash_exit_critical(InterruptMask);
+      InterruptMask = flash_enter_critical();
+    }
+    #endif
+  }
+
+  /* Restore original interrupt mask and resume core 1 when done. */
+  flash_exit_critical(InterruptMask);
+
+
+  /* Data read back differs if the area was not erased. */
+  if (memcmp(&FlashBaseAddress[Offset], Data, Length) != 0)
+  {
+    sprintf(String, "Data read back after flash_program(0x%8.8X, 0x%8.8X) doesn't match, was the area erased?\r", Offset, Length);
+    uart_send(__LINE__, String);
+
+    return 1;
+  }
+
+  return 0;
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=flash_sfdp_read() */
+/* ------------------------------------------------------------------ *\
+              Read bytes from the flash IC SFDP table.
+     NOTE: The SFDP read command is followed by a 24-bit address and
+           one dummy byte. Length must not exceed 64 bytes.
+\* ------------------------------------------------------------------ */
+void flash_sfdp_read(UINT32 Address, UINT8 *Buffer, UINT16 Length)
+{
+  UINT8 RxBuffer[5 + 64];
+  UINT8 TxBuffer[5 + 64];
+
+  UINT32 InterruptMask;
+
+
+  memset(TxBuffer, 0x00, sizeof(TxBuffer));
+  TxBuffer[0] = FLASH_CMD_SFDP;
+  TxBuffer[1] = (Address >> 16) & 0xFF;
+  TxBuffer[2] = (Address >> 8)  & 0xFF;
+  TxBuffer[3] = Address         & 0xFF;
+
+  InterruptMask = flash_enter_critical();
+  flash_do_cmd(TxBuffer, RxBuffer, (5 + Length));
+  flash_exit_critical(InterruptMask);
+
+  memcpy(Buffer, &RxBuffer[5], Length);
+
+  return;
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=flash_span_next() */
+/* ------------------------------------------------------------------ *\
+     Find the next span of a flash range that doesn't overlap any
+               protected region (see FlashExclusion[]).
+     NOTES:
+     - Span returned starts at or after Offset and ends before
+       EndOffset (exclusive). Its end is returned in SpanEnd.
+     - When there is no span left, EndOffset is returned.
+     - Called once per span by the blank check and verification
+       loops, so that their inner loops compare flash content without
+       looking for protected bytes.
+\* ------------------------------------------------------------------ */
+UINT32 __not_in_flash_func(flash_span_next)(UINT32 Offset, UINT32 EndOffset, UINT32 *SpanEnd)
+{
+  UINT8 FlagMoved;
+  UINT8 Loop1UInt8;
+
+
+  /* Skip protected regions that Offset falls into (they may be contiguous). */
+  do
+  {
+    FlagMoved = FLAG_OFF;
+    for (Loop1UInt8 = 0; Loop1UInt8 < EXCLUSION_COUNT; ++Loop1UInt8)
+    {
+      if ((Offset >= FlashExclusion[Loop1UInt8].Offset) && (Offset < (FlashExclusion[Loop1UInt8].Offset + FlashExclusion[Loop1UInt8].Length)))
+      {
+        Offset    = FlashExclusion[Loop1UInt8].Offset + FlashExclusion[Loop1UInt8].Length;
+        FlagMoved = FLAG_ON;
+      }
+    }
+  } while (FlagMoved == FLAG_ON);
+
+  if (Offset >= EndOffset)
+  {
+    *SpanEnd = EndOffset;
+    return EndOffset;
+  }
+
+  /* Span ends at the first protected region that follows. */
+  *SpanEnd = EndOffset;
+  for (Loop1UInt8 = 0; Loop1UInt8 < EXCLUSION_COUNT; ++Loop1UInt8)
+  {
+    if ((FlashExclusion[Loop1UInt8].Length != 0) && (FlashExclusion[Loop1UInt8].Offset > Offset) && (FlashExclusion[Loop1UInt8].Offset < *SpanEnd))
+      *SpanEnd = FlashExclusion[Loop1UInt8].Offset;
+  }
+
+  return Offset;
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=flash_test() */
+/* ------------------------------------------------------------------ *\
+                 Perform a test of all flash memory.
+     NOTE: The test plan is selected by user, then executed unattended
+           by flash_test_run().
+\* ------------------------------------------------------------------ */
+void flash_test(void)
+{
+  UCHAR String[256];
+
+  UINT64 TotalErrors;
+
+  struct test_checkpoint Checkpoint;
+  struct test_plan Plan;
+
+
+  /* ----------------------------------------------------- *\
+          Offer to resume an interrupted flash test.
+  \* ----------------------------------------------------- */
+  printf("=======================================================================================================\r");
+  if (checkpoint_find(&Checkpoint) == FLAG_ON)
+  {
+    sprintf(String, "Flash test <%s> has been interrupted at cycle %u, pattern <%s>, phase <%s> (%llu errors found so far).\r", Checkpoint.Plan.Name, Checkpoint.Cycle + 1,
+            PatternName[Checkpoint.Plan.Pattern[Checkpoint.PatternIndex]], PhaseName[Checkpoint.Phase], Checkpoint.TotalErrors);
+    uart_send(__LINE__, String);
+    uart_send(__LINE__, "Resume this flash test <Y/N>: ");
+    input_string(String);
+    printf("\r");
+    if ((strcmp(String, "Y") == 0) || (strcmp(String, "y") == 0))
+    {
+      FlagPipeline = Checkpoint.FlagPipeline;
+      flash_test_run(&Checkpoint.Plan, &Checkpoint, &TotalErrors);
+
+      return;
+    }
+
+    /* User doesn't want to resume, forget about it. */
+    checkpoint_clear();
+  }
+
+
+
+  /* ----------------------------------------------------- *\
+                  Select the test plan to run.
+  \* ----------------------------------------------------- */
+  if (input_test_plan(&Plan) == FLAG_OFF)
+    return;
+
+
+
+  printf("                    Flash snapshot after each pattern: <N>one, <M>ismatching rows only or <F>ull dump <N/M/F> (default M): ");
+  input_string(String);
+  printf("\r\r");
+  if ((strcmp(String, "N") == 0) || (strcmp(String, "n") == 0)) Plan.Snapshot = SNAPSHOT_NONE;
+  if ((strcmp(String, "F") == 0) || (strcmp(String, "f") == 0)) Plan.Snapshot = SNAPSHOT_FULL;
+
+
+
+  /* ----------------------------------------------------- *\
+                Present instructions to user.
+  \* ----------------------------------------------------- */
+  flash_test_describe(&Plan);
+
+  uart_send(__LINE__, "Are you sure you want to proceed <Y/N>: ");
+  input_string(String);
+  if ((strcmp(String, "Y") != 0) && (strcmp(String, "y") != 0))
+    return;
+
+  printf("\r");
+  uart_send(__LINE__, "Use dual-core pipeline (core 1 checks flash while core 0 erases, writes and logs) <Y/N>: ");
+  input_string(String);
+  FlagPipeline = (((strcmp(String, "Y") == 0) || (strcmp(String, "y") == 0)) ? FLAG_ON : FLAG_OFF);
+
+  /* Flash test results are kept in the record store, which is only created with user's consent. */
+  if (FlagKvReady == FLAG_OFF)
+  {
+    printf("\r");
+    uart_send(__LINE__, "There is no record store to keep flash test results. Create it <Y/N>: ");
+    input_string(String);
+    if (((strcmp(String, "Y") == 0) || (strcmp(String, "y") == 0)) && (kv_create(FLAG_OFF) == 2))
+    {
+      printf("\r");
+      sprintf(String, "Record store area (offset 0x%8.8X to 0x%8.8X) is not blank. Erase it (its content will be lost) <Y/N>: ", KV_OFFSET, (KV_OFFSET + (KV_SECTORS * FLASH_SECTOR_SIZE) - 1));
+      uart_send(__LINE__, String);
+      input_string(String);
+      if ((strcmp(String, "Y") == 0) || (strcmp(String, "y") == 0)) kv_create(FLAG_ON);
+    }
+  }
+
+  flash_test_run(&Plan, NULL, &TotalErrors);
+
+  return;
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=flash_test_describe() */
+/* ------------------------------------------------------------------ *\
+        Display the steps that will be executed for a test plan.
+\* ------------------------------------------------------------------ */
+void flash_test_describe(struct test_plan *Plan)
+{
+  UCHAR String[256];
+
+  UINT8 Loop1UInt8;
+  UINT8 Step;
+
+
+  sprintf(String, "Test plan <%s>: %u write cycle(s) from offset 0x%8.8X to offset 0x%8.8X\r", Plan->Name, Plan->Cycles, Plan->StartOffset, Plan->EndOffset);
+  uart_send(__LINE__, String);
+  uart_send(__LINE__, "For each cycle, the following actions will be executed:\r\r");
+
+  Step = 1;
+  for (Loop1UInt8 = 0; Loop1UInt8 < Plan->PatternCount; ++Loop1UInt8)
+  {
+    sprintf(String, "%2u) Flash memory will be erased.\r", Step++);
+    uart_send(__LINE__, String);
+    sprintf(String, "%2u) A blank check will be done.\r", Step++);
+    uart_send(__LINE__, String);
+    sprintf(String, "%2u) Pattern <%s> will be written to flash memory.\r", Step++, PatternName[Plan->Pattern[Loop1UInt8]]);
+    uart_send(__LINE__, String);
+    if (Plan->Snapshot == SNAPSHOT_FULL)
+    {
+      sprintf(String, "%2u) Flash memory range will be displayed to log file.\r", Step++);
+      uart_send(__LINE__, String);
+    }
+    if (Plan->Snapshot == SNAPSHOT_MISMATCH)
+    {
+      sprintf(String, "%2u) Flash memory rows not matching pattern will be displayed to log file.\r", Step++);
+      uart_send(__LINE__, String);
+    }
+    sprintf(String, "%2u) Flash will be read back to check if memory content matches pattern <%s>.\r\r", Step++, PatternName[Plan->Pattern[Loop1UInt8]]);
+    uart_send(__LINE__, String);
+  }
+
+  uart_send(__LINE__, "If any error is detected during the process, it will be reported.\r");
+  uart_send(__LINE__, "Also, data will be saved to log file at each step of the process.\r\r");
+  uart_send(__LINE__, "NOTE: Write to Pico's flash memory is limited to more or less 100,000 cycles.\r");
+  uart_send(__LINE__, "      Moreover, no wear leveling algorithm has been implemented in the Pico.\r");
+  uart_send(__LINE__, "      You may use this utility as required, but you should not modify it and\r");
+  uart_send(__LINE__, "      use it as a <burn-in> test and let it run for hours...\r\r");
+
+  if (flash_excluded(Plan->StartOffset, (Plan->EndOffset - Plan->StartOffset + 1), 0) != NULL)
+  {
+    uart_send(__LINE__, "Protected regions in this range (Pico's manufacturing test results) will be kept unchanged\r");
+    uart_send(__LINE__, "and are never reported as errors.\r\r");
+  }
+
+  return;
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=flash_test_run() */
+/* ------------------------------------------------------------------ *\
+           Run a flash memory test plan (unattended).
+     NOTES:
+     - For each write cycle and each pattern of the plan, the range is
+       erased, blank checked, written, displayed to the log (identical
+       lines summarized) and verified.
+     - Patterns are generated one sector at a time while writing and
+       regenerated while verifying (see pattern_next()).
+     - A checkpoint is saved to flash after each phase (see
+       checkpoint_save()). When Resume is not NULL, the test restarts
+       with the phase following the last checkpoint saved.
+     - When user aborts the test (see console_poll()), the phase in
+       progress stops at the next sector and the final report is
+       displayed right away.
+     - A summary of the test is kept in the record store, both as the
+       last test result and in the test history (see
+       display_test_history()).
+     - The total number of errors found is returned in Errors.
+       Returns FLAG_OFF if the test could not be run at all (firmware
+       run from flash), so that it is not mistaken for a test without
+       errors. Returns FLAG_ON otherwise.
+\* ------------------------------------------------------------------ */
+UINT8 flash_test_run(struct test_plan *Plan, struct test_checkpoint *Resume, UINT64 *Errors)
+{
+  UCHAR String[256];
+
+  UINT8 FirstCycle;
+  UINT8 FirstPattern;
+  UINT8 Loop1UInt8;
+  UINT8 Phase;
+
+  UINT32 Length;
+  UINT32 Step;
+
+  UINT16 ResultLength;
+
+  UINT64 TestStartTime;
+  UINT64 TotalErrors;
+
+  struct test_result Result;
+
+
+  if (((void *)main < (void *)0x20000000) || ((void *)main > (void *)0x20041FFF))
+  {
+    sprintf(String, "<<<<< FATAL >>>>> YOU CAN'T TEST FLASH MEMORY WHILE YOU RUN THE APPLICATION FROM FLASH.\r\r\r");
+    uart_send(__LINE__, String);
+    FlagPipeline = FLAG_OFF;  // set by caller for this test only.
+    *Errors      = 0;
+
+    return FLAG_OFF;
+  }
+
+
+
+  /* ----------------------------------------------------- *\
+                        Initializations.
+  \* ----------------------------------------------------- */
+  TotalErrors     = 0;
+  TestStartTime   = time_us_64();
+  FlagSectorFlags = FLAG_OFF;
+  FirstCycle      = 0;
+  FirstPattern    = 0;
+  Phase           = PHASE_ERASE;
+  Length          = Plan->EndOffset - Plan->StartOffset + 1;
+
+  if (Resume != NULL)
+  {
+    /* Resume an interrupted test where its last checkpoint was saved. */
+    TotalErrors    = Resume->TotalErrors;
+    FirstCycle     = Resume->Cycle;
+    FirstPattern   = Resume->PatternIndex;
+    Phase          = Resume->Phase;
+
+    /* Core 1 results of the interrupted phase are lost, so go back to the phase that feeds the pipeline. */
+    if (FlagPipeline == FLAG_ON)
+    {
+      if (Phase == PHASE_BLANK_CHECK) Phase = PHASE_ERASE;
+      if (Phase >  PHASE_WRITE)       Phase = PHASE_WRITE;
+    }
+
+    sprintf(String, "Resuming flash test <%s> at cycle %u, pattern <%s>, phase <%s>, with %llu errors found so far.\r\r", Plan->Name, FirstCycle + 1,
+            PatternName[Plan->Pattern[FirstPattern]], PhaseName[Phase], TotalErrors);
+    uart_send(__LINE__, String);
+  }
+  profile_reset();
+  #ifdef SECTOR_LATENCY
+  latency_reset();
+  #endif
+
+  /* One step for each phase of each pattern of each cycle. */
+  status_begin(MODE_FLASH_TEST, Plan->StartOffset, Length, (Plan->Cycles * Plan->PatternCount * PHASE_COUNT));
+  status_errors(TotalErrors);
+
+
+
+  /* ----------------------------------------------------- *\
+                Loop for the number of cycles.
+  \* ----------------------------------------------------- */
+  for (WriteCycle = FirstCycle; WriteCycle < Plan->Cycles; ++WriteCycle)
+  {
+    printf("\r\r\r\r\r= = = = = = = = = = = = = = = = = = = = = = = = CYCLE %u = = = = = = = = = = = = = = = = = = = = = = = =\r", WriteCycle + 1);
+    /* For each cycle, write every pattern of the test plan. */
+    for (Loop1UInt8 = ((WriteCycle == FirstCycle) ? FirstPattern : 0); Loop1UInt8 < Plan->PatternCount; ++Loop1UInt8)
+    {
+      Step = ((WriteCycle * Plan->PatternCount) + Loop1UInt8) * PHASE_COUNT;  // first step of this pattern.
+
+      /* ----------------------------------------------------- *\
+                      Erase flash memory range.
+      \* ----------------------------------------------------- */
+      if (Phase <= PHASE_ERASE)
+      {
+        printf("=======================================================================================================\r");
+        sprintf(String, "Erase flash memory from offset 0x%8.8X to offset 0x%8.8X.\r\r", Plan->StartOffset, Plan->EndOffset);
+        uart_send(__LINE__, String);
+
+        printf("Erasing blocks...\r");
+        status_phase(PHASE_ERASE, WriteCycle, (Step + PHASE_ERASE));
+        profile_start(PHASE_ERASE);
+        flash_erase_range(Plan->StartOffset, Length);
+        profile_end(PHASE_ERASE, Length);
+
+        printf("\r");
+        uart_send(__LINE__, "End erasing flash memory.\r");
+        printf("=======================================================================================================\r\r\r");
+        checkpoint_save(Plan, WriteCycle, Loop1UInt8, PHASE_BLANK_CHECK, TotalErrors);
+      }
+
+      if (Phase <= PHASE_BLANK_CHECK)
+      {
+        status_phase(PHASE_BLANK_CHECK, WriteCycle, (Step + PHASE_BLANK_CHECK));
+        profile_start(PHASE_BLANK_CHECK);
+        TotalErrors += flash_blank_check_range(Plan->StartOffset, Length);
+        profile_end(PHASE_BLANK_CHECK, Length);
+        status_errors(TotalErrors);
+        checkpoint_save(Plan, WriteCycle, Loop1UInt8, PHASE_WRITE, TotalErrors);
+      }
+
+      /* ----------------------------------------------------- *\
+                      Write data to flash memory.
+      \* ----------------------------------------------------- */
+      if (Phase <= PHASE_WRITE)
+      {
+        printf("========================================================================================================\r");
+        sprintf(String, "Writing pattern <%s> to flash memory.\r", PatternName[Plan->Pattern[Loop1UInt8]]);
+        uart_send(__LINE__, String);
+        uart_send(__LINE__, "Please wait...\r");
+
+        /*** Display data to be written to flash. ***
+        printf("Data to be written to flash:\r");
+        display_memory(RAM_BASE_ADDRESS, (UINT32)(FlashNewData - (UINT8 *)0x20000000), FLASH_SECTOR_SIZE, DUMP_TEXT);
+        ***/
+
+
+        /* Overwrite all flash sectors with new data. Flash memory has just been erased, so no read-modify-write is required. */
+        status_phase(PHASE_WRITE, WriteCycle, (Step + PHASE_WRITE));
+        profile_start(PHASE_WRITE);
+        flash_write_pattern(Plan->StartOffset, Length, Plan->Pattern[Loop1UInt8], WriteCycle);
+        profile_end(PHASE_WRITE, Length);
+  
+        uart_send(__LINE__, "Done writing to flash memory.\r");
+        printf("========================================================================================================\r\r\r");
+        checkpoint_save(Plan, WriteCycle, Loop1UInt8, PHASE_DISPLAY, TotalErrors);
+      }
+
+
+      /* ----------------------------------------------------- *\
+             Display flash memory range to log file.
+      \* ----------------------------------------------------- */
+      /* When flash has been written, take a snapshot of it, as requested in the test plan. */
+      if ((Phase <= PHASE_DISPLAY) && (Plan->Snapshot != SNAPSHOT_NONE))
+      {
+        status_phase(PHASE_DISPLAY, WriteCycle, (Step + PHASE_DISPLAY));
+        profile_start(PHASE_DISPLAY);
+        if (Plan->Snapshot == SNAPSHOT_FULL)
+          display_flash_range(Plan->StartOffset, Length, DUMP_TEXT);
+        else
+          display_flash_mismatch(Plan->StartOffset, Length, Plan->Pattern[Loop1UInt8], WriteCycle);
+        profile_end(PHASE_DISPLAY, Length);
+        checkpoint_save(Plan, WriteCycle, Loop1UInt8, PHASE_VERIFY, TotalErrors);
+      }
+
+
+
+      /* ----------------------------------------------------- *\
+               Check flash memory range for a match.
+      \* ----------------------------------------------------- */
+      printf("========================================================================================================\r");
+      uart_send(__LINE__, "Check flash memory for a match with data written.\r\r");
+
+      /* Check every flash byte to confirm write has been successful. */
+      status_phase(PHASE_VERIFY, WriteCycle, (Step + PHASE_VERIFY));
+      profile_start(PHASE_VERIFY);
+      TotalErrors += flash_verify_pattern(Plan->StartOffset, Length, Plan->Pattern[Loop1UInt8], WriteCycle);
+      profile_end(PHASE_VERIFY, Length);
+      status_errors(TotalErrors);
+      uart_send(__LINE__, "\r");
+      
+      sprintf(String, "Total errors found so far: %llu\r", TotalErrors);
+      uart_send(__LINE__, String);
+
+      printf("========================================================================================================\r\r\r");
+
+      if (FlagAbort == FLAG_ON) break;
+
+      /* Next pattern (or first pattern of next cycle) starts with a flash erase. */
+      Phase = PHASE_ERASE;
+      if ((Loop1UInt8 + 1) < Plan->PatternCount)
+        checkpoint_save(Plan, WriteCycle, (Loop1UInt8 + 1), PHASE_ERASE, TotalErrors);
+      else
+        checkpoint_save(Plan, (WriteCycle + 1), 0, PHASE_ERASE, TotalErrors);
+    }
+    if (FlagAbort == FLAG_ON) break;
+  }
+  
+  
+  
+  /* ----------------------------------------------------- *\
+                      Final flash erase
+          to leave flash memory range clear when done.
+  \* ----------------------------------------------------- */
+  FlagPipeline = FLAG_OFF;
+  status_phase(PHASE_COUNT, WriteCycle, (Plan->Cycles * Plan->PatternCount * PHASE_COUNT));
+  if (FlagAbort == FLAG_ON)
+  {
+    /* Flash is left as is for analysis, and the last checkpoint allows to resume the test later. */
+    uart_send(__LINE__, "Flash memory test aborted by user.\r\r");
+  }
+  else
+  {
+    flash_erase_range(Plan->StartOffset, Length);
+    printf("\r");
+
+    /* Test is complete, there is nothing left to resume. */
+    checkpoint_clear();
+  }
+
+
+
+  /* ----------------------------------------------------- *\
+          Display final report for flash memory test.
+  \* ----------------------------------------------------- */
+  printf("========================================================================================================\r");
+  sprintf(String, "Flash memory test <%s> final report after %u write cycles.\r\r", Plan->Name, WriteCycle);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "Total errors found: %llu\r", TotalErrors);
+  uart_send(__LINE__, String);
+
+
+  /* Timing summary for each phase of the test. */
+  profile_report();
+  status_end();
+  #ifdef SECTOR_LATENCY
+  latency_report();
+  #endif
+
+  /* Keep a summary of this test in the record store, to be displayed after next reset and in the test history. */
+  if ((kv_read(KV_KEY_TEST_RESULT, (UINT8 *)&Result, &ResultLength) != 0) || (ResultLength != sizeof(Result))) Result.Runs = 0;
+  strcpy(Result.Name, Plan->Name);
+  Result.TotalErrors = TotalErrors;
+  Result.StartTime   = TestStartTime;
+  Result.Duration    = (UINT32)((time_us_64() - TestStartTime) / 1000000);
+  Result.Cycles      = WriteCycle;
+  Result.FlagAborted = FlagAbort;
+  for (Phase = 0; Phase < PHASE_COUNT; ++Phase)
+    Result.Throughput[Phase] = (PhaseProfile[Phase].TotalTime ? (UINT32)((PhaseProfile[Phase].TotalBytes * 1000000) / 1024 / PhaseProfile[Phase].TotalTime) : 0);
+  ++Result.Runs;
+  kv_write(KV_KEY_TEST_RESULT, (UINT8 *)&Result, sizeof(Result));
+  kv_write(KV_KEY_HISTORY + (Result.Runs % TEST_HISTORY_SIZE), (UINT8 *)&Result, sizeof(Result));
+
+  /* Sectors erased during this test. */
+  erase_count_save();
+
+  sprintf(String, "End of flash memory test\r");
+  uart_send(__LINE__, String);
+  printf("========================================================================================================\r\r\r");
+  *Errors = TotalErrors;
+
+  return FLAG_ON;
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=flash_verify_bisect() */
+/* ------------------------------------------------------------------ *\
+     Split a flash range whose CRC32 doesn't match in halves until
+                   the bytes in error are found.
+     NOTES:
+     - Range must be within one sector and FlashOldData must hold the
+       expected content of this sector (see flash_verify_pattern()).
+     - Each half is streamed through the DMA sniffer again, and only
+       the halves that don't match are split further. Once a range is
+       VERIFY_BISECT_SIZE bytes or less, the CPU checks it byte by byte
+       with flash_verify_region(), so a few bad bytes in a sector cost
+       a few DMA passes and 256 bytes of CPU reads instead of 4096.
+\* ------------------------------------------------------------------ */
+UINT64 flash_verify_bisect(UINT32 Offset, UINT32 Length, UINT8 Pattern, UINT8 Cycle)
+{
+  UINT8 Loop1UInt8;
+
+  UINT32 Half;
+  UINT32 HalfOffset;
+
+  UINT64 TotalErrors;
+
+
+  /* Range is known not to match, small enough for the CPU to look at its bytes. */
+  if (Length <= VERIFY_BISECT_SIZE)
+    return flash_verify_region(Offset, Length, Pattern, Cycle);
+
+  /* Initializations. */
+  Half        = Length / 2;
+  TotalErrors = 0;
+
+  for (Loop1UInt8 = 0; Loop1UInt8 < 2; ++Loop1UInt8)
+  {
+    HalfOffset = Offset + (Loop1UInt8 * Half);
+    if (dma_crc32_flash(HalfOffset, Half) != dma_crc32(&FlashOldData[HalfOffset % FLASH_SECTOR_SIZE], Half))
+      TotalErrors += flash_verify_bisect(HalfOffset, Half, Pattern, Cycle);
+  }
+
+  return TotalErrors;
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=flash_verify_pattern() */
+/* ------------------------------------------------------------------ *\
+     Check that a range of flash memory contains a test pattern and
+                    report every byte in error.
+     NOTES:
+     - StartOffset and Length must be multiples of a sector (4096).
+     - When the dual-core pipeline is used, core 1 has already checked
+       every sector while core 0 was writing and logging, so only the
+       sectors flagged by core 1 are checked again. The same is done
+       when display_flash_mismatch() has just flagged the sectors in
+       error (FlagSectorFlags), so that each sector is compared once.
+     - Otherwise, when DMA_VERIFY is defined, each sector is streamed
+       through the DMA sniffer and its CRC32 is compared to the CRC32
+       of the same sector regenerated in FlashOldData. Sectors that
+       don't match are bisected (see flash_verify_bisect()), so the CPU
+       only reads the small ranges where the bytes in error are.
+\* ------------------------------------------------------------------ */
+UINT64 flash_verify_pattern(UINT32 StartOffset, UINT32 Length, UINT8 Pattern, UINT8 Cycle)
+{
+  UINT32 SectorOffset;
+
+  UINT64 TotalErrors;
+
+
+  /* Initializations. */
+  TotalErrors = 0;
+
+
+  if ((FlagPipeline == FLAG_ON) || (FlagSectorFlags == FLAG_ON))
+  {
+    /* Every sector written has already been checked, only look at the sectors where an error has been found. */
+    if (FlagPipeline == FLAG_ON) pipeline_wait();
+    FlagSectorFlags = FLAG_OFF;
+    for (SectorOffset = StartOffset; SectorOffset < (StartOffset + Length); SectorOffset += FLASH_SECTOR_SIZE)
+    {
+      if (pipeline_sector_failed(SectorOffset) == FLAG_ON)
+        TotalErrors += flash_verify_region(SectorOffset, FLASH_SECTOR_SIZE, Pattern, Cycle);
+    }
+
+    return TotalErrors;
+  }
+
+
+  #ifdef DMA_VERIFY
+  for (SectorOffset = StartOffset; SectorOffset < (StartOffset + Length); SectorOffset += FLASH_SECTOR_SIZE)
+  {
+    if (console_poll(SectorOffset) == FLAG_ON) break;
+
+    /* Find the bytes in error only if this sector's CRC32 doesn't match the CRC32 expected (protected content is expected as is). */
+    pattern_fill(Pattern, Cycle, SectorOffset, FlashOldData);
+    flash_preserve(SectorOffset, FlashOldData);
+    if (dma_crc32_flash(SectorOffset, FLASH_SECTOR_SIZE) != dma_crc32(FlashOldData, FLASH_SECTOR_SIZE))
+      TotalErrors += flash_verify_bisect(SectorOffset, FLASH_SECTOR_SIZE, Pattern, Cycle);
+  }
+  #else
+  TotalErrors = flash_verify_region(StartOffset, Length, Pattern, Cycle);
+  #endif
+
+  return TotalErrors;
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=flash_verify_region() */
+/* ------------------------------------------------------------------ *\
+      Check byte by byte that a region of flash memory contains a
+            test pattern and report every byte in error.
+     NOTES:
+     - Offset must be aligned on 32 bits and Length must be a
+       multiple of 4.
+     - Region is split into spans that don't overlap any protected
+       region (see flash_span_next()), so protected bytes are never
+       reported as errors.
+     - Expected data is regenerated on-the-fly and compared one 32-bit
+       word at a time. Bytes are looked at only when a word doesn't
+       match.
+\* ------------------------------------------------------------------ */
+UINT64 flash_verify_region(UINT32 Offset, UINT32 Length, UINT8 Pattern, UINT8 Cycle)
+{
+  UCHAR String[256];
+
+  UINT8 Expected;
+  UINT8 Loop1UInt8;
+
+  UINT32 ByteOffset;
+  UINT32 ExpectedWord;
+  UINT32 Loop1UInt32;
+  UINT32 SpanEnd;
+  UINT32 SpanStart;
+  UINT32 Word;
+
+  UINT64 TotalErrors;
+
+  struct pattern_generator Generator;
+
+
+  /* Initializations. */
+  TotalErrors = 0;
+
+
+  for (SpanStart = flash_span_next(Offset, (Offset + Length), &SpanEnd); SpanStart < (Offset + Length); SpanStart = flash_span_next(SpanEnd, (Offset + Length), &SpanEnd))
+  {
+    pattern_start(&Generator, Pattern, Cycle, (SpanStart & ~3));
+    for (Loop1UInt32 = (SpanStart & ~3); Loop1UInt32 < SpanEnd; Loop1UInt32 += 4)
+    {
+      if (((Loop1UInt32 % FLASH_SECTOR_SIZE) == 0) && (console_poll(Loop1UInt32) == FLAG_ON)) break;
+
+      /* Compare 4 bytes at a time, and look at each byte only when they don't match. */
+      ExpectedWord = pattern_next(&Generator);
+      Word         = *(UINT32 *)&FlashReadAddress[Loop1UInt32];  // single read, bytes are then taken from this word.
+      if (Word == ExpectedWord) continue;
+
+      for (Loop1UInt8 = 0; Loop1UInt8 < 4; ++Loop1UInt8)
+      {
+        /* Words partly protected at both ends of the span are compared too, ignore their protected bytes. */
+        ByteOffset = Loop1UInt32 + Loop1UInt8;
+        if ((ByteOffset < SpanStart) || (ByteOffset >= SpanEnd)) continue;
+
+        Expected = (UINT8)(ExpectedWord >> (Loop1UInt8 * 8));  // little endian.
+        if ((UINT8)(Word >> (Loop1UInt8 * 8)) != Expected)
+        {
+          sprintf(String, "Offset: 0x%8.8X   Data read: 0x%2.2X instead of 0x%2.2X\r", ByteOffset, (UINT8)(Word >> (Loop1UInt8 * 8)), Expected);
+          uart_send(__LINE__, String);
+          ++TotalErrors;
+        }
+      }
+    }
+    if (FlagAbort == FLAG_ON) break;
+  }
+
+  return TotalErrors;
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=flash_write() */
+/* ------------------------------------------------------------------ *\
+                    Write data to Pico's flash memory.
+                    To keep things simple in the code, 
+                always one sector is updated in the flash.
+     NOTES:
+     - When DIFFERENTIAL_WRITE is defined, the new sector content is
+       compared with current flash content first:
+         identical          nothing is written.
+         only 1 -> 0 bits   changed pages are programmed, no erase.
+         otherwise          sector is erased and reprogrammed.
+       Since erasing is what wears the flash out, reflashing a mostly
+       unchanged image is both faster and gentler on the flash.
+     - To append small records into an erased area, flash_program()
+       is cheaper since it doesn't read nor rewrite the whole sector.
+     - Content of EXCLUDE_PRESERVE regions (see FlashExclusion[]) is
+       kept unchanged, whatever the data written.
+\* ------------------------------------------------------------------ */
+UINT flash_write(UINT32 FlashMemoryOffset, UINT8 *Data, UINT16 DataSize)
+{
+  #ifdef RESTORE
+  UCHAR Archive[TEST_RESULT_SIZE];
+  #endif
+  UCHAR String[256];
+
+  UINT8 Current;
+  UINT8 FlagErase;
+  UINT8 Page;
+
+  UINT16 Loop1UInt16;
+  UINT16 PageMask;
+
+  UINT32 EndTime;
+  UINT32 EraseTime;
+  UINT32 InterruptMask;
+  UINT32 SectorOffset;
+  UINT32 StartTime;
+
+
+  /* Initializations. */
+  SectorOffset      = FlashMemoryOffset;  // assume offset specified is on a sector boundary.
+  FlashMemoryOffset = 0;                  // assume that new data will be at the beginning of sector.
+  FlagErase         = FLAG_ON;            // assume that sector must be erased before reprogramming.
+  PageMask          = 0xFFFF;             // one bit for each of the 16 pages of the sector.
+
+
+  /***
+  uart_send(__LINE__, "\r");
+
+  sprintf(String, "Entering flash_write()     SectorOffset from XIP_BASE where to write: 0x%8.8X\r", SectorOffset);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "Data address: 0x%8.8X   Data size:    0x%4.4X (%u)\r", Data, DataSize, DataSize);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "FlashNewData: 0x%p   FlashOldData: 0x%p\r", FlashNewData, FlashOldData);
+  uart_send(__LINE__, String);
+  ***/
+
+
+  if (SectorOffset % FLASH_SECTOR_SIZE)
+  {
+    /* Offset specified is not aligned on a sector boundary. */
+    sprintf(String, "FlashMemoryOffset specified (0x%8.8X) is not aligned on a sector boundary (multiple of 4096)\r", SectorOffset);
+    uart_send(__LINE__, String);
+
+    sprintf(String, "Phased out by %u (0x%X) bytes.\r", SectorOffset % FLASH_SECTOR_SIZE, SectorOffset % FLASH_SECTOR_SIZE);
+    uart_send(__LINE__, String);
+
+    while (SectorOffset % FLASH_SECTOR_SIZE)
+    {
+      --SectorOffset;
+      ++FlashMemoryOffset;
+    }
+
+    sprintf(String, "Sector offset has been shifted down to 0x%8.8X...\r", SectorOffset);
+    uart_send(__LINE__, String);
+
+    sprintf(String, "...and data offset has been shifted up to 0x%X (%u) from sector start.\r", FlashMemoryOffset, FlashMemoryOffset);
+    uart_send(__LINE__, String);
+  }
+
+
+  if (FlashMemoryOffset + DataSize > 4096)
+  {
+    uart_send(__LINE__, "The arguments given cross a sector boundary which is not allowed...\r");
+
+    sprintf(String, "Sector offset: %X   FlashMemoryOffset: %X  Data size: %X\r\r\r", SectorOffset, FlashMemoryOffset, DataSize);
+    uart_send(__LINE__, String);
+
+    return 1;
+  }
+
+
+  /* A wear leveling algorithm has not been implemented.
+     Consequently, flash_write() must not be used for intensive data logging without adding a wear leveling algorithm. */
+  /* Take a copy of current flash content. */
+  for (Loop1UInt16 = 0; Loop1UInt16 < FLASH_SECTOR_SIZE; ++Loop1UInt16)
+    FlashOldData[Loop1UInt16] = FlashBaseAddress[SectorOffset + Loop1UInt16];
+
+  
+  /***
+  printf("=======================================================================================================\r");
+  uart_send(__LINE__, "Display original data retrieved from flash:\r");
+
+  sprintf(String, "FlashBaseAddress: 0x%p   FlashOldData: %p   SectorOffset: 0x%4.4X\r\r", FlashBaseAddress, FlashOldData, SectorOffset);
+  uart_send(__LINE__, String);
+
+  display_memory(RAM_BASE_ADDRESS, (UINT32)(FlashOldData - RAM_BASE_ADDRESS), FLASH_SECTOR_SIZE, DUMP_TEXT);
+  
+  uart_send(__LINE__, "\r");
+  uart_send(__LINE__, "End of display original data retrieved from flash.\r");
+  printf("=======================================================================================================\r\r\r");
+  ***/
+
+
+  #ifdef RESTORE
+  /* Pico's manufacturing test results to put back in flash, as saved in restore1.c. */
+  if (SectorOffset == TEST_RESULT_OFFSET)
+  {
+    #include "restore1.c"
+  }
+  #endif
+
+
+  /* Overwrite target memory area with new data. 
+     NOTE: FlashNewData contains data to be written, passed in argument.
+           and FlashOldData contains original data (one sector) read from flash. */
+  memcpy(&FlashOldData[FlashMemoryOffset], Data, DataSize);
+
+
+  /* Keep protected content of this sector unchanged (Pico's manufacturing test results, see FlashExclusion[]). */
+  flash_preserve(SectorOffset, FlashOldData);
+
+  #ifdef RESTORE
+  if (SectorOffset == TEST_RESULT_OFFSET)
+    memcpy(&FlashOldData[TEST_RESULT_OFFSET - SectorOffset], Archive, TEST_RESULT_SIZE);
+  #endif
+
   
-  // printf("                                  AdcValue with PICO_LED true: %4.4u\r", AdcValue1);
-  // printf("            Voltage is between 1.8 and 5 volts on a Pico but near 0 volt on a Pico W: %2.2f\r", Volts1);
+  /***
+  printf("=======================================================================================================\r");
+  sprintf(String, "Data to be written to sector 0x%8.8X at offset 0x%4.4X:\r", SectorOffset, FlashMemoryOffset);
+  uart_send(__LINE__, String);
+  
+  sprintf(String, "Data: 0x%p   DataSize: 0x%4.4X (%u)\r", Data, DataSize, DataSize);
+  uart_send(__LINE__, String);
+
+  sprintf(String, "FlashBaseAddress: 0x%p\r\r", FlashBaseAddress);
+  uart_send(__LINE__, String);
+
+  display_memory(RAM_BASE_ADDRESS, (UINT32)(FlashOldData - RAM_BASE_ADDRESS), FLASH_SECTOR_SIZE, DUMP_TEXT);
+  ***/
+
+
+  #ifdef DIFFERENTIAL_WRITE
+  /* Find the pages that change and check if programming alone can do it (programming can only clear bits). */
+  FlagErase = FLAG_OFF;
+  PageMask  = 0;
+  for (Loop1UInt16 = 0; Loop1UInt16 < FLASH_SECTOR_SIZE; ++Loop1UInt16)
+  {
+    Current = FlashBaseAddress[SectorOffset + Loop1UInt16];
+    if (FlashOldData[Loop1UInt16] == Current) continue;
+
+    PageMask |= (1 << (Loop1UInt16 / FLASH_PAGE_SIZE));
+    if (FlashOldData[Loop1UInt16] & ~Current) FlagErase = FLAG_ON;  // a bit must go from 0 to 1.
+  }
+
+  /* Flash already contains the new data. */
+  if (PageMask == 0) return 0;
+
+  /* All pages will be programmed after an erase. */
+  if (FlagErase == FLAG_ON) PageMask = 0xFFFF;
+  #endif
+
+
+  /* Pause core 1, keep track of interrupt mask and disable interrupts during flash writing. */
+  InterruptMask = flash_enter_critical();
+
+  /* Erase flash before reprogramming. */
+  StartTime = time_us_32();
+  if (FlagErase == FLAG_ON) flash_range_erase(SectorOffset, FLASH_SECTOR_SIZE);
+  EraseTime = time_us_32();
+  
+  /* Save data to flash memory. */
+  if (PageMask == 0xFFFF)
+  {
+    flash_range_program(SectorOffset, FlashOldData, FLASH_SECTOR_SIZE);
+  }
+  else
+  {
+    for (Page = 0; Page < (FLASH_SECTOR_SIZE / FLASH_PAGE_SIZE); ++Page)
+      if (PageMask & (1 << Page)) flash_range_program((SectorOffset + (Page * FLASH_PAGE_SIZE)), &FlashOldData[Page * FLASH_PAGE_SIZE], FLASH_PAGE_SIZE);
+  }
+  EndTime   = time_us_32();
+
+  /* Restore original interrupt mask and resume core 1 when done. */
+  flash_exit_critical(InterruptMask);
+
+  if (FlagErase == FLAG_ON) erase_count_add(SectorOffset, FLASH_SECTOR_SIZE);
+
+  #ifdef SECTOR_LATENCY
+  /* Only whole sector programs are comparable with the other sector programs. */
+  if (FlagErase == FLAG_ON) latency_record(LATENCY_ERASE, SectorOffset, EraseTime - StartTime);
+  if (PageMask == 0xFFFF)   latency_record(LATENCY_PROGRAM, SectorOffset, EndTime - EraseTime);
+  #endif
+
+
+  /***
+  printf("\r");
+  sprintf(String, "End of flash_write(%u, %u)\r", FlashMemoryOffset, DataSize);
+  uart_send(__LINE__, String);
+  printf("========================================================================================================\r\r\r");
+  ***/
+
+  return 0;
+}
+
+
+
+
+/* $PAGE */
+/* $TITLE=flash_write_pattern() */
+/* ------------------------------------------------------------------ *\
+      Program a test pattern to a range of flash memory that is
+                            already erased.
+     NOTES:
+     - StartOffset and Length must be multiples of a sector (4096).
+     - Since the target range is known to be erased (for example
+       right after erase_all_flash()), sectors are programmed directly
+       without reading back nor erasing them first.
+     - Each sector is generated into FlashNewData just before it is
+       programmed, so any pattern (including offset-based patterns)
+       may be written without a full-size reference copy.
+     - Sectors of EXCLUDE_SKIP regions (see FlashExclusion[]) are not
+       written. Content of EXCLUDE_PRESERVE regions is copied into the
+       sector buffer, so that programming it again leaves it unchanged.
+\* ------------------------------------------------------------------ */
+UINT flash_write_pattern(UINT32 StartOffset, UINT32 Length, UINT8 Pattern, UINT8 Cycle)
+{
+  UCHAR String[256];
+
+  UINT32 EndTime;
+  UINT32 InterruptMask;
+  UINT32 SectorOffset;
+  UINT32 StartTime;
+
+
+  if ((StartOffset % FLASH_SECTOR_SIZE) || (Length % FLASH_SECTOR_SIZE))
+  {
+    sprintf(String, "Range specified for flash_write_pattern(0x%8.8X, 0x%8.8X) is not aligned on a sector boundary (multiple of 4096)\r", StartOffset, Length);
+    uart_send(__LINE__, String);
+
+    return 1;
+  }
+
+
+  for (SectorOffset = StartOffset; SectorOffset < (StartOffset + Length); SectorOffset += FLASH_SECTOR_SIZE)
+  {
+    if (console_poll(SectorOffset) == FLAG_ON) break;
+
+    /* Protected regions that must not be touched are skipped. */
+    if (flash_excluded(SectorOffset, FLASH_SECTOR_SIZE, EXCLUDE_SKIP) != NULL) continue;
+
+    /* Generate data for this sector, with protected content left as is. */
+    pattern_fill(Pattern, Cycle, SectorOffset, FlashNewData);
+    flash_preserve(SectorOffset, FlashNewData);
+
+    /* Pause core 1, keep track of interrupt mask and disable interrupts during flash writing. */
+    InterruptMask = flash_enter_critical();
+
+    /* Save data to flash memory. */
+    StartTime = time_us_32();
+    flash_range_program(SectorOffset, FlashNewData, FLASH_SECTOR_SIZE);
+    EndTime   = time_us_32();
+
+    /* Restore original interrupt mask and resume core 1 when done. */
+    flash_exit_critical(InterruptMask);
+
+    #ifdef SECTOR_LATENCY
+    latency_record(LATENCY_PROGRAM, SectorOffset, EndTime - StartTime);
+    #endif
+
+    /* Let core 1 check this region while core 0 goes on. */
+    if (FlagPipeline == FLAG_ON) pipeline_post(JOB_VERIFY, SectorOffset, FLASH_SECTOR_SIZE, Pattern, Cycle, NULL);
+  }
+
+  return 0;
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=format_memory_row() */
+/* ------------------------------------------------------------------ *\
+     Format one line of a memory dump: address, memory content in hex
+                   and memory content in ASCII.
+     NOTES:
+     - Output is the same as the original sprintf() formatting:
+       "[%p] ", then "%2.2X " for every byte, "| ", then every byte
+       as a character (or <.> if not displayable) and a final <\r>.
+     - Count is the number of bytes to display (1 to 16). Missing
+       bytes are displayed as blanks.
+     - Characters are written directly into String with a nibble
+       lookup table, without any call to sprintf() or strlen().
+     - Returns the length of the string (not including end-of-string).
+\* ------------------------------------------------------------------ */
+UINT16 format_memory_row(UCHAR *String, UINT32 Address, UINT8 *Data, UINT8 Count)
+{
+  UCHAR *Pointer;
+
+  UINT8 Loop1UInt8;
+
+
+  Pointer = String;
+
+  /* Memory address (same as "%p": 8 hex digits). */
+  *Pointer++ = '[';
+  for (Loop1UInt8 = 0; Loop1UInt8 < 8; ++Loop1UInt8)
+    *Pointer++ = HexDigit[(Address >> (28 - (Loop1UInt8 * 4))) & 0x0F];
+  *Pointer++ = ']';
+  *Pointer++ = ' ';
+
+  /* Memory content in hex. */
+  for (Loop1UInt8 = 0; Loop1UInt8 < 16; ++Loop1UInt8)
+  {
+    if (Loop1UInt8 < Count)
+    {
+      *Pointer++ = HexDigit[Data[Loop1UInt8] >> 4];
+      *Pointer++ = HexDigit[Data[Loop1UInt8] & 0x0F];
+    }
+    else
+    {
+      *Pointer++ = ' ';
+      *Pointer++ = ' ';
+    }
+    *Pointer++ = ' ';
+  }
+
+  /* Separator. */
+  *Pointer++ = '|';
+  *Pointer++ = ' ';
+
+  /* Memory content in ASCII when displayable characters, or <.> if not displayable (<%> is not displayable since string goes through sprintf() in uart_send()). */
+  for (Loop1UInt8 = 0; Loop1UInt8 < 16; ++Loop1UInt8)
+  {
+    if (Loop1UInt8 >= Count)
+      *Pointer++ = ' ';
+    else if ((Data[Loop1UInt8] >= 0x20) && (Data[Loop1UInt8] <= 0x7E) && (Data[Loop1UInt8] != 0x25))
+      *Pointer++ = Data[Loop1UInt8];
+    else
+      *Pointer++ = '.';
+  }
+
+  *Pointer++ = '\r';  // add linefeed.
+  *Pointer   = 0x00;  // end-of-string.
+
+  return (Pointer - String);
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=image_upload_result() */
+/* ------------------------------------------------------------------ *\
+       Report the result of a sector programmed by core 1 during
+                          an image upload.
+     NOTES:
+     - Must be called after pipeline_wait(). Nothing is done when Job
+       is NULL (no sector handed to core 1 yet).
+     - Crc is the CRC32 of the data received for this sector.
+\* ------------------------------------------------------------------ */
+void image_upload_result(struct pipeline_job *Job, UINT32 Crc, UINT32 *Written, UINT32 *Failed)
+{
+  if (Job == NULL) return;
+
+  if (Job->Result == JOB_RESULT_SAME)
+  {
+    printf("SECTOR 0x%8.8X 0x%8.8X SAME\r", (XIP_BASE + Job->Offset), Crc);
+
+    return;
+  }
+
+  erase_count_add(Job->Offset, FLASH_SECTOR_SIZE);
+  ++*Written;
+
+  if (Job->Result == JOB_RESULT_OK)
+  {
+    printf("SECTOR 0x%8.8X 0x%8.8X OK\r", (XIP_BASE + Job->Offset), Crc);
+  }
+  else
+  {
+    printf("SECTOR 0x%8.8X 0x%8.8X FAIL\r", (XIP_BASE + Job->Offset), Crc);
+    ++*Failed;
+    status_errors(*Failed);
+  }
+
+  return;
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=image_upload() */
+/* ------------------------------------------------------------------ *\
+       Receive an image from the host and program it to flash memory.
+     NOTES:
+     - StartOffset and Length must be multiples of a sector (4096).
+     - Host sends the image as binary frames, in the same format as
+       display_memory_binary() (SOH, Address, Length, Data, CRC32),
+       in increasing address order and never across a sector
+       boundary. Each frame is answered on the console by:
+         ACK 0x<address>     frame received, host sends the next one.
+         NAK 0x<address>     CRC error or unexpected address, host
+                             sends again the frame at this address.
+     - Resync rule: after a bad frame, everything received is dropped
+       until host has sent nothing for UPLOAD_RESYNC_IDLE msec, and
+       only then is the NAK sent. Host must stop sending and wait for
+       the ACK / NAK of the frames already sent, so that the rest of a
+       bad frame (or frames sent after it) is never parsed as a new
+       frame, and a bad frame costs a single NAK.
+     - Frames are acknowledged as soon as they are in RAM, so that the
+       host keeps streaming. FlashNewData and FlashOldData are used in
+       turn: once a sector has been received, it is handed to core 1
+       (JOB_PROGRAM, see core1_main()), which erases and programs it
+       while core 0 receives the next sector in the other buffer.
+       Core 0 waits for core 1 before handing over the next sector,
+       so a buffer is never overwritten while being programmed.
+     - While core 1 programs a sector, core 0 only works in RAM (the
+       firmware must be run from RAM) and the XIP window is never
+       read: core 0 is not paused and its interrupts stay enabled, so
+       USB keeps receiving. ACK lines go through the log buffer and
+       are sent once core 1 is done with the sector.
+     - Each sector programmed is read back and its CRC32 (same as the
+       HASH command) is compared to the CRC32 of the data received:
+         SECTOR 0x<address> 0x<crc32> SAME|OK|FAIL
+       The SECTOR line of a sector comes after the ACK lines of the
+       next sector. Sectors already holding the data received are not
+       erased.
+     - EXCLUDE_PRESERVE regions (see FlashExclusion[]) are kept
+       unchanged, whatever the data received.
+     - Console is not polled during an upload since it may be the
+       channel used for binary frames.
+\* ------------------------------------------------------------------ */
+UINT8 image_upload(UINT32 StartOffset, UINT32 Length, UCHAR *Details)
+{
+  static UINT8 Frame[7 + DUMP_FRAME_SIZE + 4];  // kept off core 0's stack.
+
+  UINT8 Receiving;
+  UINT8 *Buffer[2];
+
+  UINT16 FrameLength;
+
+  UINT32 Address;
+  UINT32 Crc;
+  UINT32 EndOffset;
+  UINT32 Expected;
+  UINT32 Failed;
+  UINT32 FrameCrc;
+  UINT32 SectorCrc[2];
+  UINT32 SectorOffset;
+  UINT32 Written;
+
+  struct pipeline_job *Job;
+
+
+  if (((void *)main < (void *)0x20000000) || ((void *)main > (void *)0x20041FFF))
+  {
+    sprintf(Details, "reason=running_from_flash");
+
+    return STATUS_FLASH_RUN;
+  }
+
+
+  /* Initializations. */
+  Buffer[0] = FlashNewData;
+  Buffer[1] = FlashOldData;
+  Receiving = 0;
+  Failed    = 0;
+  Written   = 0;
+  Job       = NULL;
+  EndOffset = StartOffset + Length;
+  status_begin(MODE_COMMAND, StartOffset, Length, 1);
+
+
+  /* One more pass after the last sector, to collect the result of its programming. */
+  for (SectorOffset = StartOffset; SectorOffset <= EndOffset; SectorOffset += FLASH_SECTOR_SIZE)
+  {
+    /* ----------------------------------------------------- *\
+        Receive this sector in the free buffer, while core 1
+                   programs the previous one.
+    \* ----------------------------------------------------- */
+    Expected = XIP_BASE + SectorOffset;
+    if (SectorOffset < EndOffset) status_offset(SectorOffset);
+    while ((SectorOffset < EndOffset) && (Expected < (XIP_BASE + SectorOffset + FLASH_SECTOR_SIZE)))
+    {
+      /* Wait for the start of a frame. */
+      do
+      {
+        if (binary_receive(Frame, 1) == FLAG_OFF)
+        {
+          /* Previous sector is still owned by core 1. */
+          pipeline_wait();
+          image_upload_result(Job, SectorCrc[Receiving ^ 1], &Written, &Failed);
+          if (Written) erase_count_save();
+          sprintf(Details, "sectors=%lu written=%lu failed=%lu next=0x%8.8X", ((SectorOffset - StartOffset) / FLASH_SECTOR_SIZE), Written, Failed, Expected);
+          status_end();
+
+          return STATUS_TIMEOUT;
+        }
+      } while (Frame[0] != 0x01);
+
+      if (binary_receive(&Frame[1], 6) == FLAG_OFF) continue;
+      Address     = Frame[1] | (Frame[2] << 8) | (Frame[3] << 16) | (Frame[4] << 24);
+      FrameLength = Frame[5] | (Frame[6] << 8);
+
+      /* Frame must be the next one expected and fit in this sector. */
+      if ((Address != Expected) || (FrameLength == 0) || (FrameLength > DUMP_FRAME_SIZE) || ((Address + FrameLength) > (XIP_BASE + SectorOffset + FLASH_SECTOR_SIZE)))
+      {
+        binary_discard(UPLOAD_RESYNC_IDLE);
+        printf("NAK 0x%8.8X\r", Expected);
+        continue;
+      }
+
+      if (binary_receive(&Frame[7], (FrameLength + 4)) == FLAG_OFF) continue;
+      Crc      = crc32_update(0, &Frame[1], (6 + FrameLength));
+      FrameCrc = Frame[7 + FrameLength] | (Frame[8 + FrameLength] << 8) | (Frame[9 + FrameLength] << 16) | (Frame[10 + FrameLength] << 24);
+      if (Crc != FrameCrc)
+      {
+        binary_discard(UPLOAD_RESYNC_IDLE);
+        printf("NAK 0x%8.8X\r", Expected);
+        continue;
+      }
+
+      memcpy(&Buffer[Receiving][Address - (XIP_BASE + SectorOffset)], &Frame[7], FrameLength);
+      Expected += FrameLength;
+      printf("ACK 0x%8.8X\r", Address);
+    }
+
+
+
+    /* ----------------------------------------------------- *\
+        Wait for core 1 to program the previous sector, then
+       hand this one over and receive the next one in the
+                         other buffer.
+    \* ----------------------------------------------------- */
+    pipeline_wait();
+    image_upload_result(Job, SectorCrc[Receiving ^ 1], &Written, &Failed);
+    if (SectorOffset == EndOffset) break;
+
+    /* Flash may be read again, now that core 1 is idle. */
+    flash_preserve(SectorOffset, Buffer[Receiving]);
+    SectorCrc[Receiving] = crc32_update(0, Buffer[Receiving], FLASH_SECTOR_SIZE);
+    Job = pipeline_post(JOB_PROGRAM, SectorOffset, FLASH_SECTOR_SIZE, 0, 0, Buffer[Receiving]);
+
+    Receiving ^= 1;
+  }
+
+  /* Keep track of sectors erased by this upload. */
+  if (Written) erase_count_save();
+
+  sprintf(Details, "sectors=%lu written=%lu failed=%lu", (Length / FLASH_SECTOR_SIZE), Written, Failed);
+  status_end();
+
+  return (Failed ? STATUS_ERRORS : STATUS_OK);
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=input_dump_format() */
+/* ------------------------------------------------------------------ *\
+                Ask user for the format of a memory dump.
+\* ------------------------------------------------------------------ */
+UINT8 input_dump_format(void)
+{
+  UCHAR String[256];
+
+
+  printf("                    Display as <T>ext, <C>ompact text (identical lines summarized)\r");
+  printf("                    or as <B>inary frames through USB (for a host script) <T/C/B>: ");
+  input_string(String);
+  printf("\r\r");
+
+  if ((strcmp(String, "B") == 0) || (strcmp(String, "b") == 0))
+    return DUMP_BINARY;
+
+  if ((strcmp(String, "C") == 0) || (strcmp(String, "c") == 0))
+    return DUMP_COMPACT;
+
+  return DUMP_TEXT;
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=input_string() */
+/* ------------------------------------------------------------------ *\
+                       Read a string from stdin.
+\* ------------------------------------------------------------------ */
+void input_string(UCHAR *String)
+{
+  input_string_echo(String, FLAG_ON);
+
+  return;
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=input_string_echo() */
+/* ------------------------------------------------------------------ *\
+              Read a string from stdin, with or without echo.
+     NOTE: Command mode reads its input without echo, so that the
+           lines sent by a host script are not mixed with the replies
+           it parses.
+\* ------------------------------------------------------------------ */
+void input_string_echo(UCHAR *String, UINT8 FlagEcho)
+{
+  int8_t DataInput;
+
+  UINT8 Loop1UInt8;
+
+
+  Loop1UInt8 = 0;
+  do
+  {
+    DataInput = getchar_timeout_us(50000);
+
+    switch (DataInput)
+    {
+      case (PICO_ERROR_TIMEOUT):
+      case (0):
+        continue;
+      break;
+
+      case (8):
+        /* <Backspace> */
+        if (Loop1UInt8 > 0)
+        {
+          --Loop1UInt8;
+          String[Loop1UInt8] = 0x00;
+          if (FlagEcho == FLAG_ON) printf("%c %c", 0x08, 0x08);  // erase character under the cursor.
+        }
+      break;
+
+      case (0x0D):
+        /* <Enter> */
+        if (Loop1UInt8 == 0)
+        {
+          String[Loop1UInt8++] = (UCHAR)DataInput;  
+          String[Loop1UInt8++] = 0x00;
+        }
+        if (FlagEcho == FLAG_ON) printf("\r");
+      break;
+
+      default:
+        if (FlagEcho == FLAG_ON) printf("%c", (UCHAR)DataInput);
+        String[Loop1UInt8] = (UCHAR)DataInput;
+        // printf("Loop1UInt8: %3u   %2.2X - %c\r", Loop1UInt8, DataInput, DataInput);  ///
+        ++Loop1UInt8;
+      break;
+    }
+  } while((Loop1UInt8 < 128) && (DataInput != 0x0D));
   
-  // printf("                                  AdcValue with PICO_LED false: %4.4u\r", AdcValue2);
-  // printf("            Voltage is between 1.8 and 5 volts on a Pico but near 0 volt on a Pico W: %2.2f\r", Volts2);
+  String[Loop1UInt8] = '\0';  // end-of-string
+
+  /***
+  for (Loop1UInt8 = 0; Loop1UInt8 < 10; ++Loop1UInt8)
+    printf("%2u:[%2.2X]   ", Loop1UInt8, String[Loop1UInt8]);
+  printf("\r");
+  ***/
+
+  return;
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=input_test_plan() */
+/* ------------------------------------------------------------------ *\
+                  Ask user for the test plan to run.
+     NOTES:
+     - User may select one of the predefined profiles or enter a
+       custom test plan (range, cycles and patterns).
+     - The last flash sector is reserved for test checkpoints and may
+       not be part of a test plan.
+     - Returns FLAG_ON when a valid test plan has been selected.
+\* ------------------------------------------------------------------ */
+UINT8 input_test_plan(struct test_plan *Plan)
+{
+  UCHAR String[256];
+
+  UINT8 Loop1UInt8;
+  UINT8 Menu;
+
+  UINT32 Value;
+
+
+  printf("                    Flash test plans:\r");
+  for (Loop1UInt8 = 0; Loop1UInt8 < TEST_PLAN_PROFILES; ++Loop1UInt8)
+    printf("                    %u) %-18s offset 0x%6.6X to 0x%6.6X   %2u cycle(s)   %u patterns\r", Loop1UInt8 + 1, TestPlanProfile[Loop1UInt8].Name, TestPlanProfile[Loop1UInt8].StartOffset,
+           TestPlanProfile[Loop1UInt8].EndOffset, TestPlanProfile[Loop1UInt8].Cycles, TestPlanProfile[Loop1UInt8].PatternCount);
+  printf("                    %u) Custom test plan\r\r", TEST_PLAN_PROFILES + 1);
+
+  printf("                    Enter an option (or <Enter> to return to menu): ");
+  input_string(String);
+  printf("\r\r");
+  if (String[0] == 0x0D) return FLAG_OFF;  // if user pressed <Enter> only.
+  Menu = atoi(String);
+
+  if ((Menu >= 1) && (Menu <= TEST_PLAN_PROFILES))
+  {
+    memcpy(Plan, &TestPlanProfile[Menu - 1], sizeof(struct test_plan));
+
+    return FLAG_ON;
+  }
+
+  if (Menu != (TEST_PLAN_PROFILES + 1))
+  {
+    printf("                    Invalid choice... [%s]\r\r", String);
+
+    return FLAG_OFF;
+  }
+
+
+
+  /* ----------------------------------------------------- *\
+                      Custom test plan.
+  \* ----------------------------------------------------- */
+  strcpy(Plan->Name, "Custom");
+  Plan->Snapshot = SNAPSHOT_MISMATCH;
+
+  printf("                    Enter start offset in hex, aligned on a sector boundary (0x0000 to 0x%X): ", (METADATA_OFFSET - FLASH_SECTOR_SIZE));
+  input_string(String);
+  Value = strtol(String, NULL, 16);
+  if ((String[0] == 0x0D) || (Value % FLASH_SECTOR_SIZE) || (Value >= METADATA_OFFSET))
+  {
+    printf("\r                    Invalid start offset entered...[0x%8.8X]\r\r", Value);
+    return FLAG_OFF;
+  }
+  Plan->StartOffset = Value;
+
+  printf("                    Enter end offset in hex, last byte of a sector (0x0FFF to 0x%X): ", (METADATA_OFFSET - 1));
+  input_string(String);
+  Value = strtol(String, NULL, 16);
+  if ((String[0] == 0x0D) || ((Value + 1) % FLASH_SECTOR_SIZE) || (Value < Plan->StartOffset) || (Value >= METADATA_OFFSET))
+  {
+    printf("\r                    Invalid end offset entered...[0x%8.8X]\r\r", Value);
+    return FLAG_OFF;
+  }
+  Plan->EndOffset = Value;
+
+  printf("                    Enter number of write cycles (1 to 255): ");
+  input_string(String);
+  Value = atoi(String);
+  if ((Value < 1) || (Value > 255))
+  {
+    printf("\r                    Invalid number of write cycles entered...[%u]\r\r", Value);
+    return FLAG_OFF;
+  }
+  Plan->Cycles = Value;
+
+  printf("\r");
+  for (Loop1UInt8 = 0; Loop1UInt8 < PATTERN_COUNT; ++Loop1UInt8)
+    printf("                    %u) %s\r", Loop1UInt8, PatternName[Loop1UInt8]);
+  printf("                    Enter the patterns to write, in order (for example: 0125): ");
+  input_string(String);
+  Plan->PatternCount = 0;
+  for (Loop1UInt8 = 0; (String[Loop1UInt8] != 0x00) && (String[Loop1UInt8] != 0x0D) && (Plan->PatternCount < PLAN_MAX_PATTERNS); ++Loop1UInt8)
+  {
+    if ((String[Loop1UInt8] < '0') || (String[Loop1UInt8] >= ('0' + PATTERN_COUNT)))
+    {
+      printf("\r                    Invalid pattern entered...[%c]\r\r", String[Loop1UInt8]);
+      return FLAG_OFF;
+    }
+    Plan->Pattern[Plan->PatternCount++] = String[Loop1UInt8] - '0';
+  }
+  printf("\r\r");
+
+  if (Plan->PatternCount == 0) return FLAG_OFF;
+
+  return FLAG_ON;
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=kv_append() */
+/* ------------------------------------------------------------------ *\
+                Append a record to the record store.
+     NOTES:
+     - Records are programmed with flash_program() into the erased
+       space of the active sector: no erase is needed.
+     - When the active sector is full, the next sector (which is
+       always erased) becomes the active one and the oldest sector
+       is reclaimed with kv_collect().
+     - Returns 1 if the record store has not been created or if the
+       record doesn't read back correctly.
+\* ------------------------------------------------------------------ */
+UINT kv_append(UINT8 Key, UINT8 *Value, UINT16 Length)
+{
+  static UINT8 Buffer[sizeof(struct kv_record) + KV_MAX_VALUE];
+
+  struct kv_record *Record;
+  struct kv_sector_header Header;
+
+
+  if (FlagKvReady == FLAG_OFF) return 1;
+
+  /* Start a new sector if the record doesn't fit in the active one. */
+  if ((KvWriteOffset + KV_RECORD_SIZE(Length)) > (KV_OFFSET + ((KvActive + 1) * FLASH_SECTOR_SIZE)))
+  {
+    Header.Magic         = KV_MAGIC;
+    Header.Sequence      = KvSequence + 1;
+    Header.SequenceCheck = ~(KvSequence + 1);
+    Header.Reserved      = 0xFFFFFFFF;
+    if (flash_program((KV_OFFSET + (((KvActive + 1) % KV_SECTORS) * FLASH_SECTOR_SIZE)), (UINT8 *)&Header, sizeof(Header)) != 0)
+    {
+      /* Erase the partially programmed header, so that the sector following the active one is still erased. */
+      flash_erase(KV_OFFSET + (((KvActive + 1) % KV_SECTORS) * FLASH_SECTOR_SIZE));
+
+      return 1;
+    }
+
+    KvActive = (KvActive + 1) % KV_SECTORS;
+    ++KvSequence;
+    KvWriteOffset = KV_OFFSET + (KvActive * FLASH_SECTOR_SIZE) + sizeof(Header);
+
+    kv_collect();
+  }
+
+
+  /* Build the record in RAM (Value may be in flash when called by kv_collect()). */
+  Record         = (struct kv_record *)Buffer;
+  Record->Key    = Key;
+  Record->Length = Length;
+  if (Length) memcpy(&Buffer[sizeof(struct kv_record)], Value, Length);
+  Record->Crc    = crc32_update(crc32_update(0, Buffer, 4), &Buffer[sizeof(struct kv_record)], Length);
+
+  /* A record that doesn't read back correctly is left behind (kv_scan() skips it): nothing is ever programmed twice without an erase. */
+  if (flash_program(KvWriteOffset, Buffer, (sizeof(struct kv_record) + Length)) != 0)
+  {
+    KvWriteOffset += KV_RECORD_SIZE(Length);
+
+    return 1;
+  }
+
+  KvIndex[Key]   = (Length ? KvWriteOffset : 0);
+  KvWriteOffset += KV_RECORD_SIZE(Length);
+
+  return 0;
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=kv_collect() */
+/* ------------------------------------------------------------------ *\
+      Move the live records out of the oldest record store sector
+                            and erase it.
+     NOTES:
+     - The oldest sector is the one following the active sector.
+       Its records that are still the latest value of their key are
+       appended to the active sector, then it is erased and becomes
+       the spare sector used when the active sector fills up.
+     - Since all live records (KV_MAX_KEYS x KV_RECORD_SIZE(KV_MAX_VALUE)
+       bytes at most) fit in a sector with room to spare, they always
+       fit in the new active sector.
+     - If power is lost in the middle, kv_init() finds the oldest
+       sector not erased and calls kv_collect() again.
+\* ------------------------------------------------------------------ */
+void kv_collect(void)
+{
+  UINT8 Key;
+
+  UINT32 SectorOffset;
+
+  struct kv_record *Record;
+
+
+  SectorOffset = KV_OFFSET + (((KvActive + 1) % KV_SECTORS) * FLASH_SECTOR_SIZE);
+
+  for (Key = 0; Key < KV_MAX_KEYS; ++Key)
+  {
+    if ((KvIndex[Key] < SectorOffset) || (KvIndex[Key] >= (SectorOffset + FLASH_SECTOR_SIZE))) continue;
+
+    Record = (struct kv_record *)&FlashBaseAddress[KvIndex[Key]];
+    kv_append(Key, ((UINT8 *)Record + sizeof(struct kv_record)), Record->Length);
+  }
+
+  flash_erase(SectorOffset);
+
+  return;
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=kv_create() */
+/* ------------------------------------------------------------------ *\
+                       Create the record store.
+     NOTES:
+     - Only called on user's request (first flash test or command
+       mode STORE), never at power-up.
+     - Record store sectors that are not blank may hold user data:
+       they are erased only if FlagErase is FLAG_ON. Otherwise,
+       nothing is written and 2 is returned, so that caller may ask
+       user first.
+     - Returns 0 when the record store is ready, 1 if the first
+       sector header doesn't read back correctly (sector is erased
+       again and the record store is not created).
+\* ------------------------------------------------------------------ */
+UINT kv_create(UINT8 FlagErase)
+{
+  UINT8 FlagBlank[KV_SECTORS];
+  UINT8 Sector;
+
+  UINT32 Loop1UInt32;
+  UINT32 *Word;
+
+  struct kv_sector_header Header;
+
+
+  if (FlagKvReady == FLAG_ON) return 0;
+
+  /* Find the record store sectors that are not blank. */
+  for (Sector = 0; Sector < KV_SECTORS; ++Sector)
+  {
+    FlagBlank[Sector] = FLAG_ON;
+    Word = (UINT32 *)&FlashBaseAddress[KV_OFFSET + (Sector * FLASH_SECTOR_SIZE)];
+    for (Loop1UInt32 = 0; Loop1UInt32 < (FLASH_SECTOR_SIZE / sizeof(UINT32)); ++Loop1UInt32)
+      if (Word[Loop1UInt32] != 0xFFFFFFFF)
+      {
+        if (FlagErase == FLAG_OFF) return 2;
+        FlagBlank[Sector] = FLAG_OFF;
+        break;
+      }
+  }
+
+  for (Sector = 0; Sector < KV_SECTORS; ++Sector)
+    if (FlagBlank[Sector] == FLAG_OFF) flash_erase(KV_OFFSET + (Sector * FLASH_SECTOR_SIZE));
+
+
+  /* First sector becomes the active one. */
+  Header.Magic         = KV_MAGIC;
+  Header.Sequence      = 1;
+  Header.SequenceCheck = ~1;
+  Header.Reserved      = 0xFFFFFFFF;
+  if (flash_program(KV_OFFSET, (UINT8 *)&Header, sizeof(Header)) != 0)
+  {
+    flash_erase(KV_OFFSET);
+
+    return 1;
+  }
+
+  memset(KvIndex, 0x00, sizeof(KvIndex));
+  KvActive      = 0;
+  KvSequence    = 1;
+  KvWriteOffset = KV_OFFSET + sizeof(Header);
+  FlagKvReady   = FLAG_ON;
+
+  /* Keep a copy of Pico's manufacturing test results. */
+  if (FlashBaseAddress[TEST_RESULT_OFFSET] != 0xFF)
+    kv_write(KV_KEY_MANUFACTURING, &FlashBaseAddress[TEST_RESULT_OFFSET], TEST_RESULT_SIZE);
+
+  return 0;
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=kv_delete() */
+/* ------------------------------------------------------------------ *\
+                 Delete a key from the record store.
+\* ------------------------------------------------------------------ */
+UINT kv_delete(UINT8 Key)
+{
+  if ((Key >= KV_MAX_KEYS) || (KvIndex[Key] == 0)) return 0;
+
+  /* A record without value deletes the key. */
+  return kv_append(Key, NULL, 0);
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=kv_init() */
+/* ------------------------------------------------------------------ *\
+             Rebuild the record store index from flash.
+     NOTES:
+     - The sector with the highest sequence number is the active
+       one. Sectors are replayed from the oldest to the newest, so
+       that the index ends up with the latest record of each key.
+     - If no sector is found, nothing is written to flash: the record
+       store must be created with kv_create().
+\* ------------------------------------------------------------------ */
+void kv_init(void)
+{
+  UINT8 FlagFound;
+  UINT8 Loop1UInt8;
+  UINT8 Sector;
+
+  UINT32 EndOffset;
+
+  struct kv_sector_header *Header;
+
+
+  /* Initializations. */
+  memset(KvIndex, 0x00, sizeof(KvIndex));
+  FlagFound   = FLAG_OFF;
+  FlagKvReady = FLAG_OFF;
+
+
+  /* Find the active sector. */
+  for (Sector = 0; Sector < KV_SECTORS; ++Sector)
+  {
+    Header = (struct kv_sector_header *)&FlashBaseAddress[KV_OFFSET + (Sector * FLASH_SECTOR_SIZE)];
+    if ((Header->Magic != KV_MAGIC) || (Header->SequenceCheck != ~Header->Sequence)) continue;
+
+    if ((FlagFound == FLAG_OFF) || (Header->Sequence > KvSequence))
+    {
+      KvActive   = Sector;
+      KvSequence = Header->Sequence;
+      FlagFound  = FLAG_ON;
+    }
+  }
+
+
+  if (FlagFound == FLAG_OFF) return;
+  FlagKvReady = FLAG_ON;
+
+
+  /* Replay sectors from the oldest (the one following the active sector) to the active one. */
+  for (Loop1UInt8 = 1; Loop1UInt8 <= KV_SECTORS; ++Loop1UInt8)
+  {
+    Sector = (KvActive + Loop1UInt8) % KV_SECTORS;
+    Header = (struct kv_sector_header *)&FlashBaseAddress[KV_OFFSET + (Sector * FLASH_SECTOR_SIZE)];
+    if ((Header->Magic != KV_MAGIC) || (Header->SequenceCheck != ~Header->Sequence)) continue;
+
+    EndOffset = kv_scan(Sector);
+    if (Sector == KvActive) KvWriteOffset = EndOffset;
+  }
+
+  /* The sector following the active one must be erased, unless power was lost during kv_collect(). */
+  if (*(UINT32 *)&FlashBaseAddress[KV_OFFSET + (((KvActive + 1) % KV_SECTORS) * FLASH_SECTOR_SIZE)] != 0xFFFFFFFF) kv_collect();
+
+  return;
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=kv_read() */
+/* ------------------------------------------------------------------ *\
+          Read the value of a key from the record store.
+     Value must be large enough for the value stored (KV_MAX_VALUE
+     bytes at most). Its actual length is returned in Length. Returns 1 if key doesn't exist.
+\* ------------------------------------------------------------------ */
+UINT kv_read(UINT8 Key, UINT8 *Value, UINT16 *Length)
+{
+  struct kv_record *Record;
+
+
+  if ((Key >= KV_MAX_KEYS) || (KvIndex[Key] == 0)) return 1;
+
+  Record  = (struct kv_record *)&FlashBaseAddress[KvIndex[Key]];
+  *Length = Record->Length;
+  memcpy(Value, ((UINT8 *)Record + sizeof(struct kv_record)), Record->Length);
+
+  return 0;
+}
 
-  printf("=======================================================================================================\r\r\r");
 
-  return PicoType;
+
+
+
+/* $PAGE */
+/* $TITLE=kv_scan() */
+/* ------------------------------------------------------------------ *\
+        Add the records of a record store sector to the index.
+     NOTES:
+     - Records with a bad CRC32 (power lost while programming) are
+       skipped. If a record header itself is not valid, the rest of
+       the sector is considered full.
+     - Returns the flash offset following the last record.
+\* ------------------------------------------------------------------ */
+UINT32 kv_scan(UINT8 Sector)
+{
+  UINT32 EndOffset;
+  UINT32 Offset;
+
+  struct kv_record *Record;
+
+
+  Offset    = KV_OFFSET + (Sector * FLASH_SECTOR_SIZE) + sizeof(struct kv_sector_header);
+  EndOffset = KV_OFFSET + ((Sector + 1) * FLASH_SECTOR_SIZE);
+
+  for (; (Offset + sizeof(struct kv_record)) <= EndOffset; Offset += KV_RECORD_SIZE(Record->Length))
+  {
+    Record = (struct kv_record *)&FlashBaseAddress[Offset];
+    if (Record->Key == 0xFFFF) break;  // erased space, end of records.
+
+    if ((Record->Key >= KV_MAX_KEYS) || (Record->Length > KV_MAX_VALUE) || ((Offset + KV_RECORD_SIZE(Record->Length)) > EndOffset)) return EndOffset;
+
+    if (Record->Crc != crc32_update(crc32_update(0, (UINT8 *)Record, 4), ((UINT8 *)Record + sizeof(struct kv_record)), Record->Length)) continue;
+
+    KvIndex[Record->Key] = (Record->Length ? Offset : 0);
+  }
+
+  return ((Offset < EndOffset) ? Offset : EndOffset);
 }
 
 
@@ -835,58 +6632,76 @@ UINT8 display_microcontroller_id(void)
 
 
 /* $PAGE */
-/* $TITLE=display_specific_sector() */
+/* $TITLE=kv_write() */
 /* ------------------------------------------------------------------ *\
-              Display Pico's specific flash memory sector.
+          Write the value of a key to the record store.
+     NOTES:
+     - The record store is log-structured: a new record is appended
+       for every write and the index in RAM keeps track of the latest
+       one for each key, so that kv_read() doesn't search the flash.
+     - Writes are spread over KV_SECTORS sectors and a sector is
+       erased only once it has been filled up, instead of erasing a
+       sector for every write as flash_write() does.
+     - Writing the same value again doesn't write anything.
 \* ------------------------------------------------------------------ */
-void display_specific_sector(void)
+UINT kv_write(UINT8 Key, UINT8 *Value, UINT16 Length)
 {
-  UCHAR String[256];
+  struct kv_record *Record;
 
-  UINT32 SectorOffset;
 
+  if ((Key >= KV_MAX_KEYS) || (Length == 0) || (Length > KV_MAX_VALUE)) return 1;
 
-  /* Request sector to be displayed. */
-  printf("                    Enter sector offset in hex (0x000000 to 0x1FFFFF): ");
-  input_string(String);
-  SectorOffset = strtol(String, NULL, 16);
-  printf("\r\r");
-  
-  
-  /* Validate sector number entered. */
-  while (SectorOffset > 0x1FFFFF)
+  if (KvIndex[Key])
   {
-    printf("                    Invalid sector offset entered...[0x%5.5X]\r", SectorOffset);
-    printf("                    Sector offset must be a value in hexadecimal between 0 and 1FFFFF\r");
-    printf("                    Enter sector offset (or <Enter> to return to menu): ");
-    input_string(String);
-    if (String[0] == 0x0D) break;  // if user pressed <Enter> only.
-    SectorOffset = strtol(String, NULL, 16);
+    Record = (struct kv_record *)&FlashBaseAddress[KvIndex[Key]];
+    if ((Record->Length == Length) && (memcmp(((UINT8 *)Record + sizeof(struct kv_record)), Value, Length) == 0)) return 0;
   }
-  if (String[0] == 0x0D) return;  // if user pressed <Enter> only.
 
-  
-  /* Make sure display begins on a sector boundary. */
-  while ((SectorOffset % FLASH_SECTOR_SIZE) != 0)
-    --SectorOffset;
+  return kv_append(Key, Value, Length);
+}
 
-  
-  printf("=======================================================================================================\r");
-  sprintf(String, "Display Pico's flash memory sector:\r");
-  uart_send(__LINE__, String);
-  
-  sprintf(String, "XIP_BASE: 0x%p   Offset: 0x%6.6X   Length: 0x%X (%u)\r", XIP_BASE, SectorOffset, FLASH_SECTOR_SIZE, FLASH_SECTOR_SIZE);
-  uart_send(__LINE__, String);
 
-  sprintf(String, "(Note: Pico's flash memory space goes from 0x10000000 to 0x101FFFFF)\r\r");
-  uart_send(__LINE__, String);
 
-  display_memory(XIP_BASE, SectorOffset, FLASH_SECTOR_SIZE);
 
-  printf("\r");
-  sprintf(String, "End of flash specific sector display.\r");
-  uart_send(__LINE__, String);
-  printf("=======================================================================================================\r\r\r");
+
+/* $PAGE */
+/* $TITLE=latency_record() */
+/* ------------------------------------------------------------------ *\
+     Record the duration of an erase or program operation for the
+                    sector or block it covered.
+     NOTES:
+     - Called right after each flash_range_erase() and
+       flash_range_program(), so it must be kept short: a few
+       additions, one compare and a count leading zeros instruction
+       for the histogram bucket.
+     - Each kind of operation has its own statistics: a 64 KB block
+       erase (LATENCY_BLOCK_ERASE) is kept for its block and is never
+       spread over its sectors, so that it is only compared with
+       other block erases.
+\* ------------------------------------------------------------------ */
+void latency_record(UINT8 Operation, UINT32 Offset, UINT32 Duration)
+{
+  UINT8 Bucket;
+
+  struct latency_stats *Stats;
+
+
+  /* Histogram counts each flash command issued. */
+  Bucket = (Duration == 0) ? 0 : (32 - __builtin_clz(Duration));
+  if (Bucket >= LATENCY_BUCKETS) Bucket = LATENCY_BUCKETS - 1;
+  ++LatencyHistogram[Operation][Bucket];
+
+  /* Latency is captured for the first 2 MB only, to save RAM on larger flash IC. */
+  if (Offset >= PICO_FLASH_SIZE_BYTES) return;
+
+  if (Operation == LATENCY_BLOCK_ERASE)
+    Stats = &BlockLatency[Offset / FLASH_BLOCK_SIZE];
+  else
+    Stats = &SectorLatency[Offset / FLASH_SECTOR_SIZE][Operation];
+
+  Stats->Total += Duration;
+  ++Stats->Count;
+  if (Duration > Stats->Max) Stats->Max = Duration;
 
   return;
 }
@@ -896,70 +6711,137 @@ void display_specific_sector(void)
 
 
 /* $PAGE */
-/* $TITLE=erase_all_flash() */
+/* $TITLE=latency_report() */
 /* ------------------------------------------------------------------ *\
-                 Erase Pico's whole flash address space
-                except Pico's manufacturing test results.
+      Display latency histogram and outlier sectors for erase and
+                        program operations.
+     NOTES:
+     - Erase time growing with wear is the earliest sign of a failing
+       flash IC. Sectors whose average latency is well above the
+       overall average are listed as outliers.
+     - Histogram buckets are powers of 2 (in usec), bucket "< 2^n"
+       counts the operations from 2^(n-1) to (2^n - 1) usec.
+     - Sector erase, sector program and block erase are reported
+       separately: outliers of each kind are found against the
+       average of the same kind only.
 \* ------------------------------------------------------------------ */
-void erase_all_flash(UINT8 FlagUnattended)
+void latency_report(void)
 {
   UCHAR String[256];
+  UCHAR *OperationName[LATENCY_OPERATIONS] = {"Sector erase", "Sector program", "Block erase"};
 
-  UINT8 Loop1UInt8;
+  UINT8 Bucket;
+  UINT8 Operation;
 
-  UINT32 Loop1UInt32;
-  UINT32 StartOffset;
-  UINT32 EndOffset;
-  
-  
-  /* Initializations. */
-  StartOffset = 0x00000000;
-  EndOffset   = 0x001FFFFF;
+  UINT16 Length;
+  UINT16 Loop1UInt16;
+  UINT16 Outliers;
+  UINT16 Sectors;
 
+  UINT32 Average;
+  UINT32 OverallAverage;
+  UINT32 PeakCount;
+  UINT32 Sector;
+  UINT32 UnitCount;
+  UINT32 UnitSize;
 
-  if (FlagUnattended == FLAG_OFF)
-  {
-    printf("                    This will erase Pico's whole flash address space except Pico's manufacturing test results.\r");
-    printf("                    Are you sure you want to proceed <Y/N>: ");
-    input_string(String);
-    if ((strcmp(String, "Y") != 0) && (strcmp(String, "y") != 0))
-      return;
-  }
+  UINT64 SumAverage;
 
+  struct latency_stats *Stats;
 
-  if (((void *)main < (void *)0x20000000) || ((void *)main > (void *)0x20041FFF))
+
+  for (Operation = 0; Operation < LATENCY_OPERATIONS; ++Operation)
   {
-    sprintf(String, "<<<<< FATAL >>>>> YOU CAN'T ERASE FLASH MEMORY WHILE YOU RUN THE APPLICATION FROM FLASH.\r");
+    /* Block erases are kept per block, other operations per sector. */
+    UnitCount = ((Operation == LATENCY_BLOCK_ERASE) ? LATENCY_BLOCKS   : LATENCY_SECTORS);
+    UnitSize  = ((Operation == LATENCY_BLOCK_ERASE) ? FLASH_BLOCK_SIZE : FLASH_SECTOR_SIZE);
+
+    printf("\r");
+    sprintf(String, "%s latency histogram (one entry per flash command):\r\r", OperationName[Operation]);
     uart_send(__LINE__, String);
 
-    sprintf(String, "                  THIS WOULD BE PROGRAM SELF-DESTRUCTION !!!\r\r\r");
+    /* Find the largest bucket to scale the bars. */
+    PeakCount = 0;
+    for (Bucket = 0; Bucket < LATENCY_BUCKETS; ++Bucket)
+      if (LatencyHistogram[Operation][Bucket] > PeakCount) PeakCount = LatencyHistogram[Operation][Bucket];
+
+    if (PeakCount == 0)
+    {
+      uart_send(__LINE__, "No data recorded.\r");
+      continue;
+    }
+
+    for (Bucket = 0; Bucket < LATENCY_BUCKETS; ++Bucket)
+    {
+      if (LatencyHistogram[Operation][Bucket] == 0) continue;
+
+      /* Bar of up to 50 characters, proportional to the number of operations in this bucket. */
+      Length = sprintf(String, "< %8lu usec: %8lu  ", (1ul << Bucket), LatencyHistogram[Operation][Bucket]);
+      for (Loop1UInt16 = 0; Loop1UInt16 < ((((UINT64)LatencyHistogram[Operation][Bucket] * 50) + PeakCount - 1) / PeakCount); ++Loop1UInt16)
+        String[Length++] = '#';
+      String[Length++] = '\r';
+      String[Length]   = 0x00;
+      uart_send(__LINE__, String);
+    }
+
+
+    /* Overall average of all sectors' (or blocks') average latency. */
+    SumAverage = 0;
+    Sectors    = 0;
+    for (Sector = 0; Sector < UnitCount; ++Sector)
+    {
+      Stats = ((Operation == LATENCY_BLOCK_ERASE) ? &BlockLatency[Sector] : &SectorLatency[Sector][Operation]);
+      if (Stats->Count == 0) continue;
+      SumAverage += (Stats->Total / Stats->Count);
+      ++Sectors;
+    }
+    OverallAverage = (Sectors ? (UINT32)(SumAverage / Sectors) : 0);
+
+    printf("\r");
+    sprintf(String, "%u %s, overall average: %lu usec per command. Outliers (average above %u%%):\r", Sectors, ((Operation == LATENCY_BLOCK_ERASE) ? "blocks" : "sectors"), OverallAverage, LATENCY_OUTLIER);
     uart_send(__LINE__, String);
 
-    return;
-  }
+    Outliers = 0;
+    for (Sector = 0; Sector < UnitCount; ++Sector)
+    {
+      Stats = ((Operation == LATENCY_BLOCK_ERASE) ? &BlockLatency[Sector] : &SectorLatency[Sector][Operation]);
+      if (Stats->Count == 0) continue;
 
+      Average = Stats->Total / Stats->Count;
+      if (((UINT64)Average * 100) <= ((UINT64)OverallAverage * LATENCY_OUTLIER)) continue;
 
-  printf("=======================================================================================================\r");
-  sprintf(String, "Erase Pico's whole flash address space.\r");
-  uart_send(__LINE__, String);
-  
-  sprintf(String, "XIP_BASE: 0x%p   StartOffset: 0x%8.8X   EndOffset: 0x%8.8X (%u)\r\r", XIP_BASE, StartOffset, EndOffset, EndOffset);
-  uart_send(__LINE__, String);
+      if (++Outliers > LATENCY_MAX_REPORT) continue;
+      sprintf(String, "%s offset 0x%8.8X   count: %5u   average: %8lu usec   max: %8lu usec\r", ((Operation == LATENCY_BLOCK_ERASE) ? "Block " : "Sector"), Sector * UnitSize, Stats->Count, Average, Stats->Max);
+      uart_send(__LINE__, String);
+    }
 
-  printf("Erasing sectors...\r");
-  for (Loop1UInt32 = StartOffset; Loop1UInt32 < EndOffset; Loop1UInt32 += 0x1000)
-  {
-    printf("0x%8.8X   ", Loop1UInt32);
-    if (((Loop1UInt32 + 0x1000) % 0x8000) == 0) printf("\r");
-    flash_erase(Loop1UInt32);
+    if (Outliers == 0)
+      uart_send(__LINE__, "None.\r");
+    else if (Outliers > LATENCY_MAX_REPORT)
+    {
+      sprintf(String, "... and %u more.\r", Outliers - LATENCY_MAX_REPORT);
+      uart_send(__LINE__, String);
+    }
   }
+  printf("\r");
 
+  return;
+}
 
-  printf("\r");
-  sprintf(String, "End erasing whole flash address space.\r");
-  uart_send(__LINE__, String);
-  printf("=======================================================================================================\r\r\r");
-  printf("\r\r");
+
+
+
+
+/* $PAGE */
+/* $TITLE=latency_reset() */
+/* ------------------------------------------------------------------ *\
+                  Clear all per-sector latency data.
+\* ------------------------------------------------------------------ */
+void latency_reset(void)
+{
+  memset(SectorLatency,    0x00, sizeof(SectorLatency));
+  memset(BlockLatency,     0x00, sizeof(BlockLatency));
+  memset(LatencyHistogram, 0x00, sizeof(LatencyHistogram));
 
   return;
 }
@@ -969,66 +6851,166 @@ void erase_all_flash(UINT8 FlagUnattended)
 
 
 /* $PAGE */
-/* $TITLE=erase_specific_sector() */
+/* $TITLE=log_drain() */
 /* ------------------------------------------------------------------ *\
-               Erase a specific sector of Pico's flash.
+          Send a chunk of the log buffer to the terminal.
+     NOTES:
+     - Called by core 1 whenever it has no job to execute, so that
+       core 0 never waits for USB CDC or UART to send its output.
+     - Data is sent to both USB CDC and UART drivers, the same way
+       printf() did before the log buffer was introduced.
+     - This is the only USB call made by core 1. It is serialized with
+       the ones of core 0 through UsbMutex.
 \* ------------------------------------------------------------------ */
-void erase_specific_sector(void)
+void __not_in_flash_func(log_drain)(void)
 {
-  UCHAR String[256];
+  UINT32 Length;
+  UINT32 Position;
 
-  UINT32 SectorOffset;
 
-  
-  printf("                    Enter offset of the sector to erase in hex (or <Enter> to return to menu): ");
-  input_string(String);
-  SectorOffset = strtol(String, NULL, 16);
-  printf("\r\r");
+  if (LogTail == LogHead) return;
+  __dmb();
 
-  while (SectorOffset % 4096)
-  {
-    printf("                    Invalid sector offset entered...[0x%5.5X]\r", SectorOffset);
-    printf("                    Sector offset must be aligned on a sector boundary (0x3000, 0xB000, 0x7A000, 1EC000)\r");
-    printf("                    Enter offset of the sector to erase in hex (or <Enter> to return to menu): ");
-    input_string(String);
-    if (String[0] == 0x0D) break;  // if user pressed <Enter> only.
-    SectorOffset = strtol(String, NULL, 16);
-  }
-  if (String[0] == 0x0D) return;  // if user pressed <Enter> only.
+  /* Send at most one chunk, without wrapping around the end of the log buffer. */
+  Position = LogTail % LOG_BUFFER_SIZE;
+  Length   = LogHead - LogTail;
+  if (Length > (LOG_BUFFER_SIZE - Position)) Length = (LOG_BUFFER_SIZE - Position);
+  if (Length > LOG_CHUNK_SIZE)               Length = LOG_CHUNK_SIZE;
 
-  
-  printf("=======================================================================================================\r");
-  sprintf(String, "Erase Pico's specific flash memory sector at offset 0x%8.8X\r", SectorOffset);
-  uart_send(__LINE__, String);
-  
-  sprintf(String, "XIP_BASE: 0x%p   Offset: 0x%6.6X   Length: 0x%X (%u)\r", XIP_BASE, SectorOffset, FLASH_SECTOR_SIZE, FLASH_SECTOR_SIZE);
-  uart_send(__LINE__, String);
+  recursive_mutex_enter_blocking(&UsbMutex);
+  stdio_usb.out_chars((const char *)&LogBuffer[Position], Length);
+  recursive_mutex_exit(&UsbMutex);
+  stdio_uart.out_chars((const char *)&LogBuffer[Position], Length);
 
-  sprintf(String, "(Note: Pico's flash memory space goes from 0x10000000 to 0x101FFFFF)\r\r");
-  uart_send(__LINE__, String);
+  /* Release this part of the log buffer. */
+  __dmb();
+  LogTail += Length;
 
-  display_memory(XIP_BASE, SectorOffset, FLASH_SECTOR_SIZE);
-  
-  printf("\r\r");
-  printf("                    Are you sure you want to erase this sector <Y/N>: ");
-  input_string(String);
-  if ((strcmp(String, "Y") != 0) && (strcmp(String, "y") != 0))
-    return;
+  return;
+}
 
-  printf("\r\r");
-  printf("=======================================================================================================\r");
-  sprintf(String, "Erase a specific sector of Pico's flash at offset 0x%8.8X.\r", SectorOffset);
-  uart_send(__LINE__, String);
-  
-  sprintf(String, "XIP_BASE: 0x%p   Offset: 0x%X  Length: 0x%X (%u)\r", XIP_BASE, SectorOffset, FLASH_SECTOR_SIZE, FLASH_SECTOR_SIZE);
-  uart_send(__LINE__, String);
 
-  flash_erase(SectorOffset);
-  
-  printf("\r");
-  sprintf(String, "End of erase specific flash sector.\r");
-  uart_send(__LINE__, String);
-  printf("=======================================================================================================\r\r\r");
+
+
+
+/* $PAGE */
+/* $TITLE=log_flush() */
+/* ------------------------------------------------------------------ *\
+      Wait until the log buffer has been completely sent to the
+                              terminal.
+\* ------------------------------------------------------------------ */
+void log_flush(void)
+{
+  if (FlagLogActive == FLAG_OFF) return;
+
+  while (LogTail != LogHead)
+    tight_loop_contents();
+
+  return;
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=log_in_chars() */
+/* ------------------------------------------------------------------ *\
+    stdio driver input function: read characters from USB CDC or UART.
+     Since USB CDC and UART stdio drivers are disabled while the log
+     buffer is active, input is read from them through this function.
+\* ------------------------------------------------------------------ */
+int log_in_chars(char *Buffer, int Length)
+{
+  int Count;
+
+
+  recursive_mutex_enter_blocking(&UsbMutex);
+  Count = stdio_usb.in_chars(Buffer, Length);
+  recursive_mutex_exit(&UsbMutex);
+  if (Count > 0) return Count;
+
+  return stdio_uart.in_chars(Buffer, Length);
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=log_out_chars() */
+/* ------------------------------------------------------------------ *\
+    stdio driver output function: write characters to the log buffer.
+\* ------------------------------------------------------------------ */
+void log_out_chars(const char *Buffer, int Length)
+{
+  log_write((const UCHAR *)Buffer, Length);
+
+  return;
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=log_write() */
+/* ------------------------------------------------------------------ *\
+      Write data to the log buffer, according to the log policy.
+     NOTES:
+     - Called on core 0 only (through printf() or uart_send()).
+     - When the log buffer usage goes above LOG_HIGH_WATER:
+       - LOG_POLICY_BLOCK: wait for core 1 to send more data to the
+                           terminal (nothing is lost).
+       - LOG_POLICY_DROP:  data is dropped and counted. A note giving
+                           the number of bytes dropped is added to
+                           the log as soon as there is room again.
+     - Log policy may be changed at run time with the LOG command of
+       command_mode().
+\* ------------------------------------------------------------------ */
+void log_write(const UCHAR *Data, UINT32 Length)
+{
+  UCHAR String[64];
+
+  UINT32 Loop1UInt32;
+
+
+  /* Long strings are written one chunk at a time so that they always fit below high water. */
+  while (Length > LOG_CHUNK_SIZE)
+  {
+    log_write(Data, LOG_CHUNK_SIZE);
+    Data   += LOG_CHUNK_SIZE;
+    Length -= LOG_CHUNK_SIZE;
+  }
+
+  if (LogPolicy == LOG_POLICY_DROP)
+  {
+    if (((LogHead - LogTail) + Length) > LOG_HIGH_WATER)
+    {
+      LogDropped += Length;
+      return;
+    }
+
+    /* Room is available again, tell how many bytes have been dropped. */
+    if (LogDropped != LogDroppedReported)
+    {
+      sprintf(String, "\r<<< Log: %lu bytes dropped >>>\r", (LogDropped - LogDroppedReported));
+      LogDroppedReported = LogDropped;
+      log_write(String, strlen(String));
+    }
+  }
+  else
+  {
+    while (((LogHead - LogTail) + Length) > LOG_HIGH_WATER)
+      tight_loop_contents();
+  }
+
+  for (Loop1UInt32 = 0; Loop1UInt32 < Length; ++Loop1UInt32)
+    LogBuffer[(LogHead + Loop1UInt32) % LOG_BUFFER_SIZE] = Data[Loop1UInt32];
+
+  /* Make data visible to core 1 before releasing it. */
+  __dmb();
+  LogHead += Length;
 
   return;
 }
@@ -1038,137 +7020,104 @@ void erase_specific_sector(void)
 
 
 /* $PAGE */
-/* $TITLE=flash_blank_check() */
+/* $TITLE=pattern_fill() */
 /* ------------------------------------------------------------------ *\
-                 Check if flash area is blank (0xFF).
+    Fill a sector-sized buffer with the test pattern of a flash sector.
 \* ------------------------------------------------------------------ */
-UINT64 flash_blank_check(void)
+void pattern_fill(UINT8 Pattern, UINT8 Cycle, UINT32 SectorOffset, UINT8 *Buffer)
 {
-  UCHAR String[256];
+  UINT16 Loop1UInt16;
 
-  UINT8  FlagDirt;
-  UINT8  FlagSkipLine;
-  UINT8  FlagStarted;
+  struct pattern_generator Generator;
 
-  UINT32 StartOffset;
-  UINT32 EndOffset;
-  UINT32 Loop1UInt32;
-  UINT32 Loop2UInt32;
 
-  UINT64 TotalErrors;
+  pattern_start(&Generator, Pattern, Cycle, SectorOffset);
+  for (Loop1UInt16 = 0; Loop1UInt16 < FLASH_SECTOR_SIZE; Loop1UInt16 += 4)
+    *(UINT32 *)&Buffer[Loop1UInt16] = pattern_next(&Generator);
 
+  return;
+}
 
-  /* Initializations. */
-  StartOffset = 0x00000000;
-  EndOffset   = 0x001FFFFF;
-  FlagStarted = FLAG_OFF;
-  TotalErrors = 0;
 
 
-  /***
-  // This block would allow for a restricted flash blank test, but I didn't see a great utility for it.
-  // Since this function may be called from the option 6 "macro", asking for a start address from user would require
-  // a small change to remain unattended.
-  printf("                    Enter start offset for flash blank check (in hex): ");
-  input_string(String);
-  StartOffset = strtol(String, NULL, 16);
 
-  // Validate sector number entered.
-  while (StartOffset > 0x1FFFFF)
-  {
-    printf("                    Invalid start offset entered...[0x%8.8X]\r", StartOffset);
-    printf("                    Start offset must be an hexadecimal value between 000000 and 1FFFFF\r");
-    printf("                    Enter start offset (or press <Enter> to return to menu): ");
-    input_string(String);
-    if (String[0] == 0x0D) break;  // if user pressed <Enter> only.
-    StartOffset = strtol(String, NULL, 16);
-  }
-  if (String[0] == 0x0D) break;  // if user pressed <Enter> only.
-  printf("\r\r");
-  ***/
 
+/* $PAGE */
+/* $TITLE=pattern_next() */
+/* ------------------------------------------------------------------ *\
+            Generate the next 32-bit word of a test pattern.
+     NOTES:
+     - Words are little endian: the first byte in flash is the least
+       significant byte of the word.
+     - <offset in data> and <inverted offset in data> store in each
+       word its own flash offset (or its complement), so that address
+       line faults and aliasing show up as mismatches.
+     - <pseudo-random> is a xorshift32 stream, reseeded at the start
+       of every sector from the sector number and the write cycle, so
+       that any sector may be regenerated on its own.
+     - Called by both cores (core 1 runs verification jobs).
+\* ------------------------------------------------------------------ */
+UINT32 __not_in_flash_func(pattern_next)(struct pattern_generator *Generator)
+{
+  UINT32 Word;
 
-  printf("======================================================================================================\r");
-  uart_send(__LINE__, "Pico's flash blank check.\r");
-   
-  sprintf(String, "XIP_BASE: 0x%p   StartOffset: 0x%8.8X   EndOffset: 0x%8.8X\r\r", XIP_BASE, StartOffset, EndOffset);
-  uart_send(__LINE__, String);
 
-  
-  FlagSkipLine = FLAG_OFF;
-  for (Loop1UInt32 = StartOffset; Loop1UInt32 < EndOffset; Loop1UInt32 += 16)
+  switch (Generator->Pattern)
   {
-    /* Check if this range is blank. */
-    FlagDirt = FLAG_OFF;
-    for (Loop2UInt32 = 0; Loop2UInt32 < 16; ++Loop2UInt32)
-    {
-      if (FlashBaseAddress[Loop1UInt32 + Loop2UInt32] != 0xFF)
-      {
-        ++TotalErrors;
-        FlagDirt     = FLAG_ON;
-        FlagSkipLine = FLAG_OFF;
-      }
-    }
-      
-    if (FlagDirt == FLAG_OFF)
-    {
-      if (FlagSkipLine == FLAG_OFF)
-      {
-        FlagSkipLine = FLAG_ON;
-        
-        /* Prevent line feed on first pass. */
-        if (FlagStarted == FLAG_ON) printf("\r");
-      }
-    }
-    else
-    {
-      FlagSkipLine = FLAG_OFF;
-    }
+    case (PATTERN_00):
+      Word = 0x00000000;
+    break;
 
+    case (PATTERN_55):
+      Word = 0x55555555;
+    break;
 
-    /* Range is not blank, display it. */
-    if (FlagDirt)
-    {
-      /* Display start address. */
-      sprintf(String, " [%p] ", XIP_BASE + Loop1UInt32);
+    case (PATTERN_AA):
+      Word = 0xAAAAAAAA;
+    break;
 
-      /* Display data in hex. */
-      for (Loop2UInt32 = 0; Loop2UInt32 < 16; ++Loop2UInt32)
-        sprintf(&String[strlen(String)], "%2.2X ", FlashBaseAddress[Loop1UInt32 + Loop2UInt32]);
+    case (PATTERN_55AA):
+      Word = 0xAA55AA55;
+    break;
 
+    case (PATTERN_AA55):
+      Word = 0x55AA55AA;
+    break;
 
-      /* Display separator. */
-      sprintf(&String[strlen(String)], "| ");
+    case (PATTERN_WALKING_ONES):
+      Word = (Generator->Offset & 0x04) ? 0x80402010 : 0x08040201;
+    break;
 
+    case (PATTERN_ADDRESS):
+      Word = Generator->Offset;
+    break;
 
-      /* Display data in ASCII if displayable character, or <.> if not displayable. */
-      for (Loop2UInt32 = 0; Loop2UInt32 < 16; ++Loop2UInt32)
+    case (PATTERN_ADDRESS_INV):
+      Word = ~Generator->Offset;
+    break;
+
+    case (PATTERN_PRNG):
+      /* Seed for this sector (xorshift32 state must not be zero). */
+      if ((Generator->Offset % FLASH_SECTOR_SIZE) == 0)
       {
-        if ((FlashBaseAddress[Loop1UInt32 + Loop2UInt32] >= 0x20) && (FlashBaseAddress[Loop1UInt32 + Loop2UInt32] <= 0x7E) && (FlashBaseAddress[Loop1UInt32 + Loop2UInt32] != 0x25))
-        {
-          sprintf(&String[strlen(String)], "%c", FlashBaseAddress[Loop1UInt32 + Loop2UInt32]);
-        }
-        else
-        {
-          sprintf(&String[strlen(String)], ".");
-        }
+        Generator->State = ((Generator->Cycle + 1) * 0x9E3779B9) ^ ((Generator->Offset / FLASH_SECTOR_SIZE) * 0x85EBCA6B);
+        if (Generator->State == 0) Generator->State = 0x2545F491;
       }
-      /* Add a final linefeed. */
-      sprintf(&String[strlen(String)], "\r");
-      uart_send(__LINE__, String);
-    }
 
-    FlagStarted = FLAG_ON;
+      Generator->State ^= Generator->State << 13;
+      Generator->State ^= Generator->State >> 17;
+      Generator->State ^= Generator->State << 5;
+      Word = Generator->State;
+    break;
+
+    default:
+      Word = 0xFFFFFFFF;
+    break;
   }
 
-  printf("\r");
-  sprintf(String, "End of Pico's flash blank check from offset 0x%8.8X to offset 0x%8.8X\r", StartOffset, EndOffset);
-  uart_send(__LINE__, String);
-  sprintf(String, "Total errors found: %llu (0x%X) (see documentation)\r", TotalErrors, TotalErrors);
-  uart_send(__LINE__, String);
-  printf("========================================================================================================\r\r\r");
+  Generator->Offset += 4;
 
-  return TotalErrors;
+  return Word;
 }
 
 
@@ -1176,64 +7125,63 @@ UINT64 flash_blank_check(void)
 
 
 /* $PAGE */
-/* $TITLE=flash_erase() */
+/* $TITLE=pattern_start() */
 /* ------------------------------------------------------------------ *\
-                  Erase data in Pico's flash memory.
-     NOTES:
-     - The way the electronics is done, one sector of the flash
-       (4096 bytes) must be erased at a time.
-     - This function has been kept simple and one sector (4096 bytes)
-       will be erased, beginning at the specified offset, which must
-       be aligned on a sector boundary (4096).
+            Initialize a pattern generator at a flash offset.
+     NOTE: Offset must be aligned on 32 bits. When it is not aligned
+           on a sector boundary, the <pseudo-random> stream is
+           advanced from the beginning of the sector.
 \* ------------------------------------------------------------------ */
-void flash_erase(UINT32 FlashMemoryOffset)
+void __not_in_flash_func(pattern_start)(struct pattern_generator *Generator, UINT8 Pattern, UINT8 Cycle, UINT32 Offset)
 {
-  UCHAR String[256];
+  Generator->Pattern = Pattern;
+  Generator->Cycle   = Cycle;
+  Generator->Offset  = Offset;
 
-  UINT16 Loop1UInt16;
+  if ((Pattern == PATTERN_PRNG) && (Offset % FLASH_SECTOR_SIZE))
+  {
+    Generator->Offset = Offset - (Offset % FLASH_SECTOR_SIZE);
+    while (Generator->Offset < Offset)
+      pattern_next(Generator);
+  }
 
-  UINT32 InterruptMask;
+  return;
+}
 
 
-  /* Erase a sector of Pico's flash memory.
-     FlashMemoryOffset is the offset in flash memory (relative to XIP_BASE) and must be aligned on a sector boundary (a multiple of 4096). */
-  if (FlashMemoryOffset % FLASH_SECTOR_SIZE)
-  {
-    sprintf(String, "Offset specified for flash_erase(0x%8.8X) is not aligned on a sector boundary (multiple of 4096)\r", FlashMemoryOffset);
-    uart_send(__LINE__, String);
 
-    while (FlashMemoryOffset % FLASH_SECTOR_SIZE)
-      ++FlashMemoryOffset;
 
-    sprintf(String, "Offset has been shifted to 0x%8.8X\r", FlashMemoryOffset);
-    uart_send(__LINE__, String);
-  }
 
+/* $PAGE */
+/* $TITLE=pipeline_post() */
+/* ------------------------------------------------------------------ *\
+                         Post a job to core 1.
+     If the queue is full, wait for core 1 to complete a job. Returns
+     the job posted, so that its result may be checked once it has
+     been completed (see pipeline_wait()).
+\* ------------------------------------------------------------------ */
+struct pipeline_job *pipeline_post(UINT8 Type, UINT32 Offset, UINT32 Length, UINT8 Pattern, UINT8 Cycle, UINT8 *Data)
+{
+  struct pipeline_job *Job;
 
-  /* Special handling of sector 0x7F000 containing Pico's manufacturing test results.
-     If flash_erase() is called for sector 0x7F000, it is converted to a flash_write() with all 0xFF.
-     flash_write() will take care of keeping Pico's manufacturing test results unchanged. */
-  if (FlashMemoryOffset == 0x7F000)
-  {
-    /* Set all bytes to be written to flash equal to 0xFF. */
-    memset(FlashNewData, 0xFF, FLASH_SECTOR_SIZE);
-    
-    /* Write this sector to flash. (NOTE: flash_write() will take care of keeping Pico's manufacturing test results unchanged). */
-    flash_write(0x7F000, FlashNewData, FLASH_SECTOR_SIZE);
-  }
-  else
-  {
-    /* Keep track of interrupt mask on entry. */
-    InterruptMask = save_and_disable_interrupts();
 
-    /* Erase flash area. */
-    flash_range_erase(FlashMemoryOffset, FLASH_SECTOR_SIZE);
+  while ((UINT16)(PipelineHead - PipelineTail) >= PIPELINE_QUEUE_SIZE)
+    tight_loop_contents();
 
-    /* Restore original interrupt mask when done. */
-    restore_interrupts(InterruptMask);
-  }
+  Job = &PipelineJob[PipelineHead % PIPELINE_QUEUE_SIZE];
+  Job->Type        = Type;
+  Job->Offset      = Offset;
+  Job->Length      = Length;
+  Job->Pattern     = Pattern;
+  Job->Cycle       = Cycle;
+  Job->Data        = Data;
+  Job->Result      = 0;
 
-  return;
+  /* Make the job visible to core 1 before posting it. */
+  __dmb();
+  ++PipelineHead;
+
+  return Job;
 }
 
 
@@ -1241,280 +7189,245 @@ void flash_erase(UINT32 FlashMemoryOffset)
 
 
 /* $PAGE */
-/* $TITLE=flash_test() */
+/* $TITLE=pipeline_sector_failed() */
 /* ------------------------------------------------------------------ *\
-                 Perform a test of all flash memory.
+      Check if core 1 found an error in a sector and clear its flag.
+     NOTE: Must be called after pipeline_wait().
 \* ------------------------------------------------------------------ */
-void flash_test(void)
+UINT8 pipeline_sector_failed(UINT32 SectorOffset)
 {
-  UCHAR  Dum1Str[2];
-  UCHAR  String[256];
-  
-  UINT8  Loop2UInt8;
+  UINT32 Sector;
 
-  UINT16 Loop1UInt16;
 
-  UINT32 Loop1UInt32;
-  UINT32 SectorOffset;
+  Sector = SectorOffset / FLASH_SECTOR_SIZE;
+  if ((PipelineSectorFlags[Sector / 32] & (1u << (Sector % 32))) == 0)
+    return FLAG_OFF;
 
-  UINT64 EndOffset;
-  UINT64 StartOffset;
-  UINT64 TotalErrors;
-  
+  PipelineSectorFlags[Sector / 32] &= ~(1u << (Sector % 32));
 
-  /* ----------------------------------------------------- *\
-                Present instructions to user.
-  \* ----------------------------------------------------- */
-  printf("=======================================================================================================\r");
-  uart_send(__LINE__, "Pico's flash memory test will perform five (5) complete memory write cycles\r");
-  uart_send(__LINE__, "For each cycle, the following actions will be executed:\r\r")   ;
-  uart_send(__LINE__, " 1) Flash memory will be erased.\r");
-  uart_send(__LINE__, " 2) A blank check will be done.\r");
-  uart_send(__LINE__, " 3) Bytes 0x00 will be written to all flash memory space.\r");
-  uart_send(__LINE__, " 4) Flash will be read back to check if all memory content is 0x00.\r\r");
-  
-  uart_send(__LINE__, " 5) Flash memory will be erased.\r");
-  uart_send(__LINE__, " 6) A blank check will be done.\r");
-  uart_send(__LINE__, " 7) Bytes 0x55 will be written to all flash memory space.\r");
-  uart_send(__LINE__, " 8) Flash will be read back to check if all memory content is 0x55.\r\r");
-  
-  uart_send(__LINE__, " 9) Flash memory will be erased.\r");
-  uart_send(__LINE__, "10) A blank check will be done.\r");
-  uart_send(__LINE__, "11) Bytes 0xAA will be written to all flash memory space.\r");
-  uart_send(__LINE__, "12) Flash will be read back to check if all memory content is 0xAA.\r\r");
-  
-  uart_send(__LINE__, "13) Flash memory will be erased.\r");
-  uart_send(__LINE__, "14) A blank check will be done.\r");
-  uart_send(__LINE__, "15) Consecutive bytes 0x55 and 0xAA will be written to all flash memory space.\r");
-  uart_send(__LINE__, "16) Flash will be read back to check if all memory content is 0x55 and 0xAA.\r\r");
-  
-  uart_send(__LINE__, "17) Flash memory will be erased.\r");
-  uart_send(__LINE__, "18) A blank check will be done.\r");
-  uart_send(__LINE__, "19) Consecutive bytes 0xAA and 0x55 will be written to all flash memory space.\r");
-  uart_send(__LINE__, "20) Flash will be read back to check if all memory content is 0xAA and 0x55.\r\r");
-  
-  uart_send(__LINE__, "If any error is detected during the process, it will be reported.\r");
-  uart_send(__LINE__, "Also, data will be saved to log file at each step of the process.\r\r");
-  uart_send(__LINE__, "NOTE: Write to Pico's flash memory is limited to more or less 100,000 cycles.\r");
-  uart_send(__LINE__, "      Moreover, no wear leveling algorithm has been implemented in the Pico.\r");
-  uart_send(__LINE__, "      You may use this utility as required, but you should not modify it and\r");
-  uart_send(__LINE__, "      use it as a <burn-in> test and let it run for hours...\r\r");
+  return FLAG_ON;
+}
 
-  uart_send(__LINE__, "NOTE: The process takes more or less 60 minutes to complete. You may want to\r");
-  uart_send(__LINE__, "      let the system go and come back later...\r\r");
 
-  uart_send(__LINE__, "As can be seen from the steps above, for each memory write cycle, five <flash erase> will be done,\r");
-  uart_send(__LINE__, "along with five <flash write>. Since the Pico's manufacturing test result will not be overwritten\r");
-  uart_send(__LINE__, "by the Pico-Flash-Utility, 107 byte errors will be added and cumulated at every step.\r");
-  sprintf(String, "So, %u errors for <flash erase> and %u errors for <flash write> = 214 errors.\r", TEST_RESULT_SIZE, TEST_RESULT_SIZE, (TEST_RESULT_SIZE * 2));
-  uart_send(__LINE__, String);
-  sprintf(String, "Then, %u errors for each pattern written to flash, times 5 patterns = %u errors. \r", (TEST_RESULT_SIZE * 2), (TEST_RESULT_SIZE * 2 * 5));
-  uart_send(__LINE__, String);
-  sprintf(String, "Finally, %u errors for each write cycle, times %u write cycles = %u errors.\r", (TEST_RESULT_SIZE * 2 * 5), TOTAL_CYCLES, (TEST_RESULT_SIZE * 2 * 5 * TOTAL_CYCLES));
-  uart_send(__LINE__, String);
-  uart_send(__LINE__, "Consequently, it is normal to have 5350 errors reported at the end of the procedure.\r\r");
 
-  uart_send(__LINE__, "Are you sure you want to proceed <Y/N>: ");
-  input_string(String);
-  if ((strcmp(String, "Y") != 0) && (strcmp(String, "y") != 0))
-    return;
 
 
+/* $PAGE */
+/* $TITLE=pipeline_wait() */
+/* ------------------------------------------------------------------ *\
+          Wait until core 1 has completed all jobs posted.
+\* ------------------------------------------------------------------ */
+void pipeline_wait(void)
+{
+  while (PipelineTail != PipelineHead)
+    tight_loop_contents();
 
-  /* ----------------------------------------------------- *\
-                        Initializations.
-  \* ----------------------------------------------------- */
-  TotalErrors = 0;
-  StartOffset = 0x00000000;
-  EndOffset   = 0x001FFFFF;
+  /* Make sure results from core 1 are seen by core 0. */
+  __dmb();
 
+  return;
+}
 
-  /***
-  printf("\r\r");
-  printf("=======================================================================================================\r");
-  sprintf(String, "XIP_BASE: 0x%p   StartOffset: 0x%8.8llX   EndOffset: 0x%8.8llX\r\r", XIP_BASE, StartOffset, EndOffset);
-  uart_send(__LINE__, String);
-  ***/
 
 
-  
-  /* ----------------------------------------------------- *\
-                Loop for <TOTAL_CYCLES> cycles.
-  \* ----------------------------------------------------- */
-  /* Perform <TOTAL_CYCLES> complete cycles. */
-  for (WriteCycle = 0; WriteCycle < TOTAL_CYCLES; ++WriteCycle)
-  {
-    printf("\r\r\r\r\r= = = = = = = = = = = = = = = = = = = = = = = = CYCLE %u = = = = = = = = = = = = = = = = = = = = = = = =\r", WriteCycle + 1);
-    /* For each cycle, write 5 different patterns. */
-    for (Loop2UInt8 = 0; Loop2UInt8 < 5; ++Loop2UInt8)
-    {
-      /* ----------------------------------------------------- *\
-                    Erase whole flash memory space.
-      \* ----------------------------------------------------- */
-      // uart_send(__LINE__, "Erasing flash...\r");
-      erase_all_flash(FLAG_ON);
-      
-      // uart_send(__LINE__, "Flash blank check...\r");
-      TotalErrors += flash_blank_check();
 
-      /* ----------------------------------------------------- *\
-                      Write data to flash memory.
-      \* ----------------------------------------------------- */
-      printf("========================================================================================================\r");
 
-      /* For each cycle, write 5 different patterns. */
-      switch (Loop2UInt8)
-      {
-        case (0):
-          uart_send(__LINE__, "Writing 0x00 to all flash memory.\r");
-          Dum1Str[0] = 0x00;
-          Dum1Str[1] = 0x00;
-        break;
+/* $PAGE */
+/* $TITLE=profile_end() */
+/* ------------------------------------------------------------------ *\
+      Mark the end of a flash test phase and cumulate its timing.
+     NOTE: Only a few 64-bit operations are done here, so that it may
+           be called in the flash test loop without affecting the
+           timings measured.
+\* ------------------------------------------------------------------ */
+void profile_end(UINT8 Phase, UINT32 Bytes)
+{
+  UINT32 Duration;
+  UINT32 SectorTime;
 
-        case (1):
-          uart_send(__LINE__, "Writing 0x55 to all flash memory.\r");
-          Dum1Str[0] = 0x55;
-          Dum1Str[1] = 0x55;
-        break;
 
-        case (2):
-          uart_send(__LINE__, "Writing 0xAA to all flash memory.\r");
-          Dum1Str[0] = 0xAA;
-          Dum1Str[1] = 0xAA;
-        break;
+  Duration   = (UINT32)(time_us_64() - PhaseProfile[Phase].StartTime);
+  SectorTime = (UINT32)(((UINT64)Duration * FLASH_SECTOR_SIZE) / Bytes);
 
-        case (3):
-          uart_send(__LINE__, "Writing 0x55 / 0xAA to all flash memory.\r");
-          Dum1Str[0] = 0x55;
-          Dum1Str[1] = 0xAA;
-        break;
+  PhaseProfile[Phase].TotalTime  += Duration;
+  PhaseProfile[Phase].TotalBytes += Bytes;
+  ++PhaseProfile[Phase].Runs;
+  if (SectorTime < PhaseProfile[Phase].MinSectorTime) PhaseProfile[Phase].MinSectorTime = SectorTime;
+  if (SectorTime > PhaseProfile[Phase].MaxSectorTime) PhaseProfile[Phase].MaxSectorTime = SectorTime;
 
-        case (4):
-          uart_send(__LINE__, "Writing 0xAA / 0x55 to all flash memory.\r");
-          Dum1Str[0] = 0xAA;
-          Dum1Str[1] = 0x55;
-        break;
-      }
+  return;
+}
 
-      uart_send(__LINE__, "Please wait...\r");
 
-      /* Initialize data to be saved. */
-      for (Loop1UInt16 = 0; Loop1UInt16 < FLASH_SECTOR_SIZE; Loop1UInt16 += 2)
-      {
-        FlashNewData[Loop1UInt16]     = Dum1Str[0];
-        FlashNewData[Loop1UInt16 + 1] = Dum1Str[1];
-      }
 
 
-      /*** Display data to be written to flash. ***
-      printf("Data to be written to flash:\r");
-      display_memory(RAM_BASE_ADDRESS, (UINT32)(FlashNewData - (UINT8 *)0x20000000), FLASH_SECTOR_SIZE);
-      ***/
 
+/* $PAGE */
+/* $TITLE=profile_report() */
+/* ------------------------------------------------------------------ *\
+        Display the timing summary of all flash test phases.
+     NOTES:
+     - Throughput is given in MB/s (1 MB = 1,000,000 bytes).
+     - Time per sector (4096 bytes) is averaged over each run. Min and
+       max are the fastest and slowest runs of each phase. A max
+       growing away from the min from one test to the next may reveal
+       a slow or degrading flash IC.
+\* ------------------------------------------------------------------ */
+void profile_report(void)
+{
+  UCHAR String[256];
 
-      /* Overwrite all flash sectors with new data. */
-      for (SectorOffset = StartOffset; SectorOffset < EndOffset; SectorOffset += 0x1000)
-      {
-        flash_write(SectorOffset, FlashNewData, FLASH_SECTOR_SIZE);
+  UINT8 Phase;
 
-        /* If we wrote to sector containing "Pico's manufacturing test results", data has been partly overwritten. */
-        if (SectorOffset == 0x7F000)
-        {
-          for (Loop1UInt16 = 0; Loop1UInt16 < TEST_RESULT_SIZE; Loop1UInt16 += 2)
-          {
-            FlashNewData[Loop1UInt16]     = Dum1Str[0];
-            FlashNewData[Loop1UInt16 + 1] = Dum1Str[1];
-          }
-        }
-      }
-  
-      uart_send(__LINE__, "Done writing to all flash memory.\r");
-      printf("========================================================================================================\r\r\r");
+  UINT32 AverageSectorTime;
 
+  float Throughput;
 
-      /* ----------------------------------------------------- *\
-             Display whole flash address space to log file.
-      \* ----------------------------------------------------- */
-      /* When all flash has been written, take a snapshot of it. */
-      display_all_flash();
+  struct job_status Status;
 
 
+  printf("\r");
+  status_read(&Status);
+  if (Status.FlagActive == FLAG_ON)
+  {
+    sprintf(String, "Job progress: %u%% after %llu sec, %llu errors found, last offset reached: 0x%8.8X.\r\r", Status.Percent, ((time_us_64() - Status.StartTime) / 1000000), Status.Errors, Status.Offset);
+    uart_send(__LINE__, String);
+  }
+  uart_send(__LINE__, "Timing summary of flash memory test phases:\r\r");
+  uart_send(__LINE__, "Phase          Runs         Bytes   Total (sec)      MB/s   Sector min (usec)   avg (usec)   max (usec)\r");
+  uart_send(__LINE__, "------------   ----   -----------   -----------   -------   -----------------   ----------   ----------\r");
 
-      /* ----------------------------------------------------- *\
-               Check all flash memory space for a match.
-      \* ----------------------------------------------------- */
-      printf("========================================================================================================\r");
-      uart_send(__LINE__, "Check all flash memory for a match with data written.\r\r");
+  for (Phase = 0; Phase < PHASE_COUNT; ++Phase)
+  {
+    if (PhaseProfile[Phase].Runs == 0) continue;
 
-      /* Check every flash byte to confirm write has been successful. */
-      for (Loop1UInt32 = 0; Loop1UInt32 < EndOffset; Loop1UInt32 += 2)
-      {
-        /* Check those 2 bytes. */
-        if (FlashBaseAddress[Loop1UInt32] != Dum1Str[0])
-        {
-          sprintf(String, "Offset: 0x%8.8X   Data read: 0x%2.2X instead of 0x%2.2X\r", Loop1UInt32, FlashBaseAddress[Loop1UInt32], Dum1Str[0]);
-          uart_send(__LINE__, String);
-          ++TotalErrors;
-        }
+    Throughput        = (float)PhaseProfile[Phase].TotalBytes / (float)PhaseProfile[Phase].TotalTime;
+    AverageSectorTime = (UINT32)((PhaseProfile[Phase].TotalTime * FLASH_SECTOR_SIZE) / PhaseProfile[Phase].TotalBytes);
 
-        if (FlashBaseAddress[Loop1UInt32 + 1] != Dum1Str[1])
-        {
-          sprintf(String, "Offset: 0x%8.8X   Data read: 0x%2.2X instead of 0x%2.2X\r", Loop1UInt32 + 1, FlashBaseAddress[Loop1UInt32 + 1], Dum1Str[1]);
-          uart_send(__LINE__, String);
-          ++TotalErrors;
-        }
-      }
-      uart_send(__LINE__, "\r");
-      
-      sprintf(String, "Total errors found so far: %u\r", TotalErrors);
-      uart_send(__LINE__, String);
+    sprintf(String, "%-12s   %4lu   %11llu   %11.3f   %7.3f   %17lu   %10lu   %10lu\r", PhaseName[Phase], PhaseProfile[Phase].Runs, PhaseProfile[Phase].TotalBytes,
+            (float)PhaseProfile[Phase].TotalTime / 1000000.0, Throughput, PhaseProfile[Phase].MinSectorTime, AverageSectorTime, PhaseProfile[Phase].MaxSectorTime);
+    uart_send(__LINE__, String);
+  }
+  printf("\r");
+
+  return;
+}
+
+
+
+
+
+/* $PAGE */
+/* $TITLE=profile_reset() */
+/* ------------------------------------------------------------------ *\
+                Clear all flash test phase timings.
+\* ------------------------------------------------------------------ */
+void profile_reset(void)
+{
+  UINT8 Phase;
+
+
+  memset(PhaseProfile, 0x00, sizeof(PhaseProfile));
+  for (Phase = 0; Phase < PHASE_COUNT; ++Phase)
+    PhaseProfile[Phase].MinSectorTime = 0xFFFFFFFF;
+
+  return;
+}
 
-      sprintf(String, "As mentionned in the documentation, %u errors until now is normal because\r", (WriteCycle * 1070) + (TEST_RESULT_SIZE * ((Loop2UInt8 + 1) * 2)));
-      uart_send(__LINE__, String);
 
-      uart_send(__LINE__, "Pico's manufacturing test result has been preserved.\r");
 
-      printf("========================================================================================================\r\r\r");
-    }
-  }
-  
-  
-  
-  /* ----------------------------------------------------- *\
-                      Final flash erase
-          to leave flash memory space clear when done.
-  \* ----------------------------------------------------- */
-  erase_all_flash(FLAG_ON);
 
 
+/* $PAGE */
+/* $TITLE=profile_start() */
+/* ------------------------------------------------------------------ *\
+                Mark the beginning of a flash test phase.
+\* ------------------------------------------------------------------ */
+void profile_start(UINT8 Phase)
+{
+  PhaseProfile[Phase].StartTime = time_us_64();
 
-  /* ----------------------------------------------------- *\
-          Display final report for flash memory test.
-  \* ----------------------------------------------------- */
-  printf("========================================================================================================\r");
-  sprintf(String, "Flash memory test final report after %u write cycles.\r\r", WriteCycle);
-  uart_send(__LINE__, String);
+  return;
+}
 
-  sprintf(String, "Total errors found: %u\r", TotalErrors);
-  uart_send(__LINE__, String);
-  
-  sprintf(String, "NOTE: %u errors is normal  since Pico's manufacturing results is not overwritten.\r", (((TEST_RESULT_SIZE * 2) * 5) * TOTAL_CYCLES));
-  uart_send(__LINE__, String);
 
-  sprintf(String, "      %u bytes for erase, %u bytes for write pattern = %U errors for each pattern written\r", TEST_RESULT_SIZE, TEST_RESULT_SIZE, (TEST_RESULT_SIZE * 2));
-  uart_send(__LINE__, String);
 
-  sprintf(String, "      %u for each pattern X 5 patterns = %u errors per write cycle (00, 55, AA, 55+AA, AA+55)\r", (TEST_RESULT_SIZE * 2), (TEST_RESULT_SIZE * 2 * 5));
-  uart_send(__LINE__, String);
 
-  sprintf(String, "      %u for each write cycle X %u cycles = %u total errors for the whole process.\r\r", (TEST_RESULT_SIZE * 2 * 5), TOTAL_CYCLES, (TEST_RESULT_SIZE * 2 * 5 * TOTAL_CYCLES));
-  uart_send(__LINE__, String);
 
-  sprintf(String, "End of flash memory test\r");
-  uart_send(__LINE__, String);
-  printf("========================================================================================================\r\r\r");
+/* $PAGE */
+/* $TITLE=ram_map() */
+/* ------------------------------------------------------------------ *\
+          Build Pico's RAM memory map from the linker script
+                  symbols, in increasing address order.
+     NOTES:
+     - Code and read-only data are what lies between the beginning of
+       RAM and the initialized data (firmware runs from RAM).
+     - Heap in use is what has been claimed by malloc() so far.
+     - Stack in use goes from the stack high-water mark to the top of
+       the stack (see stack_high_water()).
+     - Returns the number of regions.
+\* ------------------------------------------------------------------ */
+UINT8 ram_map(struct ram_region *Region)
+{
+  UINT8 Regions;
 
-  return;
+  UINT32 HeapEnd;
+  UINT32 StackLow;
+
+
+  /* Initializations. */
+  Regions = 0;
+  HeapEnd = (UINT32)__end__ + mallinfo().arena;
+
+
+  strcpy(Region[Regions].Name, "Code and read-only data");
+  Region[Regions].Start    = RAM_BASE_ADDRESS;
+  Region[Regions].Length   = (UINT32)__data_start__ - RAM_BASE_ADDRESS;
+  Region[Regions++].FlagDump = FLAG_OFF;
+
+  strcpy(Region[Regions].Name, "Initialized data (.data)");
+  Region[Regions].Start    = (UINT32)__data_start__;
+  Region[Regions].Length   = (UINT32)__data_end__ - (UINT32)__data_start__;
+  Region[Regions++].FlagDump = FLAG_ON;
+
+  strcpy(Region[Regions].Name, "Zero-initialized data (.bss)");
+  Region[Regions].Start    = (UINT32)__bss_start__;
+  Region[Regions].Length   = (UINT32)__bss_end__ - (UINT32)__bss_start__;
+  Region[Regions++].FlagDump = FLAG_ON;
+
+  strcpy(Region[Regions].Name, "Heap in use");
+  Region[Regions].Start    = (UINT32)__end__;
+  Region[Regions].Length   = HeapEnd - (UINT32)__end__;
+  Region[Regions++].FlagDump = FLAG_ON;
+
+  strcpy(Region[Regions].Name, "Heap free");
+  Region[Regions].Start    = HeapEnd;
+  Region[Regions].Length   = (UINT32)__HeapLimit - HeapEnd;
+  Region[Regions++].FlagDump = FLAG_OFF;
+
+  StackLow = stack_high_water((UINT32)__StackOneBottom, (UINT32)__StackOneTop);
+  strcpy(Region[Regions].Name, "Core 1 stack free");
+  Region[Regions].Start    = (UINT32)__StackOneBottom;
+  Region[Regions].Length   = StackLow - (UINT32)__StackOneBottom;
+  Region[Regions++].FlagDump = FLAG_OFF;
+
+  strcpy(Region[Regions].Name, "Core 1 stack in use");
+  Region[Regions].Start    = StackLow;
+  Region[Regions].Length   = (UINT32)__StackOneTop - StackLow;
+  Region[Regions++].FlagDump = FLAG_ON;
+
+  StackLow = stack_high_water((UINT32)__StackBottom, (UINT32)__StackTop);
+  strcpy(Region[Regions].Name, "Core 0 stack free");
+  Region[Regions].Start    = (UINT32)__StackBottom;
+  Region[Regions].Length   = StackLow - (UINT32)__StackBottom;
+  Region[Regions++].FlagDump = FLAG_OFF;
+
+  strcpy(Region[Regions].Name, "Core 0 stack in use");
+  Region[Regions].Start    = StackLow;
+  Region[Regions].Length   = (UINT32)__StackTop - StackLow;
+  Region[Regions++].FlagDump = FLAG_ON;
+
+  return Regions;
 }
 
 
@@ -1522,175 +7435,180 @@ void flash_test(void)
 
 
 /* $PAGE */
-/* $TITLE=flash_write() */
+/* $TITLE=stack_high_water() */
 /* ------------------------------------------------------------------ *\
-                    Write data to Pico's flash memory.
-                    To keep things simple in the code, 
-                always one sector is updated in the flash.
+      Find the lowest address ever used in a stack painted by
+                           stack_paint().
+     NOTE: Returns Bottom if the whole stack has been used (the stack
+           may have overflowed).
 \* ------------------------------------------------------------------ */
-UINT flash_write(UINT32 FlashMemoryOffset, UINT8 *Data, UINT16 DataSize)
+UINT32 stack_high_water(UINT32 Bottom, UINT32 Top)
 {
-  UCHAR Archive[TEST_RESULT_SIZE];
-  UCHAR String[256];
+  UINT32 *Pointer;
 
-  UINT16 Loop1UInt16;
 
-  UINT32 SectorOffset;
-  UINT32 InterruptMask;
+  for (Pointer = (UINT32 *)Bottom; (Pointer < (UINT32 *)Top) && (*Pointer == STACK_FILL); ++Pointer);
 
+  return (UINT32)Pointer;
+}
 
-  /* Initializations. */
-  SectorOffset      = FlashMemoryOffset;  // assume offset specified is on a sector boundary.
-  FlashMemoryOffset = 0;                  // assume that new data will be at the beginning of sector.
 
 
-  /***
-  uart_send(__LINE__, "\r");
 
-  sprintf(String, "Entering flash_write()     SectorOffset from XIP_BASE where to write: 0x%8.8X\r", SectorOffset);
-  uart_send(__LINE__, String);
 
-  sprintf(String, "Data address: 0x%8.8X   Data size:    0x%4.4X (%u)\r", Data, DataSize, DataSize);
-  uart_send(__LINE__, String);
+/* $PAGE */
+/* $TITLE=stack_paint() */
+/* ------------------------------------------------------------------ *\
+      Fill the unused part of the current core's stack with STACK_FILL
+                  so that its high-water mark may be found.
+     NOTES:
+     - Must be called by the core whose stack is painted, as early as
+       possible (stack space used before the call is not measured).
+     - STACK_PAINT_MARGIN bytes below the current stack pointer are
+       left untouched, for this function's own stack frame.
+\* ------------------------------------------------------------------ */
+void __not_in_flash_func(stack_paint)(UINT32 Bottom)
+{
+  volatile UINT32 Marker;  // its address is the current stack pointer, more or less.
 
-  sprintf(String, "FlashNewData: 0x%p   FlashOldData: 0x%p\r", FlashNewData, FlashOldData);
-  uart_send(__LINE__, String);
-  ***/
+  UINT32 *Pointer;
 
 
-  if (SectorOffset % FLASH_SECTOR_SIZE)
-  {
-    /* Offset specified is not aligned on a sector boundary. */
-    sprintf(String, "FlashMemoryOffset specified (0x%8.8X) is not aligned on a sector boundary (multiple of 4096)\r", SectorOffset);
-    uart_send(__LINE__, String);
+  for (Pointer = (UINT32 *)Bottom; Pointer < (UINT32 *)((UINT32)&Marker - STACK_PAINT_MARGIN); ++Pointer)
+    *Pointer = STACK_FILL;
 
-    sprintf(String, "Phased out by %u (0x%X) bytes.\r", SectorOffset % FLASH_SECTOR_SIZE, SectorOffset % FLASH_SECTOR_SIZE);
-    uart_send(__LINE__, String);
+  return;
+}
 
-    while (SectorOffset % FLASH_SECTOR_SIZE)
-    {
-      --SectorOffset;
-      ++FlashMemoryOffset;
-    }
 
-    sprintf(String, "Sector offset has been shifted down to 0x%8.8X...\r", SectorOffset);
-    uart_send(__LINE__, String);
 
-    sprintf(String, "...and data offset has been shifted up to 0x%X (%u) from sector start.\r", FlashMemoryOffset, FlashMemoryOffset);
-    uart_send(__LINE__, String);
-  }
 
 
-  if (FlashMemoryOffset + DataSize > 4096)
-  {
-    uart_send(__LINE__, "The arguments given cross a sector boundary which is not allowed...\r");
+/* $PAGE */
+/* $TITLE=status_begin() */
+/* ------------------------------------------------------------------ *\
+      Start reporting the progress of a job and arm the LED timer.
+     NOTES:
+     - A job is made of Steps passes over the flash range given (for
+       example one pass for each phase of each pattern of each cycle
+       of a flash test). Progress percentage is computed from the
+       step in progress (see status_phase()) and the last offset
+       reached during this step (see status_offset()).
+     - JobStatus has a single writer: core 0 in thread mode, through
+       the status_xxx() functions. Readers take a copy with
+       status_read(), there is no lock.
+\* ------------------------------------------------------------------ */
+void status_begin(UINT8 Mode, UINT32 StartOffset, UINT32 Length, UINT32 Steps)
+{
+  /* A job started from within another one replaces it. */
+  if (JobStatus.FlagActive == FLAG_ON) cancel_repeating_timer(&TimerMSec);
+
+  ++JobStatus.Sequence;
+  __dmb();
+  JobStatus.FlagActive  = FLAG_ON;
+  JobStatus.Mode        = Mode;
+  JobStatus.Phase       = PHASE_COUNT;
+  JobStatus.Cycle       = 0;
+  JobStatus.Percent     = 0;
+  JobStatus.StartOffset = StartOffset;
+  JobStatus.Length      = Length;
+  JobStatus.Offset      = StartOffset;
+  JobStatus.Step        = 0;
+  JobStatus.Steps       = (Steps ? Steps : 1);
+  JobStatus.Errors      = 0;
+  JobStatus.StartTime   = time_us_64();
+  __dmb();
+  ++JobStatus.Sequence;
+
+  StatusTicks = 0;
+  add_repeating_timer_ms(100, timer_callback_ms, NULL, &TimerMSec);
 
-    sprintf(String, "Sector offset: %X   FlashMemoryOffset: %X  Data size: %X\r\r\r", SectorOffset, FlashMemoryOffset, DataSize);
-    uart_send(__LINE__, String);
+  return;
+}
 
-    return 1;
-  }
 
 
-  /* A wear leveling algorithm has not been implemented.
-     Consequently, flash_write() must not be used for intensive data logging without adding a wear leveling algorithm. */
-  /* Take a copy of current flash content. */
-  for (Loop1UInt16 = 0; Loop1UInt16 < FLASH_SECTOR_SIZE; ++Loop1UInt16)
-    FlashOldData[Loop1UInt16] = FlashBaseAddress[SectorOffset + Loop1UInt16];
 
-  
-  /***
-  printf("=======================================================================================================\r");
-  uart_send(__LINE__, "Display original data retrieved from flash:\r");
 
-  sprintf(String, "FlashBaseAddress: 0x%p   FlashOldData: %p   SectorOffset: 0x%4.4X\r\r", FlashBaseAddress, FlashOldData, SectorOffset);
-  uart_send(__LINE__, String);
+/* $PAGE */
+/* $TITLE=status_end() */
+/* ------------------------------------------------------------------ *\
+      Stop reporting the progress of a job and disarm the LED timer.
+\* ------------------------------------------------------------------ */
+void status_end(void)
+{
+  if (JobStatus.FlagActive == FLAG_OFF) return;
 
-  display_memory(RAM_BASE_ADDRESS, (UINT32)(FlashOldData - RAM_BASE_ADDRESS), FLASH_SECTOR_SIZE);
-  
-  uart_send(__LINE__, "\r");
-  uart_send(__LINE__, "End of display original data retrieved from flash.\r");
-  printf("=======================================================================================================\r\r\r");
-  ***/
+  cancel_repeating_timer(&TimerMSec);
+  gpio_put(PICO_LED, false);
 
+  ++JobStatus.Sequence;
+  __dmb();
+  JobStatus.FlagActive = FLAG_OFF;
+  JobStatus.Phase      = PHASE_COUNT;
+  JobStatus.Percent    = 100;
+  __dmb();
+  ++JobStatus.Sequence;
 
-  /* Special handling of sector 0x7F000 containing Pico's manufacturing test results. */
-  if (SectorOffset == 0x7F000)
-  {
-    #ifdef RESTORE
-    #include "restore1.c"
-    #else
-    /* Keep track of Pico's manufacturing test results. */
-    for (Loop1UInt16 = 0; Loop1UInt16 < TEST_RESULT_SIZE; ++Loop1UInt16)
-      Archive[Loop1UInt16] = FlashBaseAddress[SectorOffset + Loop1UInt16];
-    #endif
+  return;
+}
 
-    /***
-    printf("=======================================================================================================\r");
-    sprintf(String, "Pico's manufacturing test results read back from flash:\r\r");
-    uart_send(__LINE__, String);
-    
-    display_memory(RAM_BASE_ADDRESS, (UINT32)(Archive - (UINT8 *)0x20000000), TEST_RESULT_SIZE);
-    
-    printf("\r");
-    sprintf(String, "End of Pico's manufacturing test results read back.\r");
-    uart_send(__LINE__, String);
-    printf("=======================================================================================================\r\r\r");
-    ***/
-  }
 
 
-  /* Overwrite target memory area with new data. 
-     NOTE: FlashNewData contains data to be written, passed in argument.
-           and FlashOldData contains original data (one sector) read from flash. */
-  memcpy(&FlashOldData[FlashMemoryOffset], Data, DataSize);
 
 
-  /* Special handling of sector 0x7F000 containing Pico's manufacturing test results. */
-  if (SectorOffset == 0x7F000)
-  {
-    /* Keep track of Pico's manufacturing test results. */
-    for (Loop1UInt16 = 0; Loop1UInt16 < TEST_RESULT_SIZE; ++Loop1UInt16)
-      FlashOldData[FlashMemoryOffset + Loop1UInt16] = Archive[Loop1UInt16];
-  }
+/* $PAGE */
+/* $TITLE=status_errors() */
+/* ------------------------------------------------------------------ *\
+          Update the number of errors found by the on-going job.
+\* ------------------------------------------------------------------ */
+void status_errors(UINT64 Errors)
+{
+  ++JobStatus.Sequence;
+  __dmb();
+  JobStatus.Errors = Errors;
+  __dmb();
+  ++JobStatus.Sequence;
 
-  
-  /***
-  printf("=======================================================================================================\r");
-  sprintf(String, "Data to be written to sector 0x%8.8X at offset 0x%4.4X:\r", SectorOffset, FlashMemoryOffset);
-  uart_send(__LINE__, String);
-  
-  sprintf(String, "Data: 0x%p   DataSize: 0x%4.4X (%u)\r", Data, DataSize, DataSize);
-  uart_send(__LINE__, String);
+  return;
+}
 
-  sprintf(String, "FlashBaseAddress: 0x%p\r\r", FlashBaseAddress);
-  uart_send(__LINE__, String);
 
-  display_memory(RAM_BASE_ADDRESS, (UINT32)(FlashOldData - RAM_BASE_ADDRESS), FLASH_SECTOR_SIZE);
-  ***/
 
 
-  /* Keep track of interrupt mask and disable interrupts during flash writing. */
-  InterruptMask = save_and_disable_interrupts();
 
-  /* Erase flash before reprogramming. */
-  flash_range_erase(SectorOffset, FLASH_SECTOR_SIZE);
-  
-  /* Save data to flash memory. */
-  flash_range_program(SectorOffset, FlashOldData, FLASH_SECTOR_SIZE);
+/* $PAGE */
+/* $TITLE=status_offset() */
+/* ------------------------------------------------------------------ *\
+      Update the last flash offset reached by the on-going job and
+                     its progress percentage.
+     NOTE: Called by console_poll() before each sector of long
+           operations, so it must stay cheap.
+\* ------------------------------------------------------------------ */
+void status_offset(UINT32 Offset)
+{
+  UINT32 Done;
+  UINT32 Percent;
 
-  /* Restore original interrupt mask when done. */
-  restore_interrupts(InterruptMask);
 
+  /* Part of the current step already done, in percent. */
+  Done = 0;
+  if ((Offset > JobStatus.StartOffset) && (JobStatus.Length != 0))
+    Done = (UINT32)(((UINT64)(Offset - JobStatus.StartOffset) * 100) / JobStatus.Length);
+  if (Done > 100) Done = 100;
 
-  /***
-  printf("\r");
-  sprintf(String, "End of flash_write(%u, %u)\r", FlashMemoryOffset, DataSize);
-  uart_send(__LINE__, String);
-  printf("========================================================================================================\r\r\r");
-  ***/
+  /* Work done after the last step (for example the final erase of a flash test) never goes beyond 100%. */
+  Percent = ((JobStatus.Step * 100) + Done) / JobStatus.Steps;
+  if (Percent > 100) Percent = 100;
 
-  return 0;
+  ++JobStatus.Sequence;
+  __dmb();
+  JobStatus.Offset  = Offset;
+  JobStatus.Percent = (UINT8)Percent;
+  __dmb();
+  ++JobStatus.Sequence;
+
+  return;
 }
 
 
@@ -1698,67 +7616,62 @@ UINT flash_write(UINT32 FlashMemoryOffset, UINT8 *Data, UINT16 DataSize)
 
 
 /* $PAGE */
-/* $TITLE=input_string() */
+/* $TITLE=status_phase() */
 /* ------------------------------------------------------------------ *\
-                       Read a string from stdin.
+                 Update the phase of the on-going job.
+     NOTE: Step is the number of steps of the job already completed.
+           Progress is kept at 100% at most.
 \* ------------------------------------------------------------------ */
-void input_string(UCHAR *String)
+void status_phase(UINT8 Phase, UINT8 Cycle, UINT32 Step)
 {
-  int8_t DataInput;
+  UINT32 Percent;
 
-  UINT8 Loop1UInt8;
 
+  Percent = (UINT32)(((UINT64)Step * 100) / JobStatus.Steps);
+  if (Percent > 100) Percent = 100;
 
-  Loop1UInt8 = 0;
-  do
-  {
-    DataInput = getchar_timeout_us(50000);
+  ++JobStatus.Sequence;
+  __dmb();
+  JobStatus.Phase   = Phase;
+  JobStatus.Cycle   = Cycle;
+  JobStatus.Step    = Step;
+  JobStatus.Offset  = JobStatus.StartOffset;
+  JobStatus.Percent = (UINT8)Percent;
+  __dmb();
+  ++JobStatus.Sequence;
 
-    switch (DataInput)
-    {
-      case (PICO_ERROR_TIMEOUT):
-      case (0):
-        continue;
-      break;
+  return;
+}
 
-      case (8):
-        /* <Backspace> */
-        if (Loop1UInt8 > 0)
-        {
-          --Loop1UInt8;
-          String[Loop1UInt8] = 0x00;
-          printf("%c %c", 0x08, 0x08);  // erase character under the cursor.
-        }
-      break;
 
-      case (0x0D):
-        /* <Enter> */
-        if (Loop1UInt8 == 0)
-        {
-          String[Loop1UInt8++] = (UCHAR)DataInput;  
-          String[Loop1UInt8++] = 0x00;
-        }
-        printf("\r");
-      break;
 
-      default:
-        printf("%c", (UCHAR)DataInput);
-        String[Loop1UInt8] = (UCHAR)DataInput;
-        // printf("Loop1UInt8: %3u   %2.2X - %c\r", Loop1UInt8, DataInput, DataInput);  ///
-        ++Loop1UInt8;
-      break;
-    }
-  } while((Loop1UInt8 < 128) && (DataInput != 0x0D));
-  
-  String[Loop1UInt8] = '\0';  // end-of-string
 
-  /***
-  for (Loop1UInt8 = 0; Loop1UInt8 < 10; ++Loop1UInt8)
-    printf("%2u:[%2.2X]   ", Loop1UInt8, String[Loop1UInt8]);
-  printf("\r");
-  ***/
 
-  return;
+/* $PAGE */
+/* $TITLE=status_read() */
+/* ------------------------------------------------------------------ *\
+                 Take a consistent copy of the job status.
+     NOTES:
+     - Returns FLAG_OFF when the copy may be inconsistent because the
+       job status was being updated. There is no retry: a timer
+       callback may have interrupted the writer, which can't go on
+       before the callback returns.
+     - Always consistent when called from core 0 in thread mode, that
+       is from the only writer.
+\* ------------------------------------------------------------------ */
+UINT8 status_read(struct job_status *Status)
+{
+  UINT32 Sequence;
+
+
+  Sequence = JobStatus.Sequence;
+  __dmb();
+  memcpy(Status, &JobStatus, sizeof(struct job_status));
+  __dmb();
+
+  if ((Sequence & 1) || (JobStatus.Sequence != Sequence)) return FLAG_OFF;
+
+  return FLAG_ON;
 }
 
 
@@ -1771,67 +7684,28 @@ void input_string(UCHAR *String)
                 Hundred millisecond callback function.
      Callback function used to blink Pico's LED to indicate to user
               what is the current on-going write cycle.
+     NOTES:
+     - Timer is only armed while a job is running (see status_begin()
+       and status_end()), nothing is done when the Pico is idle.
+     - Every 15 seconds, LED blinks once per write cycle started
+       (once for jobs other than flash test): 200 msec On, 300 msec
+       Off. LED state only depends on StatusTicks and on the cycle
+       read from the job status.
+     - When the job status is being updated, LED is left as is until
+       next period.
 \* ------------------------------------------------------------------ */
 bool timer_callback_ms(struct repeating_timer *TimerMSec)
 {
-  static UINT16 MSecCounter;
-  static UINT16 CycleCount;
-  static UINT8 FlagCurrentBlink;
-  static UINT8 FlagLedStatus;
-
+  UINT32 Position;
 
-  /* Display current cycle only if we are running a flash test. */
-  if (SoftwareMode != MODE_FLASH_TEST) return true;
+  struct job_status Status;
 
-  ++MSecCounter;  // one more 100 milliseconds period elapsed.
 
-  /* Blink current cycle every 15 seconds. */
-  if (FlagCurrentBlink == FLAG_OFF)
-  {
-    if (MSecCounter >= (15 * 10))
-    {
-      FlagCurrentBlink = FLAG_ON;
-      MSecCounter      = 0;  // reset 100 milliseconds counter.
-    }
-    else
-    {
-      return true;
-    }
-  }
+  Position = (StatusTicks++ % (15 * 10));  // position in the 15 seconds period, in 100 milliseconds units.
 
+  if (status_read(&Status) == FLAG_OFF) return true;
 
-  /* There is a blink in progress. */
-  if (FlagLedStatus == FLAG_ON)
-  {
-    /* LED On for 200 milliseconds. */
-    if (MSecCounter >= 2)
-    {
-      /* Turn Off LED. */
-      gpio_put(PICO_LED, false);
-      FlagLedStatus = FLAG_OFF;
-      MSecCounter   = 0;  // reset 100 milliseconds counter.
-      
-      /* If we reached total number of blinks required, stop it. */
-      if (CycleCount >= (WriteCycle + 1))
-      {
-        MSecCounter      = 0;         // reset 15 seconds counter for next blink.
-        CycleCount       = 0;         // get prepared for next cycle number to blink in 15 seconds.
-        FlagCurrentBlink = FLAG_OFF;  // no more blink in progress.
-      }
-    }
-  }
-  else
-  {
-    /* LED Off for 300 milliseconds. */
-    if (MSecCounter >= 3)
-    {
-      /* LED is Off, turn it On. */
-      gpio_put(PICO_LED, true);
-      FlagLedStatus = FLAG_ON;
-      MSecCounter   = 0;  // reset 15 seconds counter for next blink.
-      ++CycleCount;
-    }
-  }
+  gpio_put(PICO_LED, ((Position < ((Status.Cycle + 1) * 5)) && ((Position % 5) < 2)));
 
   return true;
 }
@@ -1888,7 +7762,10 @@ void uart_send(UINT16 LineNumber, UCHAR *String)
 
   /* Send log string through UART. */
   sprintf(&LineString[strlen(LineString)], String);
-  printf(LineString);
+  if (FlagLogActive == FLAG_ON)
+    log_write(LineString, strlen(LineString));  // no need to go through printf() a second time.
+  else
+    printf(LineString);
 
   return;
 }
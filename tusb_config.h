@@ -0,0 +1,40 @@
+/* ================================================================== *\
+   tusb_config.h
+   TinyUSB configuration used when the USB_VENDOR_BULK option is set
+   (see CMakeLists.txt and usb_descriptors.c).
+
+   NOTES:
+   - Interface 0/1 remains the CDC used by stdio (menus, text output
+     and command mode).
+   - Interface 2 is a vendor-class interface with one bulk IN and one
+     bulk OUT endpoint, used for binary transfers (see binary_send()).
+   - Vendor TX FIFO holds more than two binary frames (2 x 1035
+     bytes), so that the USB stack sends one frame while the next one
+     is being built. Vendor RX FIFO is the same size, so that the host
+     may keep sending upload frames while a sector is programmed.
+\* ================================================================== */
+#ifndef _TUSB_CONFIG_H_
+#define _TUSB_CONFIG_H_
+
+#define CFG_TUSB_RHPORT0_MODE     (OPT_MODE_DEVICE)
+#define CFG_TUSB_OS               OPT_OS_PICO
+
+#define CFG_TUD_ENDPOINT0_SIZE    64
+
+/* Device classes. */
+#define CFG_TUD_CDC               1
+#define CFG_TUD_MSC               0
+#define CFG_TUD_HID               0
+#define CFG_TUD_MIDI              0
+#define CFG_TUD_VENDOR            1
+
+/* CDC used by stdio. */
+#define CFG_TUD_CDC_RX_BUFSIZE    256
+#define CFG_TUD_CDC_TX_BUFSIZE    256
+
+/* Vendor bulk endpoint for binary transfers (a binary frame is at most 7 + 1024 + 4 bytes). */
+#define CFG_TUD_VENDOR_EPSIZE     64
+#define CFG_TUD_VENDOR_RX_BUFSIZE 4096
+#define CFG_TUD_VENDOR_TX_BUFSIZE 4096
+
+#endif  // _TUSB_CONFIG_H_
@@ -0,0 +1,159 @@
+/* ================================================================== *\
+   usb_descriptors.c
+   USB descriptors used when the USB_VENDOR_BULK option is set
+   (see CMakeLists.txt and tusb_config.h).
+
+   NOTES:
+   - Pico-Flash-Utility is then seen as a composite device:
+       interfaces 0 and 1   CDC used by stdio (menus and text output).
+       interface  2         vendor class, bulk endpoints 0x03 (OUT)
+                            and 0x83 (IN) for binary transfers.
+   - The CDC interface comes first, so that stdio_usb keeps using it
+     as when it provides its own descriptors.
+   - Serial number string is Pico's unique number, as with the
+     standard stdio_usb descriptors.
+\* ================================================================== */
+#include "pico/unique_id.h"
+#include "string.h"
+#include "tusb.h"
+#include "version.h"
+
+
+
+/* ------------------------------------------------------------------ *\
+                            Definitions.
+\* ------------------------------------------------------------------ */
+#define USBD_VID            0x2E8A  // Raspberry Pi.
+#define USBD_PID            0x000A  // Raspberry Pi Pico SDK CDC.
+#define USBD_BCD_DEVICE     FIRMWARE_VERSION  // firmware version (see version.h), so that the host doesn't reuse the CDC-only configuration.
+
+#define USBD_MAX_POWER_MA   250
+
+#define ITF_NUM_CDC         0
+#define ITF_NUM_CDC_DATA    1
+#define ITF_NUM_VENDOR      2
+#define ITF_NUM_TOTAL       3
+
+#define EP_CDC_NOTIFY       0x81
+#define EP_CDC_OUT          0x02
+#define EP_CDC_IN           0x82
+#define EP_VENDOR_OUT       0x03
+#define EP_VENDOR_IN        0x83
+
+#define STR_LANGUAGE        0
+#define STR_MANUFACTURER    1
+#define STR_PRODUCT         2
+#define STR_SERIAL          3
+#define STR_CDC             4
+#define STR_VENDOR          5
+
+#define CONFIG_TOTAL_LEN    (TUD_CONFIG_DESC_LEN + TUD_CDC_DESC_LEN + TUD_VENDOR_DESC_LEN)
+
+#define STRING_MAX_LENGTH   48  // longest string descriptor, in characters.
+
+
+
+/* ------------------------------------------------------------------ *\
+                             Descriptors.
+\* ------------------------------------------------------------------ */
+static const tusb_desc_device_t DeviceDescriptor =
+{
+  .bLength            = sizeof(tusb_desc_device_t),
+  .bDescriptorType    = TUSB_DESC_DEVICE,
+  .bcdUSB             = 0x0200,
+  .bDeviceClass       = TUSB_CLASS_MISC,  // composite device with interface association descriptor.
+  .bDeviceSubClass    = MISC_SUBCLASS_COMMON,
+  .bDeviceProtocol    = MISC_PROTOCOL_IAD,
+  .bMaxPacketSize0    = CFG_TUD_ENDPOINT0_SIZE,
+  .idVendor           = USBD_VID,
+  .idProduct          = USBD_PID,
+  .bcdDevice          = USBD_BCD_DEVICE,
+  .iManufacturer      = STR_MANUFACTURER,
+  .iProduct           = STR_PRODUCT,
+  .iSerialNumber      = STR_SERIAL,
+  .bNumConfigurations = 1
+};
+
+static const uint8_t ConfigurationDescriptor[] =
+{
+  TUD_CONFIG_DESCRIPTOR(1, ITF_NUM_TOTAL, 0, CONFIG_TOTAL_LEN, 0, USBD_MAX_POWER_MA),
+  TUD_CDC_DESCRIPTOR(ITF_NUM_CDC, STR_CDC, EP_CDC_NOTIFY, 8, EP_CDC_OUT, EP_CDC_IN, 64),
+  TUD_VENDOR_DESCRIPTOR(ITF_NUM_VENDOR, STR_VENDOR, EP_VENDOR_OUT, EP_VENDOR_IN, CFG_TUD_VENDOR_EPSIZE)
+};
+
+static const char *StringDescriptor[] =
+{
+  [STR_MANUFACTURER] = "Raspberry Pi",
+  [STR_PRODUCT]      = "Pico-Flash-Utility",
+  [STR_SERIAL]       = NULL,  // Pico's unique number.
+  [STR_CDC]          = "Pico-Flash-Utility console",
+  [STR_VENDOR]       = "Pico-Flash-Utility binary transfers"
+};
+
+
+
+/* ------------------------------------------------------------------ *\
+                         TinyUSB callbacks.
+\* ------------------------------------------------------------------ */
+/* Device descriptor requested by the host. */
+const uint8_t *tud_descriptor_device_cb(void)
+{
+  return (const uint8_t *)&DeviceDescriptor;
+}
+
+
+
+/* Configuration descriptor requested by the host. */
+const uint8_t *tud_descriptor_configuration_cb(uint8_t Index)
+{
+  (void)Index;
+
+  return ConfigurationDescriptor;
+}
+
+
+
+/* String descriptor requested by the host (UTF-16). */
+const uint16_t *tud_descriptor_string_cb(uint8_t Index, uint16_t LanguageId)
+{
+  static uint16_t Descriptor[1 + STRING_MAX_LENGTH];
+  static char Serial[(2 * PICO_UNIQUE_BOARD_ID_SIZE_BYTES) + 1];
+
+  const char *String;
+
+  uint8_t Length;
+  uint8_t Loop1UInt8;
+
+
+  (void)LanguageId;
+
+  if (Index == STR_LANGUAGE)
+  {
+    Descriptor[1] = 0x0409;  // English.
+    Length = 1;
+  }
+  else
+  {
+    if (Index >= (sizeof(StringDescriptor) / sizeof(StringDescriptor[0]))) return NULL;
+
+    if (Index == STR_SERIAL)
+    {
+      pico_get_unique_board_id_string(Serial, sizeof(Serial));
+      String = Serial;
+    }
+    else
+    {
+      String = StringDescriptor[Index];
+    }
+
+    Length = strlen(String);
+    if (Length > STRING_MAX_LENGTH) Length = STRING_MAX_LENGTH;
+    for (Loop1UInt8 = 0; Loop1UInt8 < Length; ++Loop1UInt8)
+      Descriptor[1 + Loop1UInt8] = String[Loop1UInt8];
+  }
+
+  /* First element gives descriptor type and length in bytes. */
+  Descriptor[0] = (TUSB_DESC_STRING << 8) | (2 * Length + 2);
+
+  return Descriptor;
+}
@@ -0,0 +1,16 @@
+/* ================================================================== *\
+   version.h
+   Firmware version, shared by Pico-Flash-Utility.c (command mode
+   READY reply) and usb_descriptors.c (USB device release number).
+
+   NOTES:
+   - Version is kept in BCD, as USB bcdDevice: 0x0210 is version 2.10.
+   - Update it together with the REVISION HISTORY of
+     Pico-Flash-Utility.c.
+\* ================================================================== */
+#ifndef _VERSION_H_
+#define _VERSION_H_
+
+#define FIRMWARE_VERSION    0x0210
+
+#endif  // _VERSION_H_